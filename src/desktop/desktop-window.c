@@ -3422,6 +3422,8 @@ void paint_item( DesktopWindow* self, DesktopItem* item, GdkRectangle* expose_ar
     
     if ( !item->fi )
         return;   // empty
+    if ( G_UNLIKELY( item->fi->mime_pending ) && self->dir )
+        vfs_dir_request_mime_type( self->dir, item->fi );
     const char* text = item->fi->disp_name;
     GtkWidget* widget = (GtkWidget*)self;
 #if !GTK_CHECK_VERSION (3, 0, 0)
@@ -3437,7 +3439,11 @@ void paint_item( DesktopWindow* self, DesktopItem* item, GdkRectangle* expose_ar
     if ( item->fi->big_thumbnail )
         icon = g_object_ref( item->fi->big_thumbnail );
     else
+    {
+        if ( self->dir )
+            vfs_thumbnail_loader_raise( self->dir, item->fi );
         icon = vfs_file_info_get_big_icon( item->fi );
+    }
 
     if( item->is_selected )
         state = GTK_CELL_RENDERER_SELECTED;
@@ -3845,6 +3851,10 @@ int comp_item_by_type( DesktopItem* item1, DesktopItem* item2, DesktopWindow* wi
     int ret;
     if( ret = COMP_VIRTUAL( item1, item2 ) )
         return ret;
+    if ( G_UNLIKELY( item1->fi->mime_pending ) && win->dir )
+        vfs_dir_load_mime_type( win->dir, item1->fi );
+    if ( G_UNLIKELY( item2->fi->mime_pending ) && win->dir )
+        vfs_dir_load_mime_type( win->dir, item2->fi );
     ret = g_strcmp0( item1->fi->mime_type->type, item2->fi->mime_type->type );
 
     if ( ret == 0 )  //sfm
@@ -4049,6 +4059,8 @@ GList* desktop_window_get_selected_files( DesktopWindow* win )
         }
         else
         {
+            if ( G_UNLIKELY( item->fi->mime_pending ) && win->dir )
+                vfs_dir_load_mime_type( win->dir, item->fi );
             l->data = vfs_file_info_ref( item->fi );
             l = l->next;
         }
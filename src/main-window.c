@@ -7320,6 +7320,19 @@ _invalid_set:
             *reply = g_strdup_printf( "%s\n", 
                                     ptk_file_browser_get_cwd( file_browser ) );
         }
+        else if ( !strcmp( argv[i], "dir_cache_stats" ) )
+        {
+            guint hits, misses, n_idle;
+            gsize idle_bytes;
+            vfs_dir_get_cache_stats( &hits, &misses, &n_idle, &idle_bytes );
+            *reply = g_strdup_printf( "hits=%u misses=%u idle=%u idle_bytes=%lu\n",
+                                      hits, misses, n_idle,
+                                      (unsigned long)idle_bytes );
+        }
+        else if ( !strcmp( argv[i], "dir_memory_report" ) )
+        {
+            *reply = vfs_dir_get_memory_report();
+        }
         else if ( !strcmp( argv[i], "edit_file" ) )
         { }
         else if ( !strcmp( argv[i], "run_in_terminal" ) )
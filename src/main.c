@@ -37,14 +37,17 @@
 #include "vfs-app-desktop.h"
 
 #include "vfs-file-monitor.h"
+#include "vfs-dir.h"
 #include "vfs-volume.h"
 #include "vfs-thumbnail-loader.h"
+#include "vfs-file-task.h"
 
 #include "ptk-utils.h"
 #include "ptk-app-chooser.h"
 #include "ptk-file-properties.h"
 #include "ptk-file-menu.h"
 #include "ptk-location-view.h"
+#include "ptk-file-list.h"
 
 #include "find-files.h"
 #include "pref-dialog.h"
@@ -106,6 +109,24 @@ static gboolean custom_dialog = FALSE;  //sfm
 static gboolean socket_cmd = FALSE;     //sfm
 static gboolean version_opt = FALSE;     //sfm
 static gboolean sdebug = FALSE;         //sfm
+static char* dir_loader = NULL;         //sfm
+static int dir_load_threads = 0;        //sfm
+static gboolean no_lazy_mime = FALSE;   //sfm
+static int bench_dir_events = 0;        //sfm
+static int bench_file_list = 0;         //sfm
+static char* check_mime_globs = NULL;   //sfm
+static char* bench_mime_magic = NULL;   //sfm
+static gboolean mime_memo = FALSE;      //sfm
+static char* bench_thumbnails = NULL;   //sfm
+static gboolean thumbnailer = FALSE;    //sfm
+static gboolean no_thumbnailer = FALSE; //sfm
+static char* bench_copy = NULL;         //sfm
+static int copy_threads = 0;            //sfm
+static int plan_mem = 0;                //sfm
+static gboolean no_plan = FALSE;        //sfm
+static gboolean no_plan_spill = FALSE;  //sfm
+static char* bench_delete = NULL;       //sfm
+static int delete_threads = -1;         //sfm
 static gboolean socket_daemon_or_desktop = FALSE;  //sfm
 
 static int show_pref = 0;
@@ -151,6 +172,24 @@ static GOptionEntry opt_entries[] =
     { "version", '\0', 0, G_OPTION_ARG_NONE, &version_opt, N_("Show version information"), NULL },
 
     { "sdebug", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &sdebug, NULL, NULL },
+    { "dir-loader", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &dir_loader, NULL, NULL },
+    { "dir-load-threads", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &dir_load_threads, NULL, NULL },
+    { "no-lazy-mime", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &no_lazy_mime, NULL, NULL },
+    { "bench-dir-events", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &bench_dir_events, NULL, NULL },
+    { "bench-file-list", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &bench_file_list, NULL, NULL },
+    { "check-mime-globs", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &check_mime_globs, NULL, NULL },
+    { "bench-mime-magic", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &bench_mime_magic, NULL, NULL },
+    { "mime-memo", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &mime_memo, NULL, NULL },
+    { "bench-thumbnails", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &bench_thumbnails, NULL, NULL },
+    { "thumbnailer", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &thumbnailer, NULL, NULL },
+    { "no-thumbnailer", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &no_thumbnailer, NULL, NULL },
+    { "bench-copy", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &bench_copy, NULL, NULL },
+    { "copy-threads", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &copy_threads, NULL, NULL },
+    { "plan-mem", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &plan_mem, NULL, NULL },
+    { "no-plan", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &no_plan, NULL, NULL },
+    { "no-plan-spill", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &no_plan_spill, NULL, NULL },
+    { "bench-delete", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &bench_delete, NULL, NULL },
+    { "delete-threads", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &delete_threads, NULL, NULL },
 
 #ifdef HAVE_HAL
     /* hidden arguments used to mount volumes */
@@ -774,6 +813,8 @@ void show_socket_help()
     printf( "clipboard_primary_from_file     %s\n", _("eg '~/copy-file-contents-to-clipboard.txt'") );
     printf( "clipboard_copy_files            %s\n", _("FILE...  Files copied to clipboard") );
     printf( "clipboard_cut_files             %s\n", _("FILE...  Files cut to clipboard") );
+    printf( "dir_cache_stats                 %s\n", _("folder listing cache hits/misses  (read-only)") );
+    printf( "dir_memory_report               %s\n", _("memory used by each folder listing  (read-only)") );
 
     printf( "\n%s\n", _("TASK PROPERTIES\n---------------") );
     printf( "status                          %s\n", _("contents of Status task column  (read-only)") );
@@ -1328,6 +1369,15 @@ int main ( int argc, char *argv[] )
     textdomain ( GETTEXT_PACKAGE );
 #endif
 
+    // --thumbnailer  make thumbnails requested on stdin (see
+    // vfs-thumbnail-loader.c) - spawned once per pool thread, so without
+    // the config or a display connection
+    if ( argc > 1 && !strcmp( argv[1], "--thumbnailer" ) )
+    {
+        g_type_init();
+        return vfs_thumbnail_helper_main();
+    }
+
     // load spacefm.conf
     load_conf();
     
@@ -1466,6 +1516,57 @@ int main ( int argc, char *argv[] )
     g_thread_init( NULL );
     gdk_threads_init ();
 
+    // --bench-dir-events=N  replay inotify event storms against a dir of N files
+    if ( G_UNLIKELY( bench_dir_events > 0 ) )
+    {
+        vfs_dir_bench_events( bench_dir_events );
+        return 0;
+    }
+    // --bench-file-list=N  tree model calls per second on a list of N rows
+    if ( G_UNLIKELY( bench_file_list > 0 ) )
+    {
+        ptk_file_list_bench( bench_file_list );
+        return 0;
+    }
+    // --check-mime-globs=DIR  compare the glob index with fnmatch for all
+    // file names under DIR
+    if ( G_UNLIKELY( check_mime_globs ) )
+    {
+        mime_type_init();
+        return mime_type_check_globs( check_mime_globs ) ? 1 : 0;
+    }
+    // --bench-mime-magic=DIR  content sniffs per second for files under DIR
+    if ( G_UNLIKELY( bench_mime_magic ) )
+    {
+        mime_type_init();
+        mime_type_bench_magic( bench_mime_magic );
+        return 0;
+    }
+    if ( G_UNLIKELY( thumbnailer ) )
+    {
+        fprintf( stderr, "spacefm: %s\n", "--thumbnailer must be first option" );
+        return 1;
+    }
+    // --bench-thumbnails=DIR  thumbnails per second for the jpegs in DIR
+    if ( G_UNLIKELY( bench_thumbnails ) )
+    {
+        vfs_thumbnail_bench( bench_thumbnails, 128 );
+        return 0;
+    }
+    // --bench-copy=FILE  MB/s of each copy method on the file system of FILE
+    if ( G_UNLIKELY( bench_copy ) )
+    {
+        vfs_file_task_bench_copy( bench_copy );
+        return 0;
+    }
+    // --bench-delete=DIR  entries/s deleting a 1M entry tree made in DIR,
+    // path based and with unlinkat on 1 to 8 threads
+    if ( G_UNLIKELY( bench_delete ) )
+    {
+        vfs_file_task_bench_delete( bench_delete, 1000000 );
+        return 0;
+    }
+
 #if HAVE_HAL
     /* If the user wants to mount/umount/eject a device */
     if( G_UNLIKELY( mount || umount || eject ) )
@@ -1496,9 +1597,43 @@ int main ( int argc, char *argv[] )
     /* Initialize our mime-type system */
     vfs_mime_type_init();
 
+    // --mime-memo  keep sniffed mime types across sessions
+    char* mime_memo_path = NULL;
+    if ( mime_memo )
+    {
+        mime_memo_path = g_build_filename( g_get_user_cache_dir(), "spacefm",
+                                                        "mime-memo", NULL );
+        mime_type_memo_load( mime_memo_path );
+    }
+
     load_settings( config_dir );    /* load config file */  //MOD was before vfs_file_monitor_init
 
     app_settings.sdebug = sdebug;
+
+    // --dir-loader=classic|batch|progressive --dir-load-threads=N
+    // (with --sdebug, entries/s are reported)
+    VFSDirLoadMode load_mode = VFS_DIR_LOAD_BATCH;
+    if ( !g_strcmp0( dir_loader, "classic" ) )
+        load_mode = VFS_DIR_LOAD_CLASSIC;
+    else if ( !g_strcmp0( dir_loader, "progressive" ) )
+        load_mode = VFS_DIR_LOAD_PROGRESSIVE;
+    vfs_dir_set_load_mode( load_mode, dir_load_threads, sdebug );
+    vfs_dir_set_lazy_mime( !no_lazy_mime );
+    // --no-thumbnailer  decode thumbnails in this process
+    vfs_thumbnail_set_helper( !no_thumbnailer );
+    // --copy-threads=N  copy files of a tree with N threads (1 = serial)
+    if ( copy_threads > 0 )
+        vfs_file_task_set_copy_threads( copy_threads );
+    // --plan-mem=MB --no-plan --no-plan-spill  tree listing kept for a task
+    if ( no_plan )
+        vfs_file_task_set_plan_mem( 0 );
+    else if ( plan_mem > 0 )
+        vfs_file_task_set_plan_mem( plan_mem );
+    if ( no_plan_spill )
+        vfs_file_task_set_plan_spill( FALSE );
+    // --delete-threads=N  delete trees with N threads (0 = path based)
+    if ( delete_threads >= 0 )
+        vfs_file_task_set_delete_threads( delete_threads );
     
 /*
     // temporarily turn off desktop if needed
@@ -1556,6 +1691,14 @@ int main ( int argc, char *argv[] )
     }
 */
     vfs_volume_finalize();
+    if ( mime_memo_path )
+    {
+        char* cache_dir = g_path_get_dirname( mime_memo_path );
+        g_mkdir_with_parents( cache_dir, 0700 );
+        g_free( cache_dir );
+        mime_type_memo_save( mime_memo_path );
+        g_free( mime_memo_path );
+    }
     vfs_mime_type_clean();
     vfs_file_monitor_clean();
     tmp_clean();
@@ -18,6 +18,10 @@
  *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
  *      MA 02110-1301, USA.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // memmem
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -73,8 +77,218 @@ MimeCache* mime_cache_new( const char* file_path )
     return cache;
 }
 
+/*
+ * Glob index
+ * Each glob gets its literal prefix (up to the first wildcard) and literal
+ * suffix (after the last wildcard), and is put in a bucket keyed by its
+ * first and last character, or GLOB_ANY_CHAR if that is a wildcard.  A
+ * filename then only needs the globs of four buckets, and cheap prefix and
+ * suffix compares reject most of them before fnmatch is called.
+ */
+#define GLOB_ANY_CHAR   256
+#define GLOB_KEY( first, last )  GUINT_TO_POINTER( ( (first) << 9 | (last) ) + 1 )
+
+typedef struct
+{
+    const char* glob;
+    const char* type;
+    guint32 index;      /* position in the glob list, earlier wins ties */
+    guint16 len;
+    guint16 prefix_len;
+    guint16 suffix_len;
+    gboolean literal;   /* no wildcards - a plain string compare */
+} MimeGlob;
+
+struct _MimeGlobIndex
+{
+    MimeGlob* globs;
+    GHashTable* buckets;    /* GLOB_KEY -> GArray of MimeGlob* */
+};
+
+static gboolean is_glob_char( char c )
+{
+    /* ']' is included so a bracket expression like "[]]" is never taken
+     * as a literal suffix */
+    return c == '*' || c == '?' || c == '[' || c == ']' || c == '\\';
+}
+
+static void glob_index_free( struct _MimeGlobIndex* index )
+{
+    GHashTableIter it;
+    gpointer bucket;
+
+    if ( !index )
+        return;
+    g_hash_table_iter_init( &it, index->buckets );
+    while ( g_hash_table_iter_next( &it, NULL, &bucket ) )
+        g_array_free( (GArray*)bucket, TRUE );
+    g_hash_table_destroy( index->buckets );
+    g_free( index->globs );
+    g_slice_free( struct _MimeGlobIndex, index );
+}
+
+static struct _MimeGlobIndex* glob_index_new( MimeCache* cache )
+{
+    struct _MimeGlobIndex* index;
+    const char* entry = cache->globs;
+    size_t entry_size = cache->has_str_weight ? 12 : 8;
+    MimeGlob* g;
+    GArray* bucket;
+    guint i, first, last;
+    int j;
+
+    index = g_slice_new( struct _MimeGlobIndex );
+    index->globs = g_new0( MimeGlob, cache->n_globs );
+    index->buckets = g_hash_table_new( g_direct_hash, g_direct_equal );
+    for ( i = 0; i < cache->n_globs; ++i, entry += entry_size )
+    {
+        g = &index->globs[ i ];
+        g->glob = cache->buffer + VAL32( entry, 0 );
+        g->type = cache->buffer + VAL32( entry, 4 );
+        g->index = i;
+        g->len = strlen( g->glob );
+        if ( G_UNLIKELY( !g->len ) )
+            continue;   /* never wins, see mime_cache_lookup_glob_fnmatch */
+        for ( j = 0; j < g->len && !is_glob_char( g->glob[ j ] ); ++j );
+        g->prefix_len = j;
+        g->literal = ( j == g->len );
+        if ( !g->literal )
+        {
+            for ( j = g->len; j > 0 && !is_glob_char( g->glob[ j - 1 ] ); --j );
+            g->suffix_len = g->len - j;
+        }
+        first = g->prefix_len ? (guchar)g->glob[ 0 ] : GLOB_ANY_CHAR;
+        last = g->literal || g->suffix_len ?
+                        (guchar)g->glob[ g->len - 1 ] : GLOB_ANY_CHAR;
+
+        bucket = (GArray*)g_hash_table_lookup( index->buckets,
+                                               GLOB_KEY( first, last ) );
+        if ( !bucket )
+        {
+            bucket = g_array_new( FALSE, FALSE, sizeof( MimeGlob* ) );
+            g_hash_table_insert( index->buckets, GLOB_KEY( first, last ),
+                                                                    bucket );
+        }
+        g_array_append_val( bucket, g );
+    }
+    return index;
+}
+
+/*
+ * Magic dispatch table
+ * A magic whose top level rules all compare a value at a fixed offset can
+ * only match if one of those values starts with the byte found at that
+ * offset, so these magics are indexed by (offset, first byte).  Only the
+ * magics found in the table for the data, plus those that can't be indexed
+ * (range or masked rules), are tried - still in cache order.
+ */
+#define MAGIC_KEY( offset, byte )  GUINT_TO_POINTER( ( (offset) << 8 | (byte) ) + 1 )
+
+struct _MimeMagicIndex
+{
+    guint8* always;         /* per magic: not indexed, always tried */
+    GArray* offsets;        /* distinct guint32 offsets in the table */
+    GHashTable* table;      /* MAGIC_KEY -> GArray of guint32 magic index */
+};
+
+static void magic_index_free( struct _MimeMagicIndex* index )
+{
+    GHashTableIter it;
+    gpointer value;
+
+    if ( !index )
+        return;
+    g_hash_table_iter_init( &it, index->table );
+    while ( g_hash_table_iter_next( &it, NULL, &value ) )
+        g_array_free( (GArray*)value, TRUE );
+    g_hash_table_destroy( index->table );
+    g_array_free( index->offsets, TRUE );
+    g_free( index->always );
+    g_slice_free( struct _MimeMagicIndex, index );
+}
+
+static gboolean magic_rule_is_indexable( const char* buf, const char* rule )
+{
+    guint32 range = VAL32( rule, 4 );
+    guint32 val_len = VAL32( rule, 12 );
+    guint32 mask_off = VAL32( rule, 20 );
+
+    /* a rule with range 0 never matches and adds no key */
+    return range == 0 || ( range == 1 && val_len > 0 &&
+                        ( mask_off == 0 || (guchar)buf[ mask_off ] == 0xff ) );
+}
+
+static struct _MimeMagicIndex* magic_index_new( MimeCache* cache )
+{
+    struct _MimeMagicIndex* index;
+    const char* magic = cache->magics;
+    const char* rule;
+    GArray* bucket;
+    guint32 i, j, k, n_rules, offset;
+    guchar byte;
+    gpointer key;
+
+    index = g_slice_new( struct _MimeMagicIndex );
+    index->always = g_new0( guint8, cache->n_magics );
+    index->offsets = g_array_new( FALSE, FALSE, sizeof( guint32 ) );
+    index->table = g_hash_table_new( g_direct_hash, g_direct_equal );
+
+    for ( i = 0; i < cache->n_magics; ++i, magic += 16 )
+    {
+        n_rules = VAL32( magic, 8 );
+        rule = cache->buffer + VAL32( magic, 12 );
+        for ( j = 0; j < n_rules; ++j, rule += 32 )
+        {
+            if ( !magic_rule_is_indexable( cache->buffer, rule ) )
+                break;
+        }
+        if ( j < n_rules )
+        {
+            index->always[ i ] = 1;
+            continue;
+        }
+
+        rule = cache->buffer + VAL32( magic, 12 );
+        for ( j = 0; j < n_rules; ++j, rule += 32 )
+        {
+            if ( VAL32( rule, 4 ) == 0 )
+                continue;
+            offset = VAL32( rule, 0 );
+            /* keep the key, ( offset << 8 | byte ) + 1, inside a guint */
+            if ( offset >= G_MAXUINT >> 8 )
+            {
+                index->always[ i ] = 1;
+                break;
+            }
+            byte = (guchar)cache->buffer[ VAL32( rule, 16 ) ];
+            key = MAGIC_KEY( offset, byte );
+            if ( !( bucket = (GArray*)g_hash_table_lookup( index->table, key ) ) )
+            {
+                bucket = g_array_new( FALSE, FALSE, sizeof( guint32 ) );
+                g_hash_table_insert( index->table, key, bucket );
+            }
+            /* two rules of one magic may share the key */
+            if ( !bucket->len ||
+                        g_array_index( bucket, guint32, bucket->len - 1 ) != i )
+                g_array_append_val( bucket, i );
+            for ( k = 0; k < index->offsets->len; ++k )
+            {
+                if ( g_array_index( index->offsets, guint32, k ) == offset )
+                    break;
+            }
+            if ( k == index->offsets->len )
+                g_array_append_val( index->offsets, offset );
+        }
+    }
+    return index;
+}
+
 static void mime_cache_unload( MimeCache* cache, gboolean clear )
 {
+    glob_index_free( cache->glob_index );
+    cache->glob_index = NULL;
+    magic_index_free( cache->magic_index );
+    cache->magic_index = NULL;
     if( G_LIKELY(cache->buffer) )
     {
 #ifdef HAVE_MMAP
@@ -177,6 +391,7 @@ gboolean mime_cache_load( MimeCache* cache, const char* file_path )
     offset = VAL32(buffer, GLOB_LIST);
     cache->globs = buffer + offset + 4;
     cache->n_globs = VAL32( buffer, offset );
+    cache->glob_index = glob_index_new( cache );
 
     offset = VAL32(buffer, SUFFIX_TREE);
     cache->suffix_roots = buffer + VAL32( buffer + offset, 4 );
@@ -186,62 +401,61 @@ gboolean mime_cache_load( MimeCache* cache, const char* file_path )
     cache->n_magics = VAL32( buffer, offset );
     cache->magic_max_extent = VAL32( buffer + offset, 4 );
     cache->magics = buffer + VAL32( buffer + offset, 8 );
+    cache->magic_index = magic_index_new( cache );
 
     return TRUE;
 }
 
 static gboolean magic_rule_match( const char* buf, const char* rule, const char* data, int len )
 {
-    gboolean match = FALSE;
     guint32 offset = VAL32( rule, 0 );
     guint32 range = VAL32( rule, 4 );
-
-    guint32 max_offset = offset + range;
     guint32 val_len = VAL32( rule, 12 );
+    const char* value = buf + VAL32( rule, 16 );
+    guint32 mask_off = VAL32( rule, 20 );
+    guint32 n_children, i;
+    guint64 last;   /* last offset the value may start at */
 
-    for( ; offset < max_offset && (offset + val_len) <= len ; ++offset )
-    {
-        guint32 val_off = VAL32( rule, 16 );
-        guint32 mask_off = VAL32( rule, 20 );
-        const char* value = buf + val_off;
-        /* FIXME: word_size and byte order are not supported! */
+    /* FIXME: word_size and byte order are not supported! */
+    if( range == 0 || (guint64)offset + val_len > len )
+        return FALSE;
+    last = MIN( (guint64)offset + range - 1, (guint64)( len - val_len ) );
 
-        if( G_UNLIKELY( mask_off > 0 ) )    /* compare with mask applied */
+    if( G_UNLIKELY( mask_off > 0 ) )    /* compare with mask applied */
+    {
+        const char* mask = buf + mask_off;
+        for( ; offset <= last; ++offset )
         {
-            int i = 0;
-            const char* mask = buf + mask_off;
-
-            for( ; i < val_len; ++i )
+            for( i = 0; i < val_len; ++i )
             {
                 if( (data[offset + i] & mask[i]) != value[i] )
                     break;
             }
             if( i >= val_len )
-                match = TRUE;
-        }
-        else    /* direct comparison */
-        {
-            if( 0 == memcmp( value, data + offset, val_len ) )
-                match = TRUE;
+                break;
         }
+        if( offset > last )
+            return FALSE;
+    }
+    else if( offset == last )   /* direct comparison */
+    {
+        if( 0 != memcmp( value, data + offset, val_len ) )
+            return FALSE;
+    }
+    /* search the range - glibc's memmem is vectorized */
+    else if( ! memmem( data + offset, last - offset + val_len, value, val_len ) )
+        return FALSE;
 
-        if( match )
-        {
-            guint32 n_children = VAL32( rule, 24 );
-            if( n_children > 0 )
-            {
-                guint32 first_child_off = VAL32( rule, 28 );
-                guint i;
-                rule = buf + first_child_off;
-                for( i = 0; i < n_children; ++i, rule += 32 )
-                {
-                    if( magic_rule_match( buf, rule, data, len ) )
-                        return TRUE;
-                }
-            }
-            else
-                return TRUE;
-        }
+    /* child rules use absolute offsets, so the match position doesn't
+     * matter to them */
+    n_children = VAL32( rule, 24 );
+    if( n_children == 0 )
+        return TRUE;
+    rule = buf + VAL32( rule, 28 );
+    for( i = 0; i < n_children; ++i, rule += 32 )
+    {
+        if( magic_rule_match( buf, rule, data, len ) )
+            return TRUE;
     }
     return FALSE;
 }
@@ -261,20 +475,50 @@ static gboolean magic_match( const char* buf, const char* magic, const char* dat
 
 const char* mime_cache_lookup_magic( MimeCache* cache, const char* data, int len )
 {
-    const char* magic = cache->magics;
-    int i;
-
-    if( G_UNLIKELY( ! data || (0 == len) || ! magic ) )
+    struct _MimeMagicIndex* index = cache->magic_index;
+    guint8 stack_buf[ 4096 ];
+    guint8* candidates;
+    GArray* bucket;
+    guint32 offset, i, j;
+    const char* type = NULL;
+
+    if( G_UNLIKELY( ! data || (0 == len) || ! cache->magics ) )
         return NULL;
 
-    for( i = 0; i < cache->n_magics; ++i, magic += 16 )
+    candidates = cache->n_magics <= sizeof( stack_buf ) ? stack_buf :
+                                            g_malloc( cache->n_magics );
+    /* without a table every magic is tried */
+    if( G_UNLIKELY( ! index ) )
+        memset( candidates, 1, cache->n_magics );
+    else
+        memcpy( candidates, index->always, cache->n_magics );
+    for( i = 0; index && i < index->offsets->len; ++i )
     {
-        if( magic_match( cache->buffer, magic, data, len ) )
+        offset = g_array_index( index->offsets, guint32, i );
+        if( offset >= len )
+            continue;
+        bucket = (GArray*)g_hash_table_lookup( index->table,
+                                MAGIC_KEY( offset, (guchar)data[ offset ] ) );
+        if( bucket )
         {
-            return cache->buffer + VAL32( magic, 4 );
+            for( j = 0; j < bucket->len; ++j )
+                candidates[ g_array_index( bucket, guint32, j ) ] = 1;
         }
     }
-    return NULL;
+
+    /* first match in cache order wins, as without the table */
+    for( i = 0; i < cache->n_magics; ++i )
+    {
+        if( candidates[ i ] &&
+                magic_match( cache->buffer, cache->magics + i * 16, data, len ) )
+        {
+            type = cache->buffer + VAL32( cache->magics + i * 16, 4 );
+            break;
+        }
+    }
+    if( candidates != stack_buf )
+        g_free( candidates );
+    return type;
 }
 
 static const char* lookup_suffix_nodes( const char* buf, const char* nodes, guint32 n, const char* name )
@@ -503,6 +747,59 @@ const char* mime_cache_lookup_literal( MimeCache* cache, const char* filename )
 }
 
 const char* mime_cache_lookup_glob( MimeCache* cache, const char* filename, int *glob_len )
+{
+    struct _MimeGlobIndex* index = cache->glob_index;
+    const MimeGlob* best = NULL;
+    const MimeGlob* g;
+    GArray* bucket;
+    gpointer keys[ 4 ];
+    guint first, last;
+    int i, k, len;
+
+    if ( G_UNLIKELY( !index ) )
+        return mime_cache_lookup_glob_fnmatch( cache, filename, glob_len );
+
+    len = strlen( filename );
+    first = len ? (guchar)filename[ 0 ] : GLOB_ANY_CHAR;
+    last = len ? (guchar)filename[ len - 1 ] : GLOB_ANY_CHAR;
+    keys[ 0 ] = GLOB_KEY( first, last );
+    keys[ 1 ] = GLOB_KEY( GLOB_ANY_CHAR, last );
+    keys[ 2 ] = GLOB_KEY( first, GLOB_ANY_CHAR );
+    keys[ 3 ] = GLOB_KEY( GLOB_ANY_CHAR, GLOB_ANY_CHAR );
+
+    /* same result as the linear scan: the longest glob wins, and of
+     * globs with the same length the earliest in the list */
+    for ( k = 0; k < 4; ++k )
+    {
+        if ( k > 0 && keys[ k ] == keys[ k - 1 ] )
+            continue;   /* empty filename */
+        if ( !( bucket = (GArray*)g_hash_table_lookup( index->buckets, keys[ k ] ) ) )
+            continue;
+        for ( i = 0; i < bucket->len; ++i )
+        {
+            g = g_array_index( bucket, MimeGlob*, i );
+            if ( best && ( g->len < best->len ||
+                           ( g->len == best->len && g->index > best->index ) ) )
+                continue;
+            if ( g->literal )
+            {
+                if ( g->len != len || strcmp( g->glob, filename ) )
+                    continue;
+            }
+            else if ( g->prefix_len + g->suffix_len > len ||
+                      strncmp( g->glob, filename, g->prefix_len ) ||
+                      memcmp( g->glob + g->len - g->suffix_len,
+                              filename + len - g->suffix_len, g->suffix_len ) ||
+                      fnmatch( g->glob, filename, 0 ) )
+                continue;
+            best = g;
+        }
+    }
+    *glob_len = best ? best->len : 0;
+    return best ? best->type : NULL;
+}
+
+const char* mime_cache_lookup_glob_fnmatch( MimeCache* cache, const char* filename, int *glob_len )
 {
     const char* entry = cache->globs, *type = NULL;
     int i;
@@ -47,6 +47,7 @@ struct _MimeCache
 
     guint32 n_globs;
     const char* globs;
+    struct _MimeGlobIndex* glob_index;  /* built by mime_cache_load */
 
     guint32 n_suffix_roots;
     const char* suffix_roots;
@@ -54,6 +55,7 @@ struct _MimeCache
     guint32 n_magics;
     guint32 magic_max_extent;
     const char* magics;
+    struct _MimeMagicIndex* magic_index;  /* built by mime_cache_load */
 };
 typedef struct _MimeCache MimeCache;
 
@@ -64,6 +66,9 @@ void mime_cache_free( MimeCache* cache );
 
 const char* mime_cache_lookup_literal( MimeCache* cache, const char* filename );
 const char* mime_cache_lookup_glob( MimeCache* cache, const char* filename, int *glob_len );
+/* reference implementation of mime_cache_lookup_glob running fnmatch on
+ * every glob - used to check the index */
+const char* mime_cache_lookup_glob_fnmatch( MimeCache* cache, const char* filename, int *glob_len );
 const char* mime_cache_lookup_suffix( MimeCache* cache, const char* filename, const char** suffix_pos );
 const char* mime_cache_lookup_magic( MimeCache* cache, const char* data, int len );
 const char** mime_cache_lookup_parents( MimeCache* cache, const char* mime_type );
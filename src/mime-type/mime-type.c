@@ -33,6 +33,8 @@
 #include "mime-cache.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <errno.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -50,9 +52,14 @@
  * (Refer to the man page of mmap for detail)
  * So here I undef HAVE_MMAP to disable the implementation using mmap.
  */
+#ifdef HAVE_MMAP
+/* the description table can still be mapped - it is replaced by rename so
+ * the mapping can't be truncated by a writer */
+#define MIME_DESC_MMAP
+#endif
 #undef HAVE_MMAP
 
-#ifdef HAVE_MMAP
+#ifdef MIME_DESC_MMAP
 #include <sys/mman.h>
 #endif
 
@@ -74,6 +81,180 @@ static char* mime_magic_buf = NULL;
 /* for MT safety, the buffer should be locked */
 G_LOCK_DEFINE_STATIC(mime_magic_buf);
 
+/* Memo of content sniffed types keyed by file identity, so files without a
+ * known name are only opened again after they change.  The ctime is checked
+ * with the mtime since it has ns precision and can't be set back by tools
+ * restoring the mtime.  Types are interned since strings in the caches go
+ * away when they are reloaded. */
+typedef struct
+{
+    dev_t dev;
+    ino64_t ino;
+    time_t mtime;
+    gint64 ctime_ns;
+    off64_t size;
+    mode_t mode;
+    const char* type;
+} MimeMemo;
+
+#define MIME_MEMO_MAX   65536
+#define MIME_MEMO_MAGIC "spacefm-mime-memo 2"
+
+#define STAT_CTIME_NS( statbuf ) \
+    ( (gint64)(statbuf)->st_ctim.tv_sec * 1000000000 + (statbuf)->st_ctim.tv_nsec )
+
+static GHashTable* memo_hash = NULL;
+G_LOCK_DEFINE_STATIC(memo_hash);
+
+static guint mime_memo_hash( gconstpointer key )
+{
+    const MimeMemo* memo = (const MimeMemo*)key;
+    return (guint)memo->ino ^ (guint)( memo->ino >> 32 ) ^ (guint)memo->dev;
+}
+
+static gboolean mime_memo_equal( gconstpointer a, gconstpointer b )
+{
+    const MimeMemo* ma = (const MimeMemo*)a;
+    const MimeMemo* mb = (const MimeMemo*)b;
+    return ma->ino == mb->ino && ma->dev == mb->dev;
+}
+
+static void mime_memo_free( gpointer memo )
+{
+    g_slice_free( MimeMemo, memo );
+}
+
+static const char* mime_memo_lookup( struct stat64* statbuf )
+{
+    MimeMemo key;
+    MimeMemo* memo;
+    const char* type = NULL;
+
+    key.dev = statbuf->st_dev;
+    key.ino = statbuf->st_ino;
+    G_LOCK( memo_hash );
+    if ( memo_hash &&
+            ( memo = (MimeMemo*)g_hash_table_lookup( memo_hash, &key ) ) &&
+            memo->mtime == statbuf->st_mtime &&
+            memo->ctime_ns == STAT_CTIME_NS( statbuf ) &&
+            memo->size == statbuf->st_size && memo->mode == statbuf->st_mode )
+        type = memo->type;
+    G_UNLOCK( memo_hash );
+    return type;
+}
+
+static void mime_memo_store( dev_t dev, ino64_t ino, time_t mtime,
+                             gint64 ctime_ns, off64_t size,
+                             mode_t mode, const char* type )
+{
+    MimeMemo* memo = g_slice_new( MimeMemo );
+    memo->dev = dev;
+    memo->ino = ino;
+    memo->mtime = mtime;
+    memo->ctime_ns = ctime_ns;
+    memo->size = size;
+    memo->mode = mode;
+    memo->type = g_intern_string( type );
+
+    G_LOCK( memo_hash );
+    if ( G_UNLIKELY( !memo_hash ) )
+        memo_hash = g_hash_table_new_full( mime_memo_hash, mime_memo_equal,
+                                           mime_memo_free, NULL );
+    else if ( g_hash_table_size( memo_hash ) >= MIME_MEMO_MAX )
+        g_hash_table_remove_all( memo_hash );
+    g_hash_table_replace( memo_hash, memo, memo );
+    G_UNLOCK( memo_hash );
+}
+
+void mime_type_memo_clear()
+{
+    G_LOCK( memo_hash );
+    if ( memo_hash )
+        g_hash_table_remove_all( memo_hash );
+    G_UNLOCK( memo_hash );
+}
+
+/* the memo and the description table are only valid for the mime caches
+ * they were made with */
+static char* mime_cache_get_signature( const char* magic )
+{
+    GString* sig = g_string_new( magic );
+    struct stat statbuf;
+    int i;
+
+    for ( i = 0; i < n_caches; ++i )
+    {
+        if ( stat( caches[i]->file_path, &statbuf ) == 0 )
+            g_string_append_printf( sig, " %ld:%ld", (long)statbuf.st_mtime,
+                                                     (long)statbuf.st_size );
+    }
+    return g_string_free( sig, FALSE );
+}
+
+gboolean mime_type_memo_save( const char* path )
+{
+    FILE* file;
+    GHashTableIter it;
+    gpointer key;
+    MimeMemo* memo;
+    char* sig;
+
+    if ( !( file = fopen( path, "w" ) ) )
+        return FALSE;
+    sig = mime_cache_get_signature( MIME_MEMO_MAGIC );
+    fprintf( file, "%s\n", sig );
+    g_free( sig );
+    G_LOCK( memo_hash );
+    if ( memo_hash )
+    {
+        g_hash_table_iter_init( &it, memo_hash );
+        while ( g_hash_table_iter_next( &it, &key, NULL ) )
+        {
+            memo = (MimeMemo*)key;
+            fprintf( file, "%llu %llu %lld %lld %lld %u %s\n",
+                     (unsigned long long)memo->dev,
+                     (unsigned long long)memo->ino,
+                     (long long)memo->mtime, (long long)memo->ctime_ns,
+                     (long long)memo->size,
+                     (unsigned)memo->mode, memo->type );
+        }
+    }
+    G_UNLOCK( memo_hash );
+    return fclose( file ) == 0;
+}
+
+gboolean mime_type_memo_load( const char* path )
+{
+    FILE* file;
+    char line[ 1024 ];
+    char type[ 256 ];
+    char* sig;
+    unsigned long long dev, ino;
+    long long mtime, ctime_ns, size;
+    unsigned mode;
+    gboolean ret = FALSE;
+
+    if ( !( file = fopen( path, "r" ) ) )
+        return FALSE;
+    sig = mime_cache_get_signature( MIME_MEMO_MAGIC );
+    if ( fgets( line, sizeof( line ), file ) &&
+            !strncmp( line, sig, strlen( sig ) ) && line[ strlen( sig ) ] == '\n' )
+    {
+        while ( fgets( line, sizeof( line ), file ) )
+        {
+            if ( sscanf( line, "%llu %llu %lld %lld %lld %u %255s", &dev, &ino,
+                                &mtime, &ctime_ns, &size, &mode, type ) == 7 )
+                mime_memo_store( (dev_t)dev, (ino64_t)ino, (time_t)mtime,
+                                 (gint64)ctime_ns, (off64_t)size,
+                                 (mode_t)mode, type );
+        }
+        ret = TRUE;
+    }
+    g_free( sig );
+    fclose( file );
+    return ret;
+}
+
 /* load all mime.cache files on the system,
  * including /usr/share/mime/mime.cache,
  * /usr/local/share/mime/mime.cache,
@@ -84,6 +265,10 @@ static void mime_cache_load_all();
 static void mime_cache_free_all();
 
 static gboolean mime_type_is_data_plain_text( const char* data, int len );
+static const char* mime_type_get_by_file_real( const char* filepath,
+                                               struct stat64* statbuf,
+                                               const char* basename,
+                                               gboolean sniff );
 
 /*
  * Get mime-type of the specified file (quick, but less accurate):
@@ -149,12 +334,31 @@ const char* mime_type_get_by_filename( const char* filename, struct stat64* stat
  * the specified file again.
 */
 const char* mime_type_get_by_file( const char* filepath, struct stat64* statbuf, const char* basename )
+{
+    return mime_type_get_by_file_real( filepath, statbuf, basename, TRUE );
+}
+
+/*
+ * Same as mime_type_get_by_file() but never reads the contents of the file.
+ * Returns NULL if the mime-type can only be determined by content sniffing,
+ * in which case the caller can call mime_type_get_by_file() later.
+*/
+const char* mime_type_get_by_file_lazy( const char* filepath, struct stat64* statbuf, const char* basename )
+{
+    return mime_type_get_by_file_real( filepath, statbuf, basename, FALSE );
+}
+
+static const char* mime_type_get_by_file_real( const char* filepath,
+                                               struct stat64* statbuf,
+                                               const char* basename,
+                                               gboolean sniff )
 {
     const char* type;
     struct stat64 _statbuf;
 
     /* IMPORTANT!! vfs-file-info.c:vfs_file_info_reload_mime_type() depends
-     * on this function only using the st_mode from statbuf.
+     * on this function only using st_mode, st_dev, st_ino, st_mtime,
+     * st_ctim and st_size from statbuf.
      * Also see vfs-dir.c:vfs_dir_load_thread */
     if( statbuf == NULL || G_UNLIKELY( S_ISLNK(statbuf->st_mode) ) )
     {
@@ -191,6 +395,12 @@ const char* mime_type_get_by_file( const char* filepath, struct stat64* statbuf,
         int fd = -1;
         char* data;
 
+        /* sniffed before and unchanged since? */
+        if ( statbuf->st_ino && ( type = mime_memo_lookup( statbuf ) ) )
+            return type;
+        if ( !sniff )
+            return NULL;
+
         /* Open the file and map it into memory */
         fd = open ( filepath, O_RDONLY, 0 );
         if ( fd != -1 )
@@ -247,6 +457,12 @@ const char* mime_type_get_by_file( const char* filepath, struct stat64* statbuf,
                 else /* we use our own buffer */
                     g_free( data );
 #endif
+                if ( statbuf->st_ino )
+                    mime_memo_store( statbuf->st_dev, statbuf->st_ino,
+                                     statbuf->st_mtime, STAT_CTIME_NS( statbuf ),
+                                     statbuf->st_size,
+                                     statbuf->st_mode,
+                                     type && *type ? type : XDG_MIME_TYPE_UNKNOWN );
             }
             close( fd );
         }
@@ -347,6 +563,16 @@ static char* parse_xml_desc( const char* buf, size_t len, const char* locale )
     return g_strndup( eng_comment, eng_comment_len );
 }
 
+/* the language used for descriptions when no locale is given */
+static char* mime_type_get_locale()
+{
+    const char* const * langs = g_get_language_names();
+    char* dot = strchr( langs[0], '.' );
+    if( dot )
+        return g_strndup( langs[0], (size_t)(dot - langs[0]) );
+    return g_strdup( langs[0] );
+}
+
 static char* _mime_type_get_desc_icon( const char* file_path,
                                        const char* locale,
                                        gboolean is_local,
@@ -383,14 +609,7 @@ static char* _mime_type_get_desc_icon( const char* file_path,
 
     _locale = NULL;
     if ( !locale )
-    {
-        const char* const * langs = g_get_language_names();
-        char* dot = strchr( langs[0], '.' );
-        if( dot )
-            locale = _locale = g_strndup( langs[0], (size_t)(dot - langs[0]) );
-        else
-            locale = langs[0];
-    }
+        locale = _locale = mime_type_get_locale();
     desc = parse_xml_desc( buffer, statbuf.st_size, locale );
     g_free( _locale );
 
@@ -406,16 +625,10 @@ static char* _mime_type_get_desc_icon( const char* file_path,
     return desc;
 }
 
-/* Get human-readable description and icon name of the mime-type
- * If locale is NULL, current locale will be used.
- * The returned string should be freed when no longer used.
- * The icon_name will only be set if points to NULL, and must be freed.
- * 
- * Note: Spec is not followed for icon.  If icon tag is found in .local
- * xml file, it is used.  Otherwise vfs_mime_type_get_icon guesses the icon.
- * The Freedesktop spec /usr/share/mime/generic-icons is NOT parsed. */
-char* mime_type_get_desc_icon( const char* type, const char* locale,
-                                                 char** icon_name )
+/* Read the description and icon name of the mime-type from its XML files -
+ * see mime_type_get_desc_icon() */
+static char* mime_type_get_desc_icon_xml( const char* type, const char* locale,
+                                                            char** icon_name )
 {
     char* desc;
     const gchar* const * dir;
@@ -469,6 +682,387 @@ char* mime_type_get_desc_icon( const char* type, const char* locale,
     return NULL;
 }
 
+/* Preparsed table of the description and icon name of every mime-type
+ * which has an XML file, in the current locale.  It is built once by a
+ * thread the first time a description is needed, saved in the user's cache
+ * dir and mapped by later sessions, so the XML files of each type are not
+ * parsed on first display.  It is dropped when a mime.cache is reloaded and
+ * rebuilt on the next request.  Until it's ready, the XML files are read.
+ * Layout: header, NUL terminated strings, then entries sorted by type. */
+#define MIME_DESC_MAGIC     0x53444d53   /* "SMDS" */
+#define MIME_DESC_SIG_MAGIC "spacefm-mime-desc 1"
+
+typedef struct
+{
+    guint32 magic;
+    guint32 n_types;
+    guint32 sig;        /* offset of signature string */
+    guint32 entries;    /* offset of MimeDescEntry array */
+} MimeDescHeader;
+
+typedef struct
+{
+    guint32 type;       /* string offsets, 0 if none */
+    guint32 desc;
+    guint32 icon;
+} MimeDescEntry;
+
+typedef struct
+{
+    char* sig;
+    guint gen;
+} MimeDescBuild;
+
+static const char* desc_table = NULL;
+static gsize desc_table_size = 0;
+static gboolean desc_table_mapped = FALSE;  /* from mime_desc_table_map */
+static gboolean desc_table_building = FALSE;
+static guint desc_table_gen = 0;
+G_LOCK_DEFINE_STATIC(desc_table);
+
+static char* mime_desc_table_get_path()
+{
+    return g_build_filename( g_get_user_cache_dir(), "spacefm", "mime-desc",
+                                                                    NULL );
+}
+
+static char* mime_desc_table_get_signature()
+{
+    char* locale = mime_type_get_locale();
+    char* sig = mime_cache_get_signature( MIME_DESC_SIG_MAGIC );
+    char* ret = g_strdup_printf( "%s %s", sig, locale );
+    g_free( sig );
+    g_free( locale );
+    return ret;
+}
+
+static gboolean mime_desc_table_is_valid( const char* buf, gsize size,
+                                          const char* sig )
+{
+    const MimeDescHeader* header = (const MimeDescHeader*)buf;
+
+    if ( size < sizeof( MimeDescHeader ) || header->magic != MIME_DESC_MAGIC )
+        return FALSE;
+    /* strings lie between the header and the entries, and end with NUL */
+    if ( header->entries <= sizeof( MimeDescHeader ) ||
+            header->entries > size || header->entries % 4 ||
+            buf[ header->entries - 1 ] != '\0' ||
+            ( size - header->entries ) / sizeof( MimeDescEntry ) !=
+                                                        header->n_types )
+        return FALSE;
+    return header->sig >= sizeof( MimeDescHeader ) &&
+           header->sig < header->entries && !strcmp( buf + header->sig, sig );
+}
+
+/* free a table returned by mime_desc_table_map */
+static void mime_desc_table_unmap( const char* buf, gsize size )
+{
+#ifdef MIME_DESC_MMAP
+    munmap( (void*)buf, size );
+#else
+    g_free( (char*)buf );
+#endif
+}
+
+/* replace the table - desc_table must be locked */
+static void mime_desc_table_set( const char* buf, gsize size, gboolean mapped )
+{
+    if ( desc_table )
+    {
+        if ( desc_table_mapped )
+            mime_desc_table_unmap( desc_table, desc_table_size );
+        else
+            g_free( (char*)desc_table );
+    }
+    desc_table = buf;
+    desc_table_size = size;
+    desc_table_mapped = mapped;
+}
+
+/* map (or read) a saved table - returns NULL if it's missing or out of date */
+static const char* mime_desc_table_map( const char* path, const char* sig,
+                                        gsize* size )
+{
+    int fd;
+    struct stat statbuf;
+    char* buf;
+#ifndef MIME_DESC_MMAP
+    gsize got = 0;
+    ssize_t n;
+#endif
+
+    fd = open( path, O_RDONLY, 0 );
+    if ( fd == -1 )
+        return NULL;
+    if ( fstat( fd, &statbuf ) == -1 || statbuf.st_size == 0 )
+    {
+        close( fd );
+        return NULL;
+    }
+#ifdef MIME_DESC_MMAP
+    buf = (char*)mmap( NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( buf == (void*)-1 )
+        return NULL;
+#else
+    buf = g_malloc( statbuf.st_size );
+    while ( got < statbuf.st_size )
+    {
+        n = read( fd, buf + got, statbuf.st_size - got );
+        if ( n <= 0 )
+        {
+            if ( n == -1 && errno == EINTR )
+                continue;
+            break;
+        }
+        got += n;
+    }
+    close( fd );
+    if ( got != statbuf.st_size )
+    {
+        g_free( buf );
+        return NULL;
+    }
+#endif
+    if ( !mime_desc_table_is_valid( buf, statbuf.st_size, sig ) )
+    {
+        mime_desc_table_unmap( buf, statbuf.st_size );
+        return NULL;
+    }
+    *size = statbuf.st_size;
+    return buf;
+}
+
+/* add the names of all types with an XML file in data_dir/mime */
+static void mime_desc_table_collect_types( const char* data_dir,
+                                           GHashTable* types )
+{
+    char* mime_dir = g_build_filename( data_dir, "mime", NULL );
+    GDir* dir = g_dir_open( mime_dir, 0, NULL );
+    GDir* media_dir;
+    const char* media;
+    const char* name;
+    char* path;
+
+    while ( dir && ( media = g_dir_read_name( dir ) ) )
+    {
+        if ( !strcmp( media, "packages" ) )
+            continue;
+        path = g_build_filename( mime_dir, media, NULL );
+        if ( ( media_dir = g_dir_open( path, 0, NULL ) ) )
+        {
+            while ( ( name = g_dir_read_name( media_dir ) ) )
+            {
+                if ( g_str_has_suffix( name, ".xml" ) )
+                    g_hash_table_replace( types, g_strdup_printf( "%s/%.*s",
+                                        media, (int)strlen( name ) - 4, name ),
+                                        NULL );
+            }
+            g_dir_close( media_dir );
+        }
+        g_free( path );
+    }
+    if ( dir )
+        g_dir_close( dir );
+    g_free( mime_dir );
+}
+
+static gint mime_desc_compare_types( gconstpointer a, gconstpointer b )
+{
+    return strcmp( *(const char**)a, *(const char**)b );
+}
+
+static guint32 mime_desc_add_string( GString* buf, const char* str )
+{
+    guint32 offset;
+
+    if ( !str )
+        return 0;
+    offset = buf->len;
+    g_string_append_len( buf, str, strlen( str ) + 1 );
+    return offset;
+}
+
+static gpointer mime_desc_table_build_thread( MimeDescBuild* build )
+{
+    GHashTable* types = g_hash_table_new_full( g_str_hash, g_str_equal,
+                                                            g_free, NULL );
+    GPtrArray* names;
+    GArray* entries;
+    GHashTableIter it;
+    gpointer key;
+    GString* buf;
+    MimeDescHeader header = { 0 };
+    MimeDescEntry entry;
+    const gchar* const * dir;
+    char* desc;
+    char* icon;
+    char* path;
+    char* cache_dir;
+    const char* mapped = NULL;
+    gsize size = 0;
+    guint i;
+
+    mime_desc_table_collect_types( g_get_user_data_dir(), types );
+    for ( dir = g_get_system_data_dirs(); *dir; ++dir )
+        mime_desc_table_collect_types( *dir, types );
+
+    names = g_ptr_array_sized_new( g_hash_table_size( types ) );
+    g_hash_table_iter_init( &it, types );
+    while ( g_hash_table_iter_next( &it, &key, NULL ) )
+        g_ptr_array_add( names, key );
+    g_ptr_array_sort( names, mime_desc_compare_types );
+
+    buf = g_string_sized_new( names->len * 64 );
+    g_string_append_len( buf, (const char*)&header, sizeof( header ) );
+    header.magic = MIME_DESC_MAGIC;
+    header.sig = mime_desc_add_string( buf, build->sig );
+    entries = g_array_sized_new( FALSE, FALSE, sizeof( MimeDescEntry ),
+                                                            names->len );
+    for ( i = 0; i < names->len; i++ )
+    {
+        icon = NULL;
+        desc = mime_type_get_desc_icon_xml( names->pdata[i], NULL, &icon );
+        entry.type = mime_desc_add_string( buf, names->pdata[i] );
+        entry.desc = mime_desc_add_string( buf, desc );
+        entry.icon = mime_desc_add_string( buf, icon );
+        g_array_append_val( entries, entry );
+        g_free( desc );
+        g_free( icon );
+    }
+    while ( buf->len % 4 )
+        g_string_append_c( buf, '\0' );
+    header.n_types = entries->len;
+    header.entries = buf->len;
+    g_string_append_len( buf, (const char*)entries->data,
+                                    entries->len * sizeof( MimeDescEntry ) );
+    memcpy( buf->str, &header, sizeof( header ) );
+    g_array_free( entries, TRUE );
+    g_ptr_array_free( names, TRUE );
+    g_hash_table_destroy( types );
+
+    /* save it for later sessions, then map the saved file */
+    path = mime_desc_table_get_path();
+    cache_dir = g_path_get_dirname( path );
+    g_mkdir_with_parents( cache_dir, 0700 );
+    g_free( cache_dir );
+    if ( g_file_set_contents( path, buf->str, buf->len, NULL ) )
+        mapped = mime_desc_table_map( path, build->sig, &size );
+
+    G_LOCK( desc_table );
+    if ( build->gen == desc_table_gen )   /* not reset meanwhile */
+    {
+        if ( mapped )
+            mime_desc_table_set( mapped, size, TRUE );
+        else
+        {
+            /* couldn't be saved - keep it in memory */
+            mime_desc_table_set( buf->str, buf->len, FALSE );
+            g_string_free( buf, FALSE );
+            buf = NULL;
+        }
+        mapped = NULL;
+    }
+    desc_table_building = FALSE;
+    G_UNLOCK( desc_table );
+
+    if ( mapped )
+        mime_desc_table_unmap( mapped, size );
+    if ( buf )
+        g_string_free( buf, TRUE );
+    g_free( path );
+    g_free( build->sig );
+    g_slice_free( MimeDescBuild, build );
+    return NULL;
+}
+
+/* Look up type in the table.  Returns FALSE if the table isn't ready, in
+ * which case a build is started if needed. */
+static gboolean mime_desc_table_lookup( const char* type, char** desc,
+                                        char** icon_name )
+{
+    const MimeDescHeader* header;
+    const MimeDescEntry* entries;
+    const MimeDescEntry* entry = NULL;
+    MimeDescBuild* build;
+    guint lo, hi, mid;
+    int cmp;
+
+    G_LOCK( desc_table );
+    if ( !desc_table )
+    {
+        if ( !desc_table_building )
+        {
+            desc_table_building = TRUE;
+            build = g_slice_new( MimeDescBuild );
+            build->sig = mime_desc_table_get_signature();
+            build->gen = desc_table_gen;
+            if ( !g_thread_create( (GThreadFunc)mime_desc_table_build_thread,
+                                                        build, FALSE, NULL ) )
+            {
+                g_free( build->sig );
+                g_slice_free( MimeDescBuild, build );
+            }
+        }
+        G_UNLOCK( desc_table );
+        return FALSE;
+    }
+
+    header = (const MimeDescHeader*)desc_table;
+    entries = (const MimeDescEntry*)( desc_table + header->entries );
+    lo = 0;
+    hi = header->n_types;
+    while ( lo < hi )
+    {
+        mid = ( lo + hi ) / 2;
+        cmp = entries[mid].type < header->entries ?
+                        strcmp( type, desc_table + entries[mid].type ) : -1;
+        if ( cmp == 0 )
+        {
+            entry = &entries[mid];
+            break;
+        }
+        if ( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    *desc = entry && entry->desc && entry->desc < header->entries ?
+                            g_strdup( desc_table + entry->desc ) : NULL;
+    if ( icon_name && *icon_name == NULL && entry && entry->icon &&
+                                            entry->icon < header->entries )
+        *icon_name = g_strdup( desc_table + entry->icon );
+    G_UNLOCK( desc_table );
+    return TRUE;
+}
+
+/* drop the table after the mime database changed */
+static void mime_desc_table_reset()
+{
+    G_LOCK( desc_table );
+    mime_desc_table_set( NULL, 0, FALSE );
+    desc_table_gen++;
+    G_UNLOCK( desc_table );
+}
+
+/* Get human-readable description and icon name of the mime-type
+ * If locale is NULL, current locale will be used.
+ * The returned string should be freed when no longer used.
+ * The icon_name will only be set if points to NULL, and must be freed.
+ * 
+ * Note: Spec is not followed for icon.  If icon tag is found in .local
+ * xml file, it is used.  Otherwise vfs_mime_type_get_icon guesses the icon.
+ * The Freedesktop spec /usr/share/mime/generic-icons is NOT parsed. */
+char* mime_type_get_desc_icon( const char* type, const char* locale,
+                                                 char** icon_name )
+{
+    char* desc;
+
+    if ( !locale && mime_desc_table_lookup( type, &desc, icon_name ) )
+        return desc;
+    return mime_type_get_desc_icon_xml( type, locale, icon_name );
+}
+
 void mime_type_finalize()
 {
 /*
@@ -479,6 +1073,7 @@ void mime_type_finalize()
     }
 */
     mime_cache_free_all();
+    mime_desc_table_reset();
 }
 
 #if 0
@@ -520,7 +1115,24 @@ void test_alias( const char* type )
 
 void mime_type_init()
 {
+    char* path;
+    char* sig;
+    const char* table;
+    gsize size;
+
     mime_cache_load_all();
+
+    /* use the description table saved by an earlier session */
+    path = mime_desc_table_get_path();
+    sig = mime_desc_table_get_signature();
+    if ( ( table = mime_desc_table_map( path, sig, &size ) ) )
+    {
+        G_LOCK( desc_table );
+        mime_desc_table_set( table, size, TRUE );
+        G_UNLOCK( desc_table );
+    }
+    g_free( path );
+    g_free( sig );
 //    table = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, (GDestroyNotify)mime_type_unref );
 }
 
@@ -582,6 +1194,9 @@ gboolean mime_cache_reload( MimeCache* cache )
 {
     int i;
     gboolean ret = mime_cache_load( cache, cache->file_path );
+    /* sniffed types and descriptions may differ with the new database */
+    mime_type_memo_clear();
+    mime_desc_table_reset();
     /* recalculate max magic extent */
     for( i = 0; i < n_caches; ++i )
     {
@@ -771,3 +1386,202 @@ MimeCache** mime_type_get_caches( int* n )
     *n = n_caches;
     return caches;
 }
+
+static void collect_file_names( const char* dir_path, GPtrArray* names,
+                                int depth, gboolean full_path )
+{
+    GDir* dir;
+    const char* name;
+    char* path;
+
+    if ( depth > 32 || !( dir = g_dir_open( dir_path, 0, NULL ) ) )
+        return;
+    while ( ( name = g_dir_read_name( dir ) ) )
+    {
+        path = g_build_filename( dir_path, name, NULL );
+        if ( g_file_test( path, G_FILE_TEST_IS_DIR ) )
+        {
+            if ( !g_file_test( path, G_FILE_TEST_IS_SYMLINK ) )
+                collect_file_names( path, names, depth + 1, full_path );
+            if ( full_path )
+            {
+                g_free( path );
+                continue;
+            }
+        }
+        g_ptr_array_add( names, full_path ? path : g_strdup( name ) );
+        if ( !full_path )
+            g_free( path );
+    }
+    g_dir_close( dir );
+}
+
+int mime_type_check_globs( const char* dir_path )
+{
+    GPtrArray* names = g_ptr_array_new_with_free_func( g_free );
+    GTimer* timer = g_timer_new();
+    const char** types;
+    int* lens;
+    const char* ref_type;
+    char* name;
+    int ref_len;
+    int mismatches = 0;
+    guint i, j, n;
+    gdouble index_secs = 0, fnmatch_secs = 0;
+
+    collect_file_names( dir_path, names, 0, FALSE );
+    /* also try each name without its extension and with an upper case one,
+     * which are the names that miss the literal and suffix lookups */
+    n = names->len;
+    for ( i = 0; i < n; ++i )
+    {
+        name = (char*)g_ptr_array_index( names, i );
+        if ( strrchr( name, '.' ) > name )
+        {
+            g_ptr_array_add( names, g_strndup( name, strrchr( name, '.' ) - name ) );
+            g_ptr_array_add( names, g_ascii_strup( name, -1 ) );
+        }
+    }
+
+    types = g_new( const char*, names->len );
+    lens = g_new( int, names->len );
+    for ( j = 0; j < n_caches; ++j )
+    {
+        g_timer_start( timer );
+        for ( i = 0; i < names->len; ++i )
+            types[i] = mime_cache_lookup_glob( caches[j],
+                            (char*)g_ptr_array_index( names, i ), &lens[i] );
+        index_secs += g_timer_elapsed( timer, NULL );
+
+        g_timer_start( timer );
+        for ( i = 0; i < names->len; ++i )
+        {
+            name = (char*)g_ptr_array_index( names, i );
+            ref_type = mime_cache_lookup_glob_fnmatch( caches[j], name, &ref_len );
+            if ( types[i] != ref_type || ( ref_type && lens[i] != ref_len ) )
+            {
+                printf( "MISMATCH %s: '%s' index=%s (%d) fnmatch=%s (%d)\n",
+                        caches[j]->file_path, name,
+                        types[i] ? types[i] : "(none)", lens[i],
+                        ref_type ? ref_type : "(none)", ref_len );
+                mismatches++;
+            }
+        }
+        fnmatch_secs += g_timer_elapsed( timer, NULL );
+    }
+    g_free( types );
+    g_free( lens );
+    printf( "spacefm: %u names x %u caches: %d mismatches\n"
+            "    glob index %.3f s   fnmatch %.3f s\n",
+            names->len, n_caches, mismatches, index_secs, fnmatch_secs );
+    g_timer_destroy( timer );
+    g_ptr_array_free( names, TRUE );
+    return mismatches;
+}
+
+void mime_type_bench_magic( const char* dir_path )
+{
+    GPtrArray* paths = g_ptr_array_new_with_free_func( g_free );
+    GPtrArray* heads = g_ptr_array_new_with_free_func( g_free );
+    GArray* lens = g_array_new( FALSE, FALSE, sizeof( int ) );
+    GTimer* timer = g_timer_new();
+    const char* type;
+    const char* ref_type;
+    char* data;
+    int fd, len, pass, n_passes = 20;
+    guint i, j;
+    int mismatches = 0;
+    gdouble all_secs, index_secs;
+    struct _MimeMagicIndex** indexes = g_new( struct _MimeMagicIndex*,
+                                                            n_caches + 1 );
+
+    collect_file_names( dir_path, paths, 0, TRUE );
+    for ( i = 0; i < paths->len; ++i )
+    {
+        fd = open( (char*)g_ptr_array_index( paths, i ), O_RDONLY );
+        if ( fd == -1 )
+            continue;
+        data = g_malloc( mime_cache_max_extent );
+        len = read( fd, data, mime_cache_max_extent );
+        close( fd );
+        if ( len <= 0 )
+        {
+            g_free( data );
+            continue;
+        }
+        g_ptr_array_add( heads, data );
+        g_array_append_val( lens, len );
+    }
+    if ( !heads->len )
+    {
+        printf( "spacefm: no readable files in %s\n", dir_path );
+        goto _done;
+    }
+
+    /* without its table mime_cache_lookup_magic tries every magic */
+    for ( j = 0; j < n_caches; ++j )
+        indexes[j] = caches[j]->magic_index;
+    for ( i = 0; i < heads->len; ++i )
+    {
+        data = (char*)g_ptr_array_index( heads, i );
+        len = g_array_index( lens, int, i );
+        for ( j = 0, type = NULL; ! type && j < n_caches; ++j )
+            type = mime_cache_lookup_magic( caches[j], data, len );
+        for ( j = 0; j < n_caches; ++j )
+            caches[j]->magic_index = NULL;
+        for ( j = 0, ref_type = NULL; ! ref_type && j < n_caches; ++j )
+            ref_type = mime_cache_lookup_magic( caches[j], data, len );
+        for ( j = 0; j < n_caches; ++j )
+            caches[j]->magic_index = indexes[j];
+        if ( type != ref_type )
+        {
+            printf( "MISMATCH %s: index=%s all=%s\n",
+                    (char*)g_ptr_array_index( paths, i ),
+                    type ? type : "(none)", ref_type ? ref_type : "(none)" );
+            mismatches++;
+        }
+    }
+
+    for ( j = 0; j < n_caches; ++j )
+        caches[j]->magic_index = NULL;
+    g_timer_start( timer );
+    for ( pass = 0; pass < n_passes; ++pass )
+    {
+        for ( i = 0; i < heads->len; ++i )
+        {
+            for ( j = 0, type = NULL; ! type && j < n_caches; ++j )
+                type = mime_cache_lookup_magic( caches[j],
+                                        (char*)g_ptr_array_index( heads, i ),
+                                        g_array_index( lens, int, i ) );
+        }
+    }
+    all_secs = g_timer_elapsed( timer, NULL );
+    for ( j = 0; j < n_caches; ++j )
+        caches[j]->magic_index = indexes[j];
+
+    g_timer_start( timer );
+    for ( pass = 0; pass < n_passes; ++pass )
+    {
+        for ( i = 0; i < heads->len; ++i )
+        {
+            for ( j = 0, type = NULL; ! type && j < n_caches; ++j )
+                type = mime_cache_lookup_magic( caches[j],
+                                        (char*)g_ptr_array_index( heads, i ),
+                                        g_array_index( lens, int, i ) );
+        }
+    }
+    index_secs = g_timer_elapsed( timer, NULL );
+
+    printf( "spacefm: %u files x %d passes, %d mismatches\n"
+            "    all      %.0f sniffs/s\n"
+            "    indexed  %.0f sniffs/s\n",
+            heads->len, n_passes, mismatches,
+            all_secs > 0 ? heads->len * n_passes / all_secs : 0,
+            index_secs > 0 ? heads->len * n_passes / index_secs : 0 );
+_done:
+    g_free( indexes );
+    g_timer_destroy( timer );
+    g_array_free( lens, TRUE );
+    g_ptr_array_free( heads, TRUE );
+    g_ptr_array_free( paths, TRUE );
+}
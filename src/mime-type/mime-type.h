@@ -78,6 +78,12 @@ const char* mime_type_get_by_filename( const char* filename, struct stat64* stat
 */
 const char* mime_type_get_by_file( const char* filepath, struct stat64* statbuf, const char* basename );
 
+/*
+ * Same as mime_type_get_by_file() without content sniffing: returns NULL if
+ * the contents of the file would have to be read to determine the mime-type.
+*/
+const char* mime_type_get_by_file_lazy( const char* filepath, struct stat64* statbuf, const char* basename );
+
 gboolean mime_type_is_text_file( const char * file_path, const char * mime_type );
 
 gboolean mime_type_is_executable_file( const char * file_path, const char * mime_type );
@@ -128,6 +134,23 @@ void mime_cache_foreach( GFunc func, gpointer user_data );
  */
 MimeCache** mime_type_get_caches( int* n );
 
+/* Content sniffed types are remembered by file identity (dev, inode, mtime,
+ * size and mode).  The memo can be saved and loaded again, in which case it
+ * is only used if the mime caches are unchanged. */
+void mime_type_memo_clear();
+gboolean mime_type_memo_save( const char* path );
+gboolean mime_type_memo_load( const char* path );
+
+/* compare the glob index with plain fnmatch lookups for every file name
+ * found under dir_path and print mismatches and timings (--check-mime-globs)
+ * Returns the number of mismatches. */
+int mime_type_check_globs( const char* dir_path );
+
+/* sniff the head of every file under dir_path with the magic dispatch table
+ * and by trying every magic, and print sniffs per second for both
+ * (--bench-mime-magic) */
+void mime_type_bench_magic( const char* dir_path );
+
 /* max magic extent of all caches */
 extern guint32 mime_cache_max_extent;
 
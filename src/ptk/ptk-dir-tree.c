@@ -907,6 +907,9 @@ be incorrect.
         }
 */
         break;
+    case VFS_FILE_MONITOR_RESCAN:
+        /* lost events - children are reread when the node is expanded again */
+        break;
     }
     GDK_THREADS_LEAVE();
 }
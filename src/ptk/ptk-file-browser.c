@@ -1305,6 +1305,57 @@ gboolean on_slider_change( GtkWidget *widget, GdkEvent  *event, // correct?
 }
 */
 
+/* load the thumbnails of the rows in view before the others */
+static void ptk_file_browser_raise_thumbnails( PtkFileBrowser* file_browser )
+{
+    GtkTreePath* start = NULL;
+    GtkTreePath* end = NULL;
+    gboolean in_view = FALSE;
+
+    if ( !file_browser->file_list || !file_browser->folder_view ||
+                        !gtk_widget_get_realized( file_browser->folder_view ) )
+        return;
+    // view_mode is already changed while the old view is destroyed
+    if ( GTK_IS_TREE_VIEW( file_browser->folder_view ) )
+        in_view = gtk_tree_view_get_visible_range(
+                        GTK_TREE_VIEW( file_browser->folder_view ), &start, &end );
+    else if ( EXO_IS_ICON_VIEW( file_browser->folder_view ) )
+        in_view = exo_icon_view_get_visible_range(
+                        EXO_ICON_VIEW( file_browser->folder_view ), &start, &end );
+    if ( !in_view )
+        return;
+    ptk_file_list_raise_thumbnails( PTK_FILE_LIST( file_browser->file_list ),
+                                    gtk_tree_path_get_indices( start )[0],
+                                    gtk_tree_path_get_indices( end )[0] );
+    gtk_tree_path_free( start );
+    gtk_tree_path_free( end );
+}
+
+static void on_folder_view_scrolled( GtkAdjustment* adjustment,
+                                     PtkFileBrowser* file_browser )
+{
+    ptk_file_browser_raise_thumbnails( file_browser );
+}
+
+/* count the dir as visible while the browser is mapped - after the inotify
+ * queue overflowed only visible dirs are rescanned */
+static void ptk_file_browser_show_dir( PtkFileBrowser* file_browser,
+                                       gboolean show )
+{
+    show = show && file_browser->dir &&
+                        gtk_widget_get_mapped( GTK_WIDGET( file_browser ) );
+    if ( show == file_browser->dir_shown )
+        return;
+    file_browser->dir_shown = show;
+    vfs_dir_set_visible( file_browser->dir, show );
+}
+
+static void on_file_browser_map( GtkWidget* widget, gpointer user_data )
+{
+    ptk_file_browser_show_dir( PTK_FILE_BROWSER( widget ),
+                               gtk_widget_get_mapped( widget ) );
+}
+
 void ptk_file_browser_init( PtkFileBrowser* file_browser )
 {
     file_browser->mypanel = 0;  // don't load font yet in ptk_path_entry_new
@@ -1326,6 +1377,15 @@ void ptk_file_browser_init( PtkFileBrowser* file_browser )
     file_browser->side_vbox = gtk_vbox_new( FALSE, 0 );
     gtk_widget_set_size_request( file_browser->side_vbox, 140, -1 );
     file_browser->folder_view_scroll = gtk_scrolled_window_new( NULL, NULL );
+    // the compact view scrolls horizontally
+    g_signal_connect( gtk_scrolled_window_get_vadjustment(
+                        GTK_SCROLLED_WINDOW( file_browser->folder_view_scroll ) ),
+                      "value-changed", G_CALLBACK( on_folder_view_scrolled ),
+                      file_browser );
+    g_signal_connect( gtk_scrolled_window_get_hadjustment(
+                        GTK_SCROLLED_WINDOW( file_browser->folder_view_scroll ) ),
+                      "value-changed", G_CALLBACK( on_folder_view_scrolled ),
+                      file_browser );
     gtk_paned_pack1 ( GTK_PANED( file_browser->hpane ), file_browser->side_vbox,
                                                                 FALSE, FALSE );
     gtk_paned_pack2 ( GTK_PANED( file_browser->hpane ), 
@@ -1465,6 +1525,12 @@ void ptk_file_browser_init( PtkFileBrowser* file_browser )
     g_signal_connect( file_browser->side_vpane_bottom, "notify::position",
                       G_CALLBACK( on_slider_change ), file_browser );
 */
+
+    // hidden tabs and panels are unmapped
+    g_signal_connect( file_browser, "map",
+                      G_CALLBACK( on_file_browser_map ), NULL );
+    g_signal_connect( file_browser, "unmap",
+                      G_CALLBACK( on_file_browser_map ), NULL );
 }
 
 void ptk_file_browser_finalize( GObject *obj )
@@ -1478,6 +1544,7 @@ void ptk_file_browser_finalize( GObject *obj )
                                               G_SIGNAL_MATCH_DATA,
                                               0, 0, NULL, NULL,
                                               file_browser );
+        ptk_file_browser_show_dir( file_browser, FALSE );
         g_object_unref( file_browser->dir );
     }
 
@@ -2290,6 +2357,7 @@ gboolean ptk_file_browser_chdir( PtkFileBrowser* file_browser,
                                               G_SIGNAL_MATCH_DATA,
                                               0, 0, NULL, NULL,
                                               file_browser );
+        ptk_file_browser_show_dir( file_browser, FALSE );
         g_object_unref( file_browser->dir );
     }
 
@@ -2302,6 +2370,7 @@ gboolean ptk_file_browser_chdir( PtkFileBrowser* file_browser,
     // load new dir
     file_browser->busy = TRUE;
     file_browser->dir = vfs_dir_get_by_path( path );
+    ptk_file_browser_show_dir( file_browser, TRUE );
 
     if( ! file_browser->curHistory ||
                             path != (char*)file_browser->curHistory->data )
@@ -2483,11 +2552,18 @@ static void on_folder_content_changed( VFSDir* dir, VFSFileInfo* file,
             // current folder doesn't exist - was renamed
             on_close_notebook_page( NULL, file_browser );
     }
-    else
+    else if ( dir->load_complete )
+        // progressive loading emits file-changed for every file
         g_idle_add( ( GSourceFunc ) ptk_file_browser_content_changed,
                                                             file_browser );
 }
 
+static void on_dir_load_complete( VFSDir* dir, PtkFileBrowser* file_browser )
+{
+    g_idle_add( ( GSourceFunc ) ptk_file_browser_content_changed,
+                                                            file_browser );
+}
+
 static void on_file_deleted( VFSDir* dir, VFSFileInfo* file,
                                         PtkFileBrowser* file_browser )
 {
@@ -2707,6 +2783,10 @@ void on_dir_file_listed( VFSDir* dir,
         g_signal_connect( dir, "file-changed",
                           G_CALLBACK( on_folder_content_changed ),
                                                             file_browser );
+        if ( !dir->load_complete )
+            g_signal_connect( dir, "load-complete",
+                              G_CALLBACK( on_dir_load_complete ),
+                                                            file_browser );
     }
 
     ptk_file_browser_update_model( file_browser );
@@ -4537,6 +4617,11 @@ void ptk_file_browser_refresh( GtkWidget* item, PtkFileBrowser* file_browser )
         on_close_notebook_page( NULL, file_browser );
         return;
     }
+
+    // a loaded dir only needs the differences applied - unchanged files
+    // keep their info and thumbnails (applied when the rescan has finished)
+    if ( file_browser->dir && vfs_dir_rescan( file_browser->dir ) )
+        return;
     
     // save cursor's file path for later re-selection
     GtkTreePath* tree_path = NULL;
@@ -4580,6 +4665,7 @@ void ptk_file_browser_refresh( GtkWidget* item, PtkFileBrowser* file_browser )
                                               G_SIGNAL_MATCH_DATA,
                                               0, 0, NULL, NULL,
                                               file_browser );
+        ptk_file_browser_show_dir( file_browser, FALSE );
         g_object_unref( file_browser->dir );
         file_browser->dir = NULL;
     }
@@ -4598,6 +4684,7 @@ void ptk_file_browser_refresh( GtkWidget* item, PtkFileBrowser* file_browser )
     file_browser->busy = TRUE;
     file_browser->dir = vfs_dir_get_by_path(
                                 ptk_file_browser_get_cwd( file_browser ) );
+    ptk_file_browser_show_dir( file_browser, TRUE );
     g_signal_emit( file_browser, signals[ BEGIN_CHDIR_SIGNAL ], 0 );
     if ( vfs_dir_is_file_listed( file_browser->dir ) )
     {
@@ -5380,6 +5467,10 @@ GList* ptk_file_browser_get_selected_files( PtkFileBrowser* file_browser )
     {
         gtk_tree_model_get_iter( model, &it, ( GtkTreePath* ) sel->data );
         gtk_tree_model_get( model, &it, COL_FILE_INFO, &file, -1 );
+        /* the list only sniffs types in the background for display -
+         * opening and menus need the real type now */
+        if ( file_browser->dir )
+            vfs_dir_load_mime_type( file_browser->dir, file );
         file_list = g_list_append( file_list, file );
     }
     g_list_foreach( sel_files,
@@ -6064,6 +6155,7 @@ void show_thumbnails( PtkFileBrowser* file_browser, PtkFileList* list,
     else if ( file_browser->dir->avoid_changes )
         max_file_size = 0;
     ptk_file_list_show_thumbnails( list, is_big, max_file_size );
+    ptk_file_browser_raise_thumbnails( file_browser );
     ptk_file_browser_update_toolbar_widgets( file_browser, NULL,
                                              XSET_TOOL_SHOW_THUMB );
 }
@@ -86,6 +86,7 @@ struct _PtkFileBrowser
     gboolean is_drag : 1;
     gboolean skip_release : 1;
     gboolean menu_shown : 1;
+    guint dir_shown : 1;    /* dir is counted as visible by vfs_dir_set_visible */
     char* book_set_name;
 
     /* folder view */
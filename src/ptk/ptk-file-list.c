@@ -18,6 +18,7 @@
 #include "vfs-thumbnail-loader.h"
 
 #include <string.h>
+#include <stdio.h>
 
 static void ptk_file_list_init ( PtkFileList *list );
 
@@ -98,6 +99,9 @@ static void ptk_file_list_set_default_sort_func( GtkTreeSortable *sortable,
 /* signal handlers */
 
 static void on_thumbnail_loaded( VFSDir* dir, VFSFileInfo* file, PtkFileList* list );
+static void on_load_complete( VFSDir* dir, PtkFileList* list );
+
+static void ptk_file_list_flush_created( PtkFileList* list );
 
 /*
  * already declared in ptk-file-list.h
@@ -113,6 +117,12 @@ void ptk_file_list_file_changed( VFSDir* dir, VFSFileInfo* file,
 
 static GObjectClass* parent_class = NULL;
 
+#define ROW_FILE( list, i ) ( (VFSFileInfo*)g_ptr_array_index( (list)->files, (i) ) )
+
+/* bursts of more than FILE_LIST_MERGE_MIN files created within one notify
+ * interval are sorted and merged into the list in one pass */
+#define FILE_LIST_MERGE_MIN 32
+
 static GType column_types[ N_FILE_LIST_COLS ];
 
 GType ptk_file_list_get_type ( void )
@@ -174,7 +184,10 @@ GType ptk_file_list_get_type ( void )
 void ptk_file_list_init ( PtkFileList *list )
 {
     list->n_files = 0;
-    list->files = NULL;
+    list->files = g_ptr_array_new();
+    list->rows = g_hash_table_new( g_direct_hash, g_direct_equal );
+    list->names = g_hash_table_new_full( g_str_hash, g_str_equal, g_free, NULL );
+    list->created = g_ptr_array_new();
     list->sort_order = -1;
     list->sort_col = -1;
     /* Random int to check whether an iter belongs to our model */
@@ -243,6 +256,15 @@ void ptk_file_list_finalize ( GObject *object )
     PtkFileList *list = ( PtkFileList* ) object;
 
     ptk_file_list_set_dir( list, NULL );
+    if ( list->created_idle )
+        g_source_remove( list->created_idle );
+    if ( list->resort_timeout )
+        g_source_remove( list->resort_timeout );
+    g_ptr_array_foreach( list->created, (GFunc)vfs_file_info_unref, NULL );
+    g_ptr_array_free( list->files, TRUE );
+    g_ptr_array_free( list->created, TRUE );
+    g_hash_table_destroy( list->rows );
+    g_hash_table_destroy( list->names );
     /* must chain up - finalize parent */
     ( * parent_class->finalize ) ( object );
 }
@@ -256,6 +278,100 @@ PtkFileList *ptk_file_list_new ( VFSDir* dir, gboolean show_hidden )
     return list;
 }
 
+/* Row lookup: list->rows holds every file in the list, but only the indices
+ * of the rows before list->rows_valid are known to be right.  An insertion
+ * or deletion lowers rows_valid to its row, and a stale index is fixed by
+ * reindexing forward from rows_valid until the file is found, so a burst
+ * of changes costs at most one pass over the rows after the first change */
+static void ptk_file_list_update_rows( PtkFileList* list, guint first )
+{
+    guint i;
+    for ( i = first; i < list->files->len; i++ )
+        g_hash_table_insert( list->rows, ROW_FILE( list, i ),
+                                                    GUINT_TO_POINTER( i ) );
+    list->rows_valid = list->files->len;
+}
+
+static gint ptk_file_list_find_row( PtkFileList* list, VFSFileInfo* file )
+{
+    gpointer row;
+    guint i;
+
+    if ( !g_hash_table_lookup_extended( list->rows, file, NULL, &row ) )
+        return -1;
+    i = GPOINTER_TO_UINT( row );
+    if ( G_LIKELY( i < list->files->len && ROW_FILE( list, i ) == file ) )
+        return i;
+    /* the rows before rows_valid are indexed right, so file is after it */
+    for ( i = list->rows_valid; i < list->files->len; i++ )
+    {
+        g_hash_table_insert( list->rows, ROW_FILE( list, i ),
+                                                    GUINT_TO_POINTER( i ) );
+        list->rows_valid = i + 1;
+        if ( ROW_FILE( list, i ) == file )
+            return i;
+    }
+    return -1;
+}
+
+/* iters point to the file, with its row index as a hint */
+static void ptk_file_list_set_iter( PtkFileList* list, GtkTreeIter* iter,
+                                    guint i )
+{
+    iter->stamp = list->stamp;
+    iter->user_data = ROW_FILE( list, i );
+    iter->user_data2 = iter->user_data;
+    iter->user_data3 = GUINT_TO_POINTER( i );
+}
+
+static gint ptk_file_list_iter_row( PtkFileList* list, GtkTreeIter* iter )
+{
+    guint i = GPOINTER_TO_UINT( iter->user_data3 );
+    if ( G_LIKELY( i < list->files->len &&
+                                ROW_FILE( list, i ) == iter->user_data2 ) )
+        return i;
+    return ptk_file_list_find_row( list, (VFSFileInfo*)iter->user_data2 );
+}
+
+static void ptk_file_list_add_name( PtkFileList* list, VFSFileInfo* file )
+{
+    if ( G_LIKELY( file->name ) )
+        g_hash_table_replace( list->names, g_strdup( file->name ), file );
+}
+
+static void ptk_file_list_insert_row( PtkFileList* list, guint i,
+                                      VFSFileInfo* file )
+{
+    g_ptr_array_add( list->files, NULL );
+    memmove( list->files->pdata + i + 1, list->files->pdata + i,
+                        ( list->files->len - 1 - i ) * sizeof( gpointer ) );
+    list->files->pdata[i] = file;
+    g_hash_table_insert( list->rows, file, GUINT_TO_POINTER( i ) );
+    /* the rows after i moved down */
+    list->rows_valid = MIN( list->rows_valid, i + 1 );
+    ptk_file_list_add_name( list, file );
+    ++list->n_files;
+}
+
+static void ptk_file_list_remove_row( PtkFileList* list, guint i )
+{
+    VFSFileInfo* file = ROW_FILE( list, i );
+
+    g_hash_table_remove( list->rows, file );
+    if ( file->name && g_hash_table_lookup( list->names, file->name ) == file )
+        g_hash_table_remove( list->names, file->name );
+    g_ptr_array_remove_index( list->files, i );
+    list->rows_valid = MIN( list->rows_valid, i );
+    --list->n_files;
+}
+
+/* is file or another VFSFileInfo of the same name in the list ? */
+static gboolean ptk_file_list_has_file( PtkFileList* list, VFSFileInfo* file )
+{
+    return g_hash_table_lookup_extended( list->rows, file, NULL, NULL ) ||
+            ( file->name && g_hash_table_lookup( list->names, file->name ) );
+}
+
 static void _ptk_file_list_file_changed( VFSDir* dir, VFSFileInfo* file,
                                         PtkFileList* list )
 {
@@ -280,10 +396,22 @@ static void _ptk_file_list_file_changed( VFSDir* dir, VFSFileInfo* file,
     }
 }
 
+static gboolean on_created_idle( PtkFileList* list )
+{
+    list->created_idle = 0;
+    ptk_file_list_flush_created( list );
+    return FALSE;
+}
+
 static void _ptk_file_list_file_created( VFSDir* dir, VFSFileInfo* file,
                                         PtkFileList* list )
 {
-    ptk_file_list_file_created( dir, file, list );
+    /* VFSDir emits all files created within one notify interval at once,
+     * so they are collected and added before the views are redrawn */
+    g_ptr_array_add( list->created, vfs_file_info_ref( file ) );
+    if ( !list->created_idle )
+        list->created_idle = g_idle_add_full( G_PRIORITY_HIGH_IDLE,
+                                    ( GSourceFunc ) on_created_idle, list, NULL );
 
     /* check if reloading of thumbnail is needed. */
     if ( list->max_thumbnail != 0 && (
@@ -301,6 +429,7 @@ static void _ptk_file_list_file_created( VFSDir* dir, VFSFileInfo* file,
 void ptk_file_list_set_dir( PtkFileList* list, VFSDir* dir )
 {
     GList* l;
+    VFSFileInfo* file;
 
     if( list->dir == dir )
         return;
@@ -312,8 +441,23 @@ void ptk_file_list_set_dir( PtkFileList* list, VFSDir* dir )
             /* cancel all possible pending requests */
             vfs_thumbnail_loader_cancel_all_requests( list->dir, list->big_thumbnail );
         }
-        g_list_foreach( list->files, (GFunc)vfs_file_info_unref, NULL );
-        g_list_free( list->files );
+        g_ptr_array_foreach( list->files, (GFunc)vfs_file_info_unref, NULL );
+        g_ptr_array_set_size( list->files, 0 );
+        g_hash_table_remove_all( list->rows );
+        list->rows_valid = 0;
+        g_hash_table_remove_all( list->names );
+        if ( list->created_idle )
+        {
+            g_source_remove( list->created_idle );
+            list->created_idle = 0;
+        }
+        if ( list->resort_timeout )
+        {
+            g_source_remove( list->resort_timeout );
+            list->resort_timeout = 0;
+        }
+        g_ptr_array_foreach( list->created, (GFunc)vfs_file_info_unref, NULL );
+        g_ptr_array_set_size( list->created, 0 );
         g_signal_handlers_disconnect_by_func( list->dir,
                                               _ptk_file_list_file_created, list );
         g_signal_handlers_disconnect_by_func( list->dir,
@@ -322,11 +466,12 @@ void ptk_file_list_set_dir( PtkFileList* list, VFSDir* dir )
                                               _ptk_file_list_file_changed, list );
         g_signal_handlers_disconnect_by_func( list->dir,
                                               on_thumbnail_loaded, list );
+        g_signal_handlers_disconnect_by_func( list->dir,
+                                              on_load_complete, list );
         g_object_unref( list->dir );
     }
 
     list->dir = dir;
-    list->files = NULL;
     list->n_files = 0;
     if( ! dir )
         return;
@@ -342,18 +487,25 @@ void ptk_file_list_set_dir( PtkFileList* list, VFSDir* dir )
     g_signal_connect( list->dir, "file-changed",
                       G_CALLBACK(_ptk_file_list_file_changed),
                       list );
+    g_signal_connect( list->dir, "load-complete",
+                      G_CALLBACK(on_load_complete),
+                      list );
 
     if( dir && dir->file_list )
     {
         for( l = dir->file_list; l; l = l->next )
         {
-            if( list->show_hidden ||
-                    ((VFSFileInfo*)l->data)->disp_name[0] != '.' )
+            file = (VFSFileInfo*)l->data;
+            if( list->show_hidden || file->disp_name[0] != '.' )
             {
-                list->files = g_list_prepend( list->files, vfs_file_info_ref( (VFSFileInfo*)l->data) );
-                ++list->n_files;
+                g_hash_table_insert( list->rows, file,
+                                GUINT_TO_POINTER( list->files->len ) );
+                ptk_file_list_add_name( list, file );
+                g_ptr_array_add( list->files, vfs_file_info_ref( file ) );
             }
         }
+        list->n_files = list->files->len;
+        list->rows_valid = list->files->len;
     }
 }
 
@@ -382,7 +534,6 @@ gboolean ptk_file_list_get_iter ( GtkTreeModel *tree_model,
 {
     PtkFileList *list;
     gint *indices, n, depth;
-    GList* l;
 
     g_assert(PTK_IS_FILE_LIST(tree_model));
     g_assert(path!=NULL);
@@ -400,16 +551,7 @@ gboolean ptk_file_list_get_iter ( GtkTreeModel *tree_model,
     if ( n >= list->n_files || n < 0 )
         return FALSE;
 
-    l = g_list_nth( list->files, n );
-
-    g_assert(l != NULL);
-
-    /* We simply store a pointer in the iter */
-    iter->stamp = list->stamp;
-    iter->user_data  = l;
-    iter->user_data2 = l->data;
-    iter->user_data3 = NULL;   /* unused */
-
+    ptk_file_list_set_iter( list, iter, n );
     return TRUE;
 }
 
@@ -417,7 +559,7 @@ GtkTreePath *ptk_file_list_get_path ( GtkTreeModel *tree_model,
                                       GtkTreeIter *iter )
 {
     GtkTreePath* path;
-    GList* l;
+    gint i;
     PtkFileList* list = PTK_FILE_LIST(tree_model);
 
     g_return_val_if_fail (list, NULL);
@@ -425,10 +567,11 @@ GtkTreePath *ptk_file_list_get_path ( GtkTreeModel *tree_model,
     g_return_val_if_fail (iter != NULL, NULL);
     g_return_val_if_fail (iter->user_data != NULL, NULL);
 
-    l = (GList*) iter->user_data;
+    i = ptk_file_list_iter_row( list, iter );
+    g_return_val_if_fail ( i >= 0, NULL );
 
     path = gtk_tree_path_new();
-    gtk_tree_path_append_index(path, g_list_index(list->files, l->data) );
+    gtk_tree_path_append_index( path, i );
     return path;
 }
 
@@ -437,7 +580,6 @@ void ptk_file_list_get_value ( GtkTreeModel *tree_model,
                                gint column,
                                GValue *value )
 {
-    GList* l;
     PtkFileList* list = PTK_FILE_LIST(tree_model);
     VFSFileInfo* info;
     GdkPixbuf* icon;
@@ -448,10 +590,15 @@ void ptk_file_list_get_value ( GtkTreeModel *tree_model,
 
     g_value_init (value, column_types[column] );
 
-    l = (GList*) iter->user_data;
-    g_return_if_fail ( l != NULL );
-
     info = (VFSFileInfo*)iter->user_data2;
+    g_return_if_fail ( info != NULL );
+
+    /* file info still being loaded - load this row first */
+    if ( G_UNLIKELY( info->placeholder ) )
+        vfs_dir_request_file_info( list->dir, info );
+    /* row in view - sniff its mime type in the background */
+    else if ( G_UNLIKELY( info->mime_pending ) )
+        vfs_dir_request_mime_type( list->dir, info );
 
     switch(column)
     {
@@ -495,7 +642,7 @@ void ptk_file_list_get_value ( GtkTreeModel *tree_model,
         g_value_set_string( value, vfs_file_info_get_disp_name(info) );
         break;
     case COL_FILE_SIZE:
-        if ( S_ISDIR( info->mode ) || ( S_ISLNK( info->mode ) &&
+        if ( info->placeholder || S_ISDIR( info->mode ) || ( S_ISLNK( info->mode ) &&
                                 0 == strcmp( vfs_mime_type_get_type( info->mime_type ),
                                 XDG_MIME_TYPE_DIRECTORY ) ) )
             g_value_set_string( value, NULL );
@@ -506,15 +653,20 @@ void ptk_file_list_get_value ( GtkTreeModel *tree_model,
         g_value_set_string( value, vfs_file_info_get_mime_type_desc( info ) );
         break;
     case COL_FILE_PERM:
-        g_value_set_string( value, vfs_file_info_get_disp_perm(info) );
+        if ( !info->placeholder )
+            g_value_set_string( value, vfs_file_info_get_disp_perm(info) );
         break;
     case COL_FILE_OWNER:
-        g_value_set_string( value, vfs_file_info_get_disp_owner(info) );
+        if ( !info->placeholder )
+            g_value_set_string( value, vfs_file_info_get_disp_owner(info) );
         break;
     case COL_FILE_MTIME:
-        g_value_set_string( value, vfs_file_info_get_disp_mtime(info) );
+        if ( !info->placeholder )
+            g_value_set_string( value, vfs_file_info_get_disp_mtime(info) );
         break;
     case COL_FILE_INFO:
+        /* a pending type is the name-based one until the sniff requested
+         * above updates the row */
         g_value_set_pointer( value, vfs_file_info_ref( info ) );
         break;
     }
@@ -523,7 +675,7 @@ void ptk_file_list_get_value ( GtkTreeModel *tree_model,
 gboolean ptk_file_list_iter_next ( GtkTreeModel *tree_model,
                                    GtkTreeIter *iter )
 {
-    GList* l;
+    gint i;
     PtkFileList* list;
 
     g_return_val_if_fail (PTK_IS_FILE_LIST (tree_model), FALSE);
@@ -532,16 +684,13 @@ gboolean ptk_file_list_iter_next ( GtkTreeModel *tree_model,
         return FALSE;
 
     list = PTK_FILE_LIST(tree_model);
-    l = (GList *) iter->user_data;
+    i = ptk_file_list_iter_row( list, iter );
 
-    /* Is this the last l in the list? */
-    if ( ! l->next )
+    /* Is this the last row in the list? */
+    if ( i < 0 || i + 1 >= list->files->len )
         return FALSE;
 
-    iter->stamp = list->stamp;
-    iter->user_data = l->next;
-    iter->user_data2 = l->next->data;
-
+    ptk_file_list_set_iter( list, iter, i + 1 );
     return TRUE;
 }
 
@@ -561,13 +710,11 @@ gboolean ptk_file_list_iter_children ( GtkTreeModel *tree_model,
     list = PTK_FILE_LIST( tree_model );
 
     /* No rows => no first row */
-    if ( list->dir->n_files == 0 )
+    if ( list->n_files == 0 )
         return FALSE;
 
     /* Set iter to first item in list */
-    iter->stamp = list->stamp;
-    iter->user_data = list->files;
-    iter->user_data2 = list->files->data;
+    ptk_file_list_set_iter( list, iter, 0 );
     return TRUE;
 }
 
@@ -595,7 +742,6 @@ gboolean ptk_file_list_iter_nth_child ( GtkTreeModel *tree_model,
                                         GtkTreeIter *parent,
                                         gint n )
 {
-    GList* l;
     PtkFileList* list;
 
     g_return_val_if_fail (PTK_IS_FILE_LIST (tree_model), FALSE);
@@ -609,13 +755,7 @@ gboolean ptk_file_list_iter_nth_child ( GtkTreeModel *tree_model,
     if( n >= list->n_files || n < 0 )
         return FALSE;
 
-    l = g_list_nth( list->files, n );
-    g_assert( l != NULL );
-
-    iter->stamp = list->stamp;
-    iter->user_data = l;
-    iter->user_data2 = l->data;
-
+    ptk_file_list_set_iter( list, iter, n );
     return TRUE;
 }
 
@@ -737,8 +877,9 @@ static gint ptk_file_list_compare( gconstpointer a,
         return result;
 	
     // by display name
-    if ( list->sort_natural )
+    if ( list->sort_natural && file_a->collate_key && file_b->collate_key )
     {
+        // collate keys are not loaded for placeholders
         // natural
         if ( list->sort_case )
             result = strcmp( file_a->collate_key, file_b->collate_key );
@@ -759,6 +900,32 @@ static gint ptk_file_list_compare( gconstpointer a,
     return list->sort_order == GTK_SORT_ASCENDING ? result : -result;
 }
 
+/* rows sorted by type need the sniffed type of lazily loaded files - they
+ * are sorted by the name-based type until the sniffed one arrives, then
+ * ptk_file_list_file_changed sorts the list again */
+static void ptk_file_list_request_mime_type( PtkFileList* list,
+                                          VFSFileInfo* file )
+{
+    if ( G_UNLIKELY( file->mime_pending ) && list->dir &&
+                                        list->sort_col == COL_FILE_DESC )
+        vfs_dir_request_mime_type( list->dir, file );
+}
+
+static gboolean on_resort_timeout( PtkFileList* list )
+{
+    list->resort_timeout = 0;
+    ptk_file_list_sort( list );
+    return FALSE;
+}
+
+static gint ptk_file_list_compare_rows( gconstpointer a,
+                                        gconstpointer b,
+                                        gpointer user_data )
+{
+    return ptk_file_list_compare( *(VFSFileInfo**)a, *(VFSFileInfo**)b,
+                                                            user_data );
+}
+
 #if 0
 static gint ptk_file_list_compare( gconstpointer a,
                                    gconstpointer b,
@@ -810,29 +977,33 @@ static gint ptk_file_list_compare( gconstpointer a,
 
 void ptk_file_list_sort ( PtkFileList* list )
 {
-    GHashTable* old_order;
     gint *new_order;
     GtkTreePath *path;
-    GList* l;
     int i;
 
+    if ( list->created->len )
+        ptk_file_list_flush_created( list );
     if( list->n_files <=1 )
         return;
 
-    old_order = g_hash_table_new( g_direct_hash, g_direct_equal );
-    /* save old order */
-    for( i = 0, l = list->files; l; l = l->next, ++i )
-        g_hash_table_insert( old_order, l, GINT_TO_POINTER(i) );
+    /* list->rows has the old order */
+    ptk_file_list_update_rows( list, list->rows_valid );
+
+    if ( list->sort_col == COL_FILE_DESC )
+    {
+        for( i = 0; i < list->n_files; ++i )
+            ptk_file_list_request_mime_type( list, ROW_FILE( list, i ) );
+    }
 
     /* sort the list */
-    list->files = g_list_sort_with_data( list->files,
-                                         ptk_file_list_compare, list );
+    g_ptr_array_sort_with_data( list->files, ptk_file_list_compare_rows, list );
 
     /* save new order */
     new_order = g_new( int, list->n_files );
-    for( i = 0, l = list->files; l; l = l->next, ++i )
-        new_order[i] = GPOINTER_TO_INT( g_hash_table_lookup( old_order, l ) );
-    g_hash_table_destroy( old_order );
+    for( i = 0; i < list->n_files; ++i )
+        new_order[i] = GPOINTER_TO_INT( g_hash_table_lookup( list->rows,
+                                                    ROW_FILE( list, i ) ) );
+    ptk_file_list_update_rows( list, 0 );
     path = gtk_tree_path_new ();
     gtk_tree_model_rows_reordered (GTK_TREE_MODEL (list),
                                    path, NULL, new_order);
@@ -842,164 +1013,226 @@ void ptk_file_list_sort ( PtkFileList* list )
 
 gboolean ptk_file_list_find_iter(  PtkFileList* list, GtkTreeIter* it, VFSFileInfo* fi )
 {
-    GList* l;
-    for( l = list->files; l; l = l->next )
+    VFSFileInfo* fi2;
+    gint i;
+
+    if ( list->created->len )
+        ptk_file_list_flush_created( list );
+    i = ptk_file_list_find_row( list, fi );
+    if ( i < 0 )
     {
-        VFSFileInfo* fi2 = (VFSFileInfo*)l->data;
-        if( G_UNLIKELY( fi2 == fi
-            || 0 == strcmp( vfs_file_info_get_name(fi), vfs_file_info_get_name(fi2) ) ) )
-        {
-            it->stamp = list->stamp;
-            it->user_data = l;
-            it->user_data2 = fi2;
-            return TRUE;
-        }
+        /* another VFSFileInfo for the same file */
+        fi2 = fi->name ? g_hash_table_lookup( list->names, fi->name ) : NULL;
+        if ( !fi2 || ( i = ptk_file_list_find_row( list, fi2 ) ) < 0 )
+            return FALSE;
     }
-    return FALSE;
+    ptk_file_list_set_iter( list, it, i );
+    return TRUE;
 }
 
 void ptk_file_list_file_created( VFSDir* dir,
                                  VFSFileInfo* file,
                                  PtkFileList* list )
 {
-    GList* l, *ll = NULL;
     GtkTreeIter it;
     GtkTreePath* path;
-    VFSFileInfo* file2;
+    guint lo, hi, mid;
     
     if( ! list->show_hidden && vfs_file_info_get_name(file)[0] == '.' )
         return;
 
-    gboolean is_desktop = vfs_file_info_is_desktop_entry( file ); //sfm
-    gboolean is_desktop2;
-    
-    for( l = list->files; l; l = l->next )
-    {
-        file2 = (VFSFileInfo*)l->data;
-        if( G_UNLIKELY( file == file2 ) )
-        {
-            /* The file is already in the list */
-            return;
-        }
-        
-        is_desktop2 = vfs_file_info_is_desktop_entry( file2 );
-        if ( is_desktop || is_desktop2 )
-        {
-            // at least one is a desktop file, need to compare filenames
-            if ( file->name && file2->name )
-            {
-                if ( !strcmp( file->name, file2->name ) )
-                    return;
-            }
-        }
-        else if ( ptk_file_list_compare( file2, file, list ) == 0 )
-        {
-            // disp_name matches ?
-            // ptk_file_list_compare may return 0 on differing display names
-            // if case-insensitive - need to compare filenames
-            if ( list->sort_natural && list->sort_case )
-                return;
-            else if ( !strcmp( file->name, file2->name ) )
-                return;
-        }
+    /* The file is already in the list */
+    if ( ptk_file_list_has_file( list, file ) )
+        return;
+    ptk_file_list_request_mime_type( list, file );
 
-        if ( !ll && ptk_file_list_compare( file2, file, list ) > 0 )
-        {
-            if ( !is_desktop && !is_desktop2 )
-                break;
-            else
-                ll = l; // store insertion location based on disp_name
-        }
+    /* binary search for the first row sorted after file */
+    lo = 0;
+    hi = list->files->len;
+    while ( lo < hi )
+    {
+        mid = ( lo + hi ) / 2;
+        if ( ptk_file_list_compare( ROW_FILE( list, mid ), file, list ) > 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    if ( ll )
-        l = ll;
+    ptk_file_list_insert_row( list, lo, vfs_file_info_ref( file ) );
 
-    list->files = g_list_insert_before( list->files, l, vfs_file_info_ref( file ) );
-    ++list->n_files;
+    ptk_file_list_set_iter( list, &it, lo );
+    path = gtk_tree_path_new_from_indices( lo, -1 );
 
-    if( l )
-        l = l->prev;
-    else
-        l = g_list_last( list->files );
+    gtk_tree_model_row_inserted( GTK_TREE_MODEL(list), path, &it );
 
-    it.stamp = list->stamp;
-    it.user_data = l;
-    it.user_data2 = file;
+    gtk_tree_path_free( path );
+}
 
-    path = gtk_tree_path_new_from_indices( g_list_index(list->files, l->data), -1 );
+/* Add a burst of created files: sort them, then find their rows in one pass
+ * over the sorted rows */
+static void ptk_file_list_merge_created( PtkFileList* list, GPtrArray* created )
+{
+    GPtrArray* added;
+    guint i, j;
+    VFSFileInfo* file;
+    GtkTreeIter it;
+    GtkTreePath* path;
 
-    gtk_tree_model_row_inserted( GTK_TREE_MODEL(list), path, &it );
+    added = g_ptr_array_sized_new( created->len );
+    for ( i = 0; i < created->len; i++ )
+    {
+        file = (VFSFileInfo*)created->pdata[i];
+        if( ! list->show_hidden && vfs_file_info_get_name(file)[0] == '.' )
+            continue;
+        if ( ptk_file_list_has_file( list, file ) )
+            continue;
+        /* also catches a file listed twice in the burst */
+        ptk_file_list_add_name( list, file );
+        ptk_file_list_request_mime_type( list, file );
+        g_ptr_array_add( added, file );
+    }
+    if ( added->len == 0 )
+    {
+        g_ptr_array_free( added, TRUE );
+        return;
+    }
+    g_ptr_array_sort_with_data( added, ptk_file_list_compare_rows, list );
 
-    gtk_tree_path_free( path );
+    /* new files go after equal rows, as in ptk_file_list_file_created.
+     * Each row is inserted and signalled before the next one, as views
+     * expect - i passes over the rows already in the list, and the new
+     * rows inserted before it */
+    for ( i = j = 0; j < added->len; i++ )
+    {
+        if ( i < list->files->len && ptk_file_list_compare( ROW_FILE( list, i ),
+                                              added->pdata[j], list ) <= 0 )
+            continue;
+        file = (VFSFileInfo*)added->pdata[j++];
+        ptk_file_list_insert_row( list, i, vfs_file_info_ref( file ) );
+        ptk_file_list_set_iter( list, &it, i );
+        path = gtk_tree_path_new_from_indices( i, -1 );
+        gtk_tree_model_row_inserted( GTK_TREE_MODEL(list), path, &it );
+        gtk_tree_path_free( path );
+    }
+    g_ptr_array_free( added, TRUE );
+}
+
+void ptk_file_list_flush_created( PtkFileList* list )
+{
+    GPtrArray* created = list->created;
+    guint i;
+
+    if ( list->created_idle )
+    {
+        g_source_remove( list->created_idle );
+        list->created_idle = 0;
+    }
+    list->created = g_ptr_array_new();
+    if ( created->len > FILE_LIST_MERGE_MIN )
+        ptk_file_list_merge_created( list, created );
+    else
+    {
+        for ( i = 0; i < created->len; i++ )
+            ptk_file_list_file_created( list->dir, created->pdata[i], list );
+    }
+    g_ptr_array_foreach( created, (GFunc)vfs_file_info_unref, NULL );
+    g_ptr_array_free( created, TRUE );
 }
 
 void ptk_file_list_file_deleted( VFSDir* dir,
                                  VFSFileInfo* file,
                                  PtkFileList* list )
 {
-    GList* l;
+    gint i;
     GtkTreePath* path;
 
+    if ( list->created->len )
+        ptk_file_list_flush_created( list );
+
     /* If there is no file info, that means the dir itself was deleted. */
     if( G_UNLIKELY( ! file ) )
     {
-        /* Clear the whole list */
-        path = gtk_tree_path_new_from_indices(0, -1);
-        for( l = list->files; l; l = list->files )
+        /* Clear the whole list, last row first to avoid moving rows */
+        for( i = (gint)list->files->len - 1; i >= 0; i-- )
         {
+            path = gtk_tree_path_new_from_indices( i, -1 );
             gtk_tree_model_row_deleted( GTK_TREE_MODEL(list), path );
-            file = (VFSFileInfo*)l->data;
-            list->files = g_list_delete_link( list->files, l );
+            gtk_tree_path_free( path );
+            file = ROW_FILE( list, i );
+            ptk_file_list_remove_row( list, i );
             vfs_file_info_unref( file );
-            --list->n_files;
         }
-        gtk_tree_path_free( path );
         return;
     }
 
     if( ! list->show_hidden && vfs_file_info_get_name(file)[0] == '.' )
         return;
 
-    l = g_list_find( list->files, file );
-    if( ! l )
+    i = ptk_file_list_find_row( list, file );
+    if( i < 0 )
         return;
 
-    path = gtk_tree_path_new_from_indices( g_list_index(list->files, l->data), -1 );
+    path = gtk_tree_path_new_from_indices( i, -1 );
 
     gtk_tree_model_row_deleted( GTK_TREE_MODEL(list), path );
 
     gtk_tree_path_free( path );
 
-    list->files = g_list_delete_link( list->files, l );
+    ptk_file_list_remove_row( list, i );
     vfs_file_info_unref( file );
-    --list->n_files;
 }
 
 void ptk_file_list_file_changed( VFSDir* dir,
                                  VFSFileInfo* file,
                                  PtkFileList* list )
 {
-    GList* l;
+    gint i;
     GtkTreeIter it;
     GtkTreePath* path;
 
+    if ( list->created->len )
+        ptk_file_list_flush_created( list );
     if( ! list->show_hidden && vfs_file_info_get_name(file)[0] == '.' )
         return;
-    l = g_list_find( list->files, file );
+    i = ptk_file_list_find_row( list, file );
 
-    if( ! l )
+    if( i < 0 )
         return;
 
-    it.stamp = list->stamp;
-    it.user_data = l;
-    it.user_data2 = l->data;
+    ptk_file_list_set_iter( list, &it, i );
 
-    path = gtk_tree_path_new_from_indices( g_list_index(list->files, l->data), -1 );
+    path = gtk_tree_path_new_from_indices( i, -1 );
 
     gtk_tree_model_row_changed( GTK_TREE_MODEL(list), path, &it );
 
     gtk_tree_path_free( path );
+
+    /* the type may have changed - sniffed types arrive in batches, so they
+     * are sorted once */
+    if ( list->sort_col == COL_FILE_DESC && !list->resort_timeout )
+        list->resort_timeout = g_timeout_add( 250,
+                                    ( GSourceFunc ) on_resort_timeout, list );
+}
+
+void ptk_file_list_raise_thumbnails( PtkFileList* list, int first, int last )
+{
+    VFSFileInfo* file;
+    int i;
+
+    if ( !list->dir || list->max_thumbnail == 0 || first < 0 )
+        return;
+    for ( i = first; i <= last && i < list->files->len; i++ )
+    {
+        file = ROW_FILE( list, i );
+        if ( !vfs_file_info_is_thumbnail_loaded( file, list->big_thumbnail ) )
+            vfs_thumbnail_loader_raise( list->dir, file );
+    }
+}
+
+void on_load_complete( VFSDir* dir, PtkFileList* list )
+{
+    /* rows were sorted by placeholder info while the dir was loading */
+    ptk_file_list_sort( list );
 }
 
 void on_thumbnail_loaded( VFSDir* dir, VFSFileInfo* file, PtkFileList* list )
@@ -1011,7 +1244,7 @@ void on_thumbnail_loaded( VFSDir* dir, VFSFileInfo* file, PtkFileList* list )
 void ptk_file_list_show_thumbnails( PtkFileList* list, gboolean is_big,
                                     int max_file_size )
 {
-    GList* l;
+    guint i;
     VFSFileInfo* file;
     int old_max_thumbnail;
 
@@ -1030,9 +1263,9 @@ void ptk_file_list_show_thumbnails( PtkFileList* list, gboolean is_big,
             vfs_thumbnail_loader_cancel_all_requests( list->dir, list->big_thumbnail );
             g_signal_handlers_disconnect_by_func( list->dir, on_thumbnail_loaded, list );
 
-            for( l = list->files; l; l = l->next )
+            for( i = 0; i < list->files->len; ++i )
             {
-                file = (VFSFileInfo*)l->data;
+                file = ROW_FILE( list, i );
                 if ( ( vfs_file_info_is_image( file )
 #ifdef HAVE_FFMPEG
                        || vfs_file_info_is_video( file )
@@ -1054,9 +1287,9 @@ void ptk_file_list_show_thumbnails( PtkFileList* list, gboolean is_big,
     g_signal_connect( list->dir, "thumbnail-loaded",
                                     G_CALLBACK(on_thumbnail_loaded), list );
 
-    for( l = list->files; l; l = l->next )
+    for( i = 0; i < list->files->len; ++i )
     {
-        file = (VFSFileInfo*)l->data;
+        file = ROW_FILE( list, i );
         if ( list->max_thumbnail != 0 && (
 #ifdef HAVE_FFMPEG
              vfs_file_info_is_video( file ) ||
@@ -1074,3 +1307,86 @@ void ptk_file_list_show_thumbnails( PtkFileList* list, gboolean is_big,
         }
     }
 }
+
+void ptk_file_list_bench( int n_files )
+{
+    PtkFileList* list;
+    GtkTreeModel* model;
+    GtkTreeIter it;
+    GtkTreePath* path;
+    GPtrArray* infos;
+    VFSFileInfo* file;
+    GTimer* timer;
+    char name[ 32 ];
+    int i, n;
+    gdouble secs;
+
+    list = ptk_file_list_new( NULL, TRUE );
+    model = GTK_TREE_MODEL( list );
+    list->sort_col = COL_FILE_NAME;
+    list->sort_order = GTK_SORT_ASCENDING;
+    infos = g_ptr_array_sized_new( n_files );
+    for ( i = 0; i < n_files; i++ )
+    {
+        /* pseudo random names so insertions land all over the list */
+        g_snprintf( name, sizeof( name ), "file-%08u",
+                                ( guint )( ( i * 2654435761u ) % 100000000 ) );
+        file = vfs_file_info_new();
+        file->mode = S_IFREG | 0644;
+        vfs_file_info_set_name( file, name );
+        vfs_file_info_set_disp_name( file, name );
+        g_ptr_array_add( infos, file );
+    }
+
+    timer = g_timer_new();
+    for ( i = 0; i < n_files; i++ )
+        ptk_file_list_file_created( NULL, infos->pdata[i], list );
+    secs = g_timer_elapsed( timer, NULL );
+    printf( "spacefm: %d rows  file_created  %.3f s (%.0f calls/s)\n",
+                    n_files, secs, secs > 0 ? n_files / secs : 0 );
+
+    /* the calls made by a view scrolling through the list */
+    n = MAX( n_files, 100000 );
+    g_timer_start( timer );
+    for ( i = 0; i < n; i++ )
+    {
+        path = gtk_tree_path_new_from_indices( ( i * 7919 ) % n_files, -1 );
+        gtk_tree_model_get_iter( model, &it, path );
+        gtk_tree_path_free( path );
+        path = gtk_tree_model_get_path( model, &it );
+        gtk_tree_path_free( path );
+        gtk_tree_model_iter_next( model, &it );
+    }
+    secs = g_timer_elapsed( timer, NULL );
+    printf( "    get_iter+get_path+iter_next  %.3f s (%.0f calls/s)\n",
+                    secs, secs > 0 ? n * 3 / secs : 0 );
+
+    /* file-changed for every row, as emitted by the progressive loader */
+    g_timer_start( timer );
+    for ( i = 0; i < n_files; i++ )
+        ptk_file_list_file_changed( NULL, infos->pdata[i], list );
+    secs = g_timer_elapsed( timer, NULL );
+    printf( "    file_changed  %.3f s (%.0f calls/s)\n",
+                    secs, secs > 0 ? n_files / secs : 0 );
+
+    g_timer_start( timer );
+    for ( i = 0; i < n_files; i++ )
+        ptk_file_list_file_deleted( NULL, infos->pdata[i], list );
+    secs = g_timer_elapsed( timer, NULL );
+    printf( "    file_deleted  %.3f s (%.0f calls/s)\n",
+                    secs, secs > 0 ? n_files / secs : 0 );
+
+    /* the same files as one burst within a notify interval */
+    g_timer_start( timer );
+    for ( i = 0; i < n_files; i++ )
+        _ptk_file_list_file_created( NULL, infos->pdata[i], list );
+    ptk_file_list_flush_created( list );
+    secs = g_timer_elapsed( timer, NULL );
+    printf( "    burst of file-created merged  %.3f s (%.0f files/s)\n",
+                    secs, secs > 0 ? n_files / secs : 0 );
+
+    g_timer_destroy( timer );
+    g_ptr_array_foreach( infos, ( GFunc ) vfs_file_info_unref, NULL );
+    g_ptr_array_free( infos, TRUE );
+    g_object_unref( list );
+}
@@ -60,7 +60,13 @@ struct _PtkFileList
     GObject parent;
     /* <private> */
     VFSDir* dir;
-    GList* files;
+    GPtrArray* files;   /* rows in sort order */
+    GHashTable* rows;   /* VFSFileInfo* -> row index, rebuilt when stale */
+    guint rows_valid;   /* the indices of the rows before this are right */
+    GHashTable* names;  /* file name -> VFSFileInfo*, for duplicate checks */
+    GPtrArray* created; /* files created since the last flush */
+    guint created_idle;
+    guint resort_timeout;  /* resort by type once sniffed types arrived */
     guint n_files;
 
     gboolean show_hidden : 1;
@@ -106,8 +112,14 @@ void ptk_file_list_file_changed( VFSDir* dir, VFSFileInfo* file,
 
 void ptk_file_list_show_thumbnails( PtkFileList* list, gboolean is_big,
                                     int max_file_size );
+/* load the thumbnails of rows first to last (in view) before the others */
+void ptk_file_list_raise_thumbnails( PtkFileList* list, int first, int last );
 void ptk_file_list_sort ( PtkFileList* list );   //sfm 
 
+/* measure tree model calls per second on a list of n_files synthetic
+ * files (--bench-file-list) */
+void ptk_file_list_bench( int n_files );
+
 G_END_DECLS
 
 #endif
@@ -649,14 +649,11 @@ void ptk_file_task_pause( PtkFileTask* ptask, int state )
         ptask->task->state_pause = VFS_FILE_TASK_QUEUE;
     else
     {
-        // Resume
-        if ( ptask->task->pause_cond )
-        {
-            g_mutex_lock( ptask->task->mutex );
-            g_cond_broadcast( ptask->task->pause_cond );
-            g_mutex_unlock( ptask->task->mutex );
-        }
+        // Resume - copy workers wait until they see it running
+        g_mutex_lock( ptask->task->mutex );
         ptask->task->state_pause = VFS_FILE_TASK_RUNNING;
+        g_cond_broadcast( ptask->task->pause_cond );
+        g_mutex_unlock( ptask->task->mutex );
     }    
     set_button_states( ptask );
     ptask->pause_change = ptask->pause_change_view = TRUE;
@@ -1548,7 +1545,15 @@ void ptk_file_task_update( PtkFileTask* ptask )
 
     VFSFileTask* task = ptask->task;
     off64_t cur_speed;
+    off64_t progress;
     gdouble timer_elapsed = g_timer_elapsed( task->timer, NULL );
+
+    // the delete pool counts items, since it doesn't stat the files
+    if ( task->item_progress && task->total_items )
+        progress = task->total_size * MIN( task->current_item,
+                                    task->total_items ) / task->total_items;
+    else
+        progress = task->progress;
     
     if ( task->type == VFS_FILE_TASK_EXEC )
     {
@@ -1594,15 +1599,15 @@ void ptk_file_task_update( PtkFileTask* ptask )
             gdouble since_last = timer_elapsed - task->last_elapsed;
             if ( since_last >= 2.0 )
             {
-                cur_speed = ( task->progress - task->last_progress ) / since_last;
+                cur_speed = ( progress - task->last_progress ) / since_last;
                 //printf( "( %lld - %lld ) / %lf = %lld\n", task->progress,
                 //                task->last_progress, since_last, cur_speed );
                 task->last_elapsed = timer_elapsed;
                 task->last_speed = cur_speed;
-                task->last_progress = task->progress;
+                task->last_progress = progress;
             }
             else if ( since_last > 0.1 )
-                cur_speed = ( task->progress - task->last_progress ) / since_last;
+                cur_speed = ( progress - task->last_progress ) / since_last;
             else
                 cur_speed = 0;
         }
@@ -1610,11 +1615,14 @@ void ptk_file_task_update( PtkFileTask* ptask )
         int ipercent;
         if ( task->total_size )
         {
-            gdouble dpercent = ( ( gdouble ) task->progress ) / task->total_size;
+            gdouble dpercent = ( ( gdouble ) progress ) / task->total_size;
             ipercent = ( int ) ( dpercent * 100 );
+            // total_size is still growing while the size thread runs
+            if ( task->size_scanning && ipercent > 99 )
+                ipercent = 99;
         }
         else
-            ipercent = 50;  // total_size calculation timed out
+            ipercent = 50;  // total_size not known yet
         if ( ipercent != task->percent )
             task->percent = ipercent;
     }
@@ -1653,14 +1661,25 @@ void ptk_file_task_update( PtkFileTask* ptask )
         char buf1[ 64 ];
         char buf2[ 64 ];
         //count
-        file_count = g_strdup_printf( "%d", task->current_item );
+        if ( task->total_items >= task->current_item )
+            g_snprintf( buf2, sizeof( buf2 ), " / %d%s", task->total_items,
+                                            task->size_scanning ? "+" : "" );
+        else
+            buf2[0] = '\0';
+        if ( timer_elapsed >= 1 && task->current_item > 1 )
+            file_count = g_strdup_printf( "%d%s (%d/s)", task->current_item,
+                                buf2,
+                                (int)( task->current_item / timer_elapsed ) );
+        else
+            file_count = g_strdup_printf( "%d%s", task->current_item, buf2 );
         //size
-        vfs_file_size_to_string_format( buf1, task->progress, NULL );
+        vfs_file_size_to_string_format( buf1, progress, NULL );
         if ( task->total_size )
             vfs_file_size_to_string_format( buf2, task->total_size, NULL );
         else
-            sprintf( buf2, "??" );  // total_size calculation timed out
-        size_tally = g_strdup_printf( "%s / %s", buf1, buf2 );
+            sprintf( buf2, "??" );  // total_size not known yet
+        size_tally = g_strdup_printf( "%s / %s%s", buf1, buf2,
+                                            task->size_scanning ? "+" : "" );
         // cur speed display
         if ( task->last_speed != 0 )
             // use speed of last 2 sec interval if available
@@ -1682,7 +1701,7 @@ void ptk_file_task_update( PtkFileTask* ptask )
         // avg speed
         time_t avg_speed;
         if ( timer_elapsed > 0 )
-            avg_speed = task->progress / timer_elapsed;
+            avg_speed = progress / timer_elapsed;
         else
             avg_speed = 0;
         vfs_file_size_to_string_format( buf2, avg_speed, NULL );
@@ -1690,7 +1709,7 @@ void ptk_file_task_update( PtkFileTask* ptask )
         //remain cur
         off64_t remain;
         if ( cur_speed > 0 && task->total_size != 0 )
-            remain = ( task->total_size - task->progress ) / cur_speed;
+            remain = ( task->total_size - progress ) / cur_speed;
         else
             remain = 0;
         if ( remain <= 0 )
@@ -1709,7 +1728,7 @@ void ptk_file_task_update( PtkFileTask* ptask )
             remain1 = g_strdup_printf( ":%02lu", remain );
         //remain avg
         if ( avg_speed > 0 && task->total_size != 0 )
-            remain = ( task->total_size - task->progress ) / avg_speed;
+            remain = ( task->total_size - progress ) / avg_speed;
         else
             remain = 0;
         if ( remain <= 0 )
@@ -27,8 +27,16 @@
 #endif
 
 #include <unistd.h> /* for read */
+#include <errno.h>
+#include <stdio.h>
 #include "vfs-volume.h"
 
+#if defined (__linux__)
+#include <sys/syscall.h>    /* for SYS_getdents64 */
+#include <sys/sysmacros.h>  /* for makedev */
+#include <dirent.h>         /* for DT_DIR */
+#endif
+
 
 static void vfs_dir_class_init( VFSDirClass* klass );
 static void vfs_dir_init( VFSDir* dir );
@@ -80,6 +88,7 @@ enum {
     FILE_CHANGED_SIGNAL,
     THUMBNAIL_LOADED_SIGNAL,
     FILE_LISTED_SIGNAL,
+    LOAD_COMPLETE_SIGNAL,
     N_SIGNALS
 };
 
@@ -91,12 +100,71 @@ static GList* mime_cb = NULL;
 static guint change_notify_timeout = 0;
 static guint theme_change_notify = 0;
 
+/* LRU of recently used dirs, most recent first - each entry holds a ref so
+ * a released dir stays listed and monitored until it is trimmed */
+#define DIR_CACHE_MAX_IDLE   8
+#define DIR_CACHE_MAX_BYTES  ( 32 * 1024 * 1024 )
+static GQueue* dir_cache = NULL;
+static guint dir_cache_hits = 0;
+static guint dir_cache_misses = 0;
+static guint dir_cache_n_idle = 0;
+static gsize dir_cache_idle_bytes = 0;   /* sum of cache_bytes */
+
 static char* desktop_dir = NULL;
 static char* home_trash_dir = NULL;
 static size_t home_trash_dir_len = 0;
 
 static gboolean is_desktop_set = FALSE;
 
+/* file info loaded by the progressive loader for a placeholder */
+typedef struct
+{
+    VFSFileInfo* file;  /* placeholder in dir->file_list */
+    VFSFileInfo* info;  /* loaded info, or NULL if the file is gone */
+}VFSDirUpdate;
+
+/* deferred mime sniffing request, and its result once sniffed */
+typedef struct
+{
+    VFSFileInfo* file;
+    char* path;
+    struct stat64 file_stat;    /* identity of file when requested */
+    VFSMimeType* mime_type;
+}VFSDirSniff;
+
+/* an entry found on disk by the rescan thread */
+typedef struct
+{
+    char* name;
+    struct stat64 file_stat;
+    gboolean has_stat;
+}VFSDirRescanEntry;
+
+/* result of the rescan thread, applied by on_rescan_task_finished */
+typedef struct
+{
+    GPtrArray* entries;
+    time_t mtime;
+}VFSDirRescan;
+
+static void vfs_dir_apply_updates( VFSDir* dir );
+static void vfs_dir_sniff_free( VFSDirSniff* sniff );
+static void on_rescan_task_finished( VFSAsyncTask* task, gboolean is_cancelled,
+                                     VFSDir* dir );
+
+/* read buffer size used by the batched getdents64 loader */
+#define DIR_LOAD_BATCH_SIZE ( 256 * 1024 )
+
+/* the batched loader shards directories with at least DIR_LOAD_MIN_PARALLEL
+ * entries across up to DIR_LOAD_MAX_THREADS threads */
+#define DIR_LOAD_MIN_PARALLEL 256
+#define DIR_LOAD_MAX_THREADS 8
+
+static VFSDirLoadMode dir_load_mode = VFS_DIR_LOAD_BATCH;
+static int dir_load_threads = 0;    // 0 = automatic
+static gboolean dir_load_report = FALSE;
+static gboolean dir_lazy_mime = TRUE;
+
 GType vfs_dir_get_type()
 {
     static GType type = G_TYPE_INVALID;
@@ -193,6 +261,19 @@ void vfs_dir_class_init( VFSDirClass* klass )
                        g_cclosure_marshal_VOID__BOOLEAN,
                        G_TYPE_NONE, 1, G_TYPE_BOOLEAN );
 
+    /*
+    * load-complete is emitted when the progressive loader has finished
+    * loading the info of all files, after "file-listed" was emitted early.
+    */
+    signals[ LOAD_COMPLETE_SIGNAL ] =
+        g_signal_new ( "load-complete",
+                       G_TYPE_FROM_CLASS ( klass ),
+                       G_SIGNAL_RUN_FIRST,
+                       G_STRUCT_OFFSET ( VFSDirClass, load_complete ),
+                       NULL, NULL,
+                       g_cclosure_marshal_VOID__VOID,
+                       G_TYPE_NONE, 0 );
+
     /* FIXME: Is there better way to do this? */
     if( G_UNLIKELY( ! is_desktop_set ) )
         vfs_get_desktop_dir();
@@ -212,6 +293,7 @@ void vfs_dir_init( VFSDir* dir )
 void vfs_dir_finalize( GObject *obj )
 {
     VFSDir * dir = VFS_DIR( obj );
+    VFSDirRescan* rescan;
 //printf("vfs_dir_finalize  %s\n", dir->path );
     do{}
     while( g_source_remove_by_user_data( dir ) );
@@ -224,6 +306,30 @@ void vfs_dir_finalize( GObject *obj )
         vfs_async_task_cancel( dir->task );
         g_object_unref( dir->task );
         dir->task = NULL;
+        /* the load thread may have added idle handlers before it exited */
+        do{}
+        while( g_source_remove_by_user_data( dir ) );
+    }
+    if ( dir->sniff_task )
+    {
+        /* the sniff thread frees the queue when it exits */
+        vfs_async_task_cancel( dir->sniff_task );
+        g_object_unref( dir->sniff_task );
+        dir->sniff_task = NULL;
+        do{}
+        while( g_source_remove_by_user_data( dir ) );
+    }
+    if ( dir->rescan_task )
+    {
+        g_signal_handlers_disconnect_by_func( dir->rescan_task,
+                                              on_rescan_task_finished, dir );
+        vfs_async_task_cancel( dir->rescan_task );
+        rescan = (VFSDirRescan*)vfs_async_task_get_return_value(
+                                                        dir->rescan_task );
+        if ( rescan )
+            vfs_dir_rescan_free( rescan );
+        g_object_unref( dir->rescan_task );
+        dir->rescan_task = NULL;
     }
     if ( dir->monitor )
     {
@@ -231,6 +337,16 @@ void vfs_dir_finalize( GObject *obj )
                                  vfs_dir_monitor_callback,
                                  dir );
     }
+    /* updates queued by a load or sniff thread which has finished, or by
+     * the monitor - it may have been removed by user data above */
+    if ( dir->update_idle )
+    {
+        GSource* source = g_main_context_find_source_by_id( NULL,
+                                                        dir->update_idle );
+        if ( source )
+            g_source_destroy( source );
+        dir->update_idle = 0;
+    }
     if ( dir->path )
     {
         if( G_LIKELY( dir_hash ) )
@@ -276,6 +392,11 @@ void vfs_dir_finalize( GObject *obj )
         dir->file_list = NULL;
         dir->n_files = 0;
     }
+    if ( dir->file_index )
+    {
+        g_hash_table_destroy( dir->file_index );
+        dir->file_index = NULL;
+    }
 
     if( dir->changed_files )
     {
@@ -291,6 +412,27 @@ void vfs_dir_finalize( GObject *obj )
         dir->created_files = NULL;
     }
 
+    if( dir->pending_updates )
+    {
+        GSList* l;
+        for ( l = dir->pending_updates; l; l = l->next )
+        {
+            VFSDirUpdate* update = (VFSDirUpdate*)l->data;
+            vfs_file_info_unref( update->file );
+            if ( update->info )
+                vfs_file_info_unref( update->info );
+            g_slice_free( VFSDirUpdate, update );
+        }
+        g_slist_free( dir->pending_updates );
+        dir->pending_updates = NULL;
+    }
+    if ( dir->sniffed_files )
+    {
+        g_slist_foreach( dir->sniffed_files, (GFunc)vfs_dir_sniff_free, NULL );
+        g_slist_free( dir->sniffed_files );
+        dir->sniffed_files = NULL;
+    }
+
     g_mutex_free( dir->mutex );
     G_OBJECT_CLASS( parent_class ) ->finalize( obj );
 }
@@ -307,21 +449,47 @@ void vfs_dir_set_property ( GObject *obj,
                             GParamSpec *pspec )
 {}
 
+/* dir->file_index maps file names to their node in dir->file_list, and must
+ * be updated with dir->mutex locked whenever a node is added or removed */
+static void vfs_dir_index_add( VFSDir* dir, GList* l )
+{
+    VFSFileInfo* file = (VFSFileInfo*)l->data;
+
+    if ( G_UNLIKELY( !dir->file_index ) )
+        dir->file_index = g_hash_table_new_full( g_str_hash, g_str_equal,
+                                                 g_free, NULL );
+    if ( G_LIKELY( file->name ) )
+        g_hash_table_replace( dir->file_index, g_strdup( file->name ), l );
+}
+
+static void vfs_dir_index_remove( VFSDir* dir, GList* l, const char* file_name )
+{
+    if ( dir->file_index && file_name &&
+                    g_hash_table_lookup( dir->file_index, file_name ) == l )
+        g_hash_table_remove( dir->file_index, file_name );
+}
+
 static GList* vfs_dir_find_file( VFSDir* dir, const char* file_name, VFSFileInfo* file )
 {
-    GList * l;
-    VFSFileInfo* file2;
-    for ( l = dir->file_list; l; l = l->next )
-    {
-        file2 = ( VFSFileInfo* ) l->data;
-        if( G_UNLIKELY( file == file2 ) )
-            return l;
-        if ( file2->name && 0 == strcmp( file2->name, file_name ) )
-        {
-            return l;
-        }
-    }
-    return NULL;
+    GList * l = NULL;
+
+    if ( dir->file_index && file_name )
+        l = (GList*)g_hash_table_lookup( dir->file_index, file_name );
+    if ( G_UNLIKELY( !l && file ) )
+        l = g_list_find( dir->file_list, file );
+    return l;
+}
+
+/* the node of file itself - another file with the same name may have
+ * replaced it in the index */
+static GList* vfs_dir_find_file_node( VFSDir* dir, const char* file_name,
+                                                        VFSFileInfo* file )
+{
+    GList* l = vfs_dir_find_file( dir, file_name, file );
+
+    if ( l && l->data != file )
+        l = g_list_find( dir->file_list, file );
+    return l;
 }
 
 /* signal handlers */
@@ -339,11 +507,12 @@ void vfs_dir_emit_file_created( VFSDir* dir, const char* file_name, gboolean for
         return;
     }
 
-    dir->created_files = g_slist_append( dir->created_files, g_strdup( file_name ) );
+    // prepended for O(1) insertion, reversed in update_created_files
+    dir->created_files = g_slist_prepend( dir->created_files, g_strdup( file_name ) );
     if ( 0 == change_notify_timeout )
     {
         change_notify_timeout = g_timeout_add_full( G_PRIORITY_LOW,
-                                                    200,
+                                    vfs_file_monitor_get_delay( 200, 1000 ),
                                                     notify_file_change,
                                                     NULL, NULL );
     }
@@ -363,23 +532,28 @@ void vfs_dir_emit_file_deleted( VFSDir* dir, const char* file_name, VFSFileInfo*
         g_list_foreach( dir->file_list, (GFunc)vfs_file_info_unref, NULL );
         g_list_free( dir->file_list );
         dir->file_list = NULL;
+        dir->n_files = 0;
+        if ( dir->file_index )
+            g_hash_table_remove_all( dir->file_index );
         g_mutex_unlock( dir->mutex );
 
         g_signal_emit( dir, signals[ FILE_DELETED_SIGNAL ], 0, file );
         return;
     }
 
+    g_mutex_lock( dir->mutex );
     l = vfs_dir_find_file( dir, file_name, file );
-    if ( G_LIKELY( l ) )
+    file_found = l ? vfs_file_info_ref( ( VFSFileInfo* ) l->data ) : NULL;
+    g_mutex_unlock( dir->mutex );
+    if ( G_LIKELY( file_found ) )
     {
-        file_found = vfs_file_info_ref( ( VFSFileInfo* ) l->data );
         if( !g_slist_find( dir->changed_files, file_found ) )
         {
             dir->changed_files = g_slist_prepend( dir->changed_files, file_found );
             if ( 0 == change_notify_timeout )
             {
                 change_notify_timeout = g_timeout_add_full( G_PRIORITY_LOW,
-                                                            200,
+                                    vfs_file_monitor_get_delay( 200, 1000 ),
                                                             notify_file_change,
                                                             NULL, NULL );
             }
@@ -419,7 +593,7 @@ void vfs_dir_emit_file_changed( VFSDir* dir, const char* file_name,
                 if ( 0 == change_notify_timeout )
                 {
                     change_notify_timeout = g_timeout_add_full( G_PRIORITY_LOW,
-                                                                100,
+                                    vfs_file_monitor_get_delay( 100, 1000 ),
                                                                 notify_file_change,
                                                                 NULL, NULL );
                 }
@@ -430,7 +604,7 @@ void vfs_dir_emit_file_changed( VFSDir* dir, const char* file_name,
                 if ( 0 == change_notify_timeout )
                 {
                     change_notify_timeout = g_timeout_add_full( G_PRIORITY_LOW,
-                                                                500,
+                                    vfs_file_monitor_get_delay( 500, 2000 ),
                                                                 notify_file_change,
                                                                 NULL, NULL );
                 }
@@ -448,12 +622,9 @@ void vfs_dir_emit_thumbnail_loaded( VFSDir* dir, VFSFileInfo* file )
 {
     GList* l;
     g_mutex_lock( dir->mutex );
-    l = vfs_dir_find_file( dir, file->name, file );
+    l = vfs_dir_find_file_node( dir, file->name, file );
     if( l )
-    {
-        g_assert( file == (VFSFileInfo*)l->data );
         file = vfs_file_info_ref( (VFSFileInfo*)l->data );
-    }
     else
         file = NULL;
     g_mutex_unlock( dir->mutex );
@@ -465,6 +636,188 @@ void vfs_dir_emit_thumbnail_loaded( VFSDir* dir, VFSFileInfo* file )
     }
 }
 
+static void vfs_dir_rescan_free( VFSDirRescan* rescan )
+{
+    guint i;
+    VFSDirRescanEntry* entry;
+
+    for ( i = 0; i < rescan->entries->len; i++ )
+    {
+        entry = (VFSDirRescanEntry*)rescan->entries->pdata[i];
+        g_free( entry->name );
+        g_slice_free( VFSDirRescanEntry, entry );
+    }
+    g_ptr_array_free( rescan->entries, TRUE );
+    g_slice_free( VFSDirRescan, rescan );
+}
+
+/* list and lstat the dir in a thread - only dir->path is used here, the
+ * file list is compared in the main thread */
+static gpointer vfs_dir_rescan_thread( VFSAsyncTask* task, VFSDir* dir )
+{
+    GDir* dir_content;
+    const char* file_name;
+    char* full_path;
+    char* hidden;
+    struct stat64 file_stat;
+    VFSDirRescan* rescan;
+    VFSDirRescanEntry* entry;
+
+    if ( !( dir_content = g_dir_open( dir->path, 0, NULL ) ) )
+        return NULL;
+    rescan = g_slice_new0( VFSDirRescan );
+    rescan->entries = g_ptr_array_new();
+    if ( stat64( dir->path, &file_stat ) == 0 )
+        rescan->mtime = file_stat.st_mtime;
+
+    hidden = gethidden( dir->path );
+    while ( ( file_name = g_dir_read_name( dir_content ) ) )
+    {
+        if ( vfs_async_task_is_cancelled( task ) )
+            break;
+        if ( hidden && ishidden( hidden, file_name ) )
+            continue;
+        entry = g_slice_new0( VFSDirRescanEntry );
+        entry->name = g_strdup( file_name );
+        full_path = g_build_filename( dir->path, file_name, NULL );
+        entry->has_stat = lstat64( full_path, &entry->file_stat ) == 0;
+        g_free( full_path );
+        g_ptr_array_add( rescan->entries, entry );
+    }
+    g_dir_close( dir_content );
+    g_free( hidden );
+
+    if ( vfs_async_task_is_cancelled( task ) )
+    {
+        vfs_dir_rescan_free( rescan );
+        return NULL;
+    }
+    return rescan;
+}
+
+static void vfs_dir_apply_rescan( VFSDir* dir, VFSDirRescan* rescan )
+{
+    GHashTable* on_disk;
+    GList* l;
+    GSList* deleted = NULL;
+    GSList* changed = NULL;
+    GSList* sl;
+    VFSFileInfo* file;
+    VFSDirRescanEntry* entry;
+    guint i;
+
+    if ( rescan->mtime )
+        dir->mtime = rescan->mtime;
+
+    on_disk = g_hash_table_new( g_str_hash, g_str_equal );
+    for ( i = 0; i < rescan->entries->len; i++ )
+    {
+        entry = (VFSDirRescanEntry*)rescan->entries->pdata[i];
+        g_hash_table_insert( on_disk, entry->name, entry );
+
+        g_mutex_lock( dir->mutex );
+        l = vfs_dir_find_file( dir, entry->name, NULL );
+        file = l ? vfs_file_info_ref( ( VFSFileInfo* ) l->data ) : NULL;
+        g_mutex_unlock( dir->mutex );
+        if ( !file )
+        {
+            vfs_dir_emit_file_created( dir, entry->name, TRUE );
+            continue;
+        }
+
+        /* unchanged files keep their info, thumbnails and collate keys */
+        if ( !file->placeholder && entry->has_stat &&
+                ( file->mtime != entry->file_stat.st_mtime ||
+                  file->size != entry->file_stat.st_size ||
+                  file->ino != entry->file_stat.st_ino ||
+                  file->mode != entry->file_stat.st_mode ) )
+            changed = g_slist_prepend( changed, file );
+        else
+            vfs_file_info_unref( file );
+    }
+
+    g_mutex_lock( dir->mutex );
+    for ( l = dir->file_list; l; l = l->next )
+    {
+        file = ( VFSFileInfo* ) l->data;
+        if ( file->name && !g_hash_table_lookup( on_disk, file->name ) )
+            deleted = g_slist_prepend( deleted, vfs_file_info_ref( file ) );
+    }
+    g_mutex_unlock( dir->mutex );
+    g_hash_table_destroy( on_disk );
+
+    for ( sl = deleted; sl; sl = sl->next )
+    {
+        file = ( VFSFileInfo* ) sl->data;
+        vfs_dir_emit_file_deleted( dir, file->name, file );
+        vfs_file_info_unref( file );
+    }
+    g_slist_free( deleted );
+
+    for ( sl = changed; sl; sl = sl->next )
+    {
+        file = ( VFSFileInfo* ) sl->data;
+        vfs_dir_emit_file_changed( dir, file->name, file, TRUE );
+        vfs_file_info_unref( file );
+    }
+    g_slist_free( changed );
+
+    /* show the differences now rather than after the notify delay */
+    vfs_dir_flush_notify_cache();
+}
+
+static void on_rescan_task_finished( VFSAsyncTask* task, gboolean is_cancelled,
+                                     VFSDir* dir )
+{
+    VFSDirRescan* rescan = (VFSDirRescan*)vfs_async_task_get_return_value( task );
+
+    dir->rescan_task = NULL;
+    if ( rescan )
+    {
+        if ( !is_cancelled && !vfs_dir_is_loading( dir ) )
+            vfs_dir_apply_rescan( dir, rescan );
+        vfs_dir_rescan_free( rescan );
+    }
+    g_object_unref( task );
+
+    /* the dir changed again while the thread was reading it */
+    if ( dir->rescan_again && !is_cancelled )
+    {
+        dir->rescan_again = 0;
+        vfs_dir_rescan( dir );
+    }
+}
+
+gboolean vfs_dir_rescan( VFSDir* dir )
+{
+    /* a running load reads the current contents anyway */
+    if ( vfs_dir_is_loading( dir ) || !dir->file_listed )
+        return FALSE;
+    dir->stale = 0;
+    if ( dir->rescan_task )
+    {
+        dir->rescan_again = 1;
+        return TRUE;
+    }
+    dir->rescan_task = vfs_async_task_new(
+                            (VFSAsyncFunc)vfs_dir_rescan_thread, dir );
+    g_signal_connect( dir->rescan_task, "finish",
+                      G_CALLBACK( on_rescan_task_finished ), dir );
+    vfs_async_task_execute( dir->rescan_task );
+    return TRUE;
+}
+
+void vfs_dir_set_visible( VFSDir* dir, gboolean visible )
+{
+    if ( visible )
+    {
+        if ( dir->n_visible++ == 0 && dir->stale )
+            vfs_dir_rescan( dir );
+    }
+    else if ( dir->n_visible > 0 )
+        dir->n_visible--;
+}
+
 /* methods */
 
 VFSDir* vfs_dir_new( const char* path )
@@ -486,6 +839,14 @@ void on_list_task_finished( VFSAsyncTask* task, gboolean is_cancelled, VFSDir* d
 {
     g_object_unref( dir->task );
     dir->task = NULL;
+    if ( dir->file_listed )
+    {
+        /* the progressive loader already emitted "file-listed" */
+        vfs_dir_apply_updates( dir );
+        dir->load_complete = 1;
+        g_signal_emit( dir, signals[LOAD_COMPLETE_SIGNAL], 0 );
+        return;
+    }
     g_signal_emit( dir, signals[FILE_LISTED_SIGNAL], 0, is_cancelled );
     dir->file_listed = 1;
     dir->load_complete = 1;
@@ -659,7 +1020,70 @@ gboolean is_dir_desktop( const char* path )
 }
 #endif
 
-gpointer vfs_dir_load_thread(  VFSAsyncTask* task, VFSDir* dir )
+/* get the info of a file in the dir, without content sniffing if lazy -
+ * file_stat can be NULL */
+static gboolean vfs_dir_get_file_info( VFSFileInfo* file,
+                                       const char* full_path,
+                                       const char* file_name,
+                                       struct stat64* file_stat )
+{
+    if ( file_stat )
+        return dir_lazy_mime ?
+            vfs_file_info_get_with_stat_lazy( file, full_path, file_name,
+                                                            file_stat ) :
+            vfs_file_info_get_with_stat( file, full_path, file_name,
+                                                            file_stat );
+    return dir_lazy_mime ?
+            vfs_file_info_get_lazy( file, full_path, file_name ) :
+            vfs_file_info_get( file, full_path, file_name );
+}
+
+static void vfs_dir_add_loaded_file( VFSDir* dir, VFSFileInfo* file,
+                                     const char* full_path,
+                                     const char* file_name,
+                                     GKeyFile* kf )
+{
+    g_mutex_lock( dir->mutex );
+
+    /* Special processing for desktop folder */
+    vfs_file_info_load_special_info( file, full_path );
+
+    /* FIXME: load info, too when new file is added to trash dir */
+    if( G_UNLIKELY( dir->is_trash ) ) /* load info of trashed files */
+    {
+        gboolean info_loaded;
+        char* info = g_strconcat( home_trash_dir, "/info/", file_name, ".trashinfo", NULL );
+
+        info_loaded = g_key_file_load_from_file( kf, info, 0, NULL );
+        g_free( info );
+        if( info_loaded )
+        {
+            char* ori_path = g_key_file_get_string( kf, "Trash Info", "Path", NULL );
+            if( ori_path )
+            {
+                /* Thanks to the stupid freedesktop.org spec, the filename is encoded
+                 * like a URL, which is insane. This add nothing more than overhead. */
+                char* fake_uri = g_strconcat( "file://", ori_path, NULL );
+                g_free( ori_path );
+                ori_path = g_filename_from_uri( fake_uri, NULL, NULL );
+                /* g_debug( ori_path ); */
+
+                if( file->disp_name && file->disp_name != file->name )
+                    g_free( file->disp_name );
+                file->disp_name = g_filename_display_basename( ori_path );
+                g_free( ori_path );
+            }
+        }
+    }
+
+    dir->file_list = g_list_prepend( dir->file_list, file );
+    vfs_dir_index_add( dir, dir->file_list );
+    ++dir->n_files;
+    g_mutex_unlock( dir->mutex );
+}
+
+/* Classic loader: g_dir_read_name() and a path based lstat per entry */
+static void vfs_dir_load_classic( VFSDir* dir, GKeyFile* kf )
 {
     const gchar * file_name;
     char* full_path;
@@ -667,99 +1091,859 @@ gpointer vfs_dir_load_thread(  VFSAsyncTask* task, VFSDir* dir )
     VFSFileInfo* file;
     char* hidden = NULL;  //MOD added
 
+    dir_content = g_dir_open( dir->path, 0, NULL );
+    if ( !dir_content )
+        return;
+
+    // MOD  dir contains .hidden file?
+    hidden = gethidden( dir->path );
+
+    while ( ! vfs_async_task_is_cancelled( dir->task )
+                && ( file_name = g_dir_read_name( dir_content ) ) )
+    {
+        //MOD ignore if in .hidden
+        if ( hidden && ishidden( hidden, file_name ) )
+        {
+            dir->xhidden_count++;
+            continue;
+        }
+
+        full_path = g_build_filename( dir->path, file_name, NULL );
+        if ( !full_path )
+            continue;
+
+        /* FIXME: Is locking GDK needed here? */
+        /* GDK_THREADS_ENTER(); */
+        file = vfs_file_info_new();
+        if ( G_LIKELY( vfs_dir_get_file_info( file, full_path, file_name,
+                                                                NULL ) ) )
+            vfs_dir_add_loaded_file( dir, file, full_path, file_name, kf );
+        else
+            vfs_file_info_unref( file );
+        /* GDK_THREADS_LEAVE(); */
+        g_free( full_path );
+    }
+    g_dir_close( dir_content );
+    g_free( hidden );
+}
+
+#if defined (__linux__) && defined (SYS_getdents64)
+/* record layout returned by the getdents64 syscall */
+struct linux_dirent64
+{
+    guint64 d_ino;
+    gint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* stat an entry relative to the open directory fd, without following links */
+static int vfs_dir_stat_at( int dfd, const char* file_name,
+                                                    struct stat64* file_stat )
+{
+#ifdef STATX_BASIC_STATS
+    static gboolean no_statx = FALSE;
+    struct statx stx;
+
+    if ( G_LIKELY( !no_statx ) )
+    {
+        /* only request the fields VFSFileInfo actually stores - the inode
+         * is needed by vfs_dir_rescan and the mime memo */
+        if ( statx( dfd, file_name, AT_SYMLINK_NOFOLLOW,
+                    STATX_TYPE | STATX_MODE | STATX_INO | STATX_UID |
+                    STATX_GID | STATX_SIZE | STATX_MTIME | STATX_ATIME |
+                    STATX_CTIME | STATX_BLOCKS,
+                    &stx ) == 0 )
+        {
+            memset( file_stat, 0, sizeof( struct stat64 ) );
+            file_stat->st_mode = stx.stx_mode;
+            file_stat->st_dev = makedev( stx.stx_dev_major, stx.stx_dev_minor );
+            file_stat->st_ino = stx.stx_ino;
+            file_stat->st_uid = stx.stx_uid;
+            file_stat->st_gid = stx.stx_gid;
+            file_stat->st_size = stx.stx_size;
+            file_stat->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+            file_stat->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+            file_stat->st_atim.tv_sec = stx.stx_atime.tv_sec;
+            file_stat->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+            file_stat->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+            file_stat->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+            file_stat->st_blksize = stx.stx_blksize;
+            file_stat->st_blocks = stx.stx_blocks;
+            return 0;
+        }
+        if ( errno != ENOSYS )
+            return -1;
+        // kernel < 4.11
+        no_statx = TRUE;
+    }
+#endif
+    return fstatat64( dfd, file_name, file_stat, AT_SYMLINK_NOFOLLOW );
+}
+
+/* Stat and fill VFSFileInfo for names[first] to names[last - 1] */
+static void vfs_dir_load_names( VFSDir* dir, int dfd, char** names,
+                                guint first, guint last, GKeyFile* kf )
+{
+    guint i;
+    GString* full_path;
+    gsize dir_len;
+    struct stat64 file_stat;
+    VFSFileInfo* file;
+
+    full_path = g_string_new( dir->path );
+    if ( full_path->len == 0 || full_path->str[ full_path->len - 1 ] != '/' )
+        g_string_append_c( full_path, '/' );
+    dir_len = full_path->len;
+
+    for ( i = first; i < last; i++ )
+    {
+        if ( G_UNLIKELY( vfs_async_task_is_cancelled( dir->task ) ) )
+            break;
+        if ( vfs_dir_stat_at( dfd, names[i], &file_stat ) == -1 )
+            continue;   // file removed since read
+
+        g_string_truncate( full_path, dir_len );
+        g_string_append( full_path, names[i] );
+        file = vfs_file_info_new();
+        vfs_dir_get_file_info( file, full_path->str, names[i], &file_stat );
+        vfs_dir_add_loaded_file( dir, file, full_path->str, names[i], kf );
+    }
+    g_string_free( full_path, TRUE );
+}
+
+/* shards still running for one vfs_dir_load_names_parallel call */
+typedef struct
+{
+    GMutex* mutex;
+    GCond* cond;
+    int pending;
+}VFSDirLoadJoin;
+
+/* one slice of the name list handled by a load worker thread */
+typedef struct
+{
+    VFSDir* dir;
+    int dfd;
+    char** names;
+    guint first;
+    guint last;
+    VFSDirLoadJoin* join;
+}VFSDirLoadShard;
+
+/* workers shared by all dir loads, so opening several tabs at once doesn't
+ * multiply the number of threads */
+static GThreadPool* load_pool = NULL;
+G_LOCK_DEFINE_STATIC( load_pool );
+
+static void vfs_dir_load_shard_thread( VFSDirLoadShard* shard,
+                                       gpointer user_data )
+{
+    VFSDirLoadJoin* join = shard->join;
+
+    vfs_dir_load_names( shard->dir, shard->dfd, shard->names,
+                        shard->first, shard->last, NULL );
+    if ( join )
+    {
+        g_mutex_lock( join->mutex );
+        if ( --join->pending == 0 )
+            g_cond_signal( join->cond );
+        g_mutex_unlock( join->mutex );
+    }
+}
+
+static int vfs_dir_get_load_threads()
+{
+    long n;
+
+    if ( dir_load_threads > 0 )
+        return MIN( dir_load_threads, DIR_LOAD_MAX_THREADS );
+    /* stat is mostly latency bound on network filesystems, so use
+     * more threads than cpus */
+    n = sysconf( _SC_NPROCESSORS_ONLN );
+    return CLAMP( n * 2, 2, DIR_LOAD_MAX_THREADS );
+}
+
+/* Fill VFSFileInfo for all names, sharding the list across a bounded
+ * pool of worker threads for large directories.  Results are merged
+ * into dir->file_list under dir->mutex by vfs_dir_add_loaded_file, and
+ * all workers are joined before returning, so "file-listed" is still
+ * emitted only after every entry is loaded. */
+static int vfs_dir_load_names_parallel( VFSDir* dir, int dfd,
+                                        GPtrArray* names, GKeyFile* kf )
+{
+    VFSDirLoadShard shards[ DIR_LOAD_MAX_THREADS ];
+    VFSDirLoadJoin join;
+    GThreadPool* pool;
+    int i, n_threads;
+
+    n_threads = vfs_dir_get_load_threads();
+    /* GKeyFile used for trash info is not thread safe */
+    if ( n_threads < 2 || names->len < DIR_LOAD_MIN_PARALLEL || kf )
+    {
+        vfs_dir_load_names( dir, dfd, (char**)names->pdata, 0, names->len, kf );
+        return 1;
+    }
+
+    G_LOCK( load_pool );
+    if ( !load_pool )
+        load_pool = g_thread_pool_new( ( GFunc ) vfs_dir_load_shard_thread,
+                                       NULL, DIR_LOAD_MAX_THREADS - 1,
+                                       FALSE, NULL );
+    pool = load_pool;
+    G_UNLOCK( load_pool );
+
+    join.mutex = g_mutex_new();
+    join.cond = g_cond_new();
+    join.pending = 0;
+    for ( i = 0; i < n_threads; i++ )
+    {
+        shards[i].dir = dir;
+        shards[i].dfd = dfd;
+        shards[i].names = (char**)names->pdata;
+        shards[i].first = (guint64)names->len * i / n_threads;
+        shards[i].last = (guint64)names->len * ( i + 1 ) / n_threads;
+        shards[i].join = &join;
+        /* the last shard runs in this thread */
+        if ( i < n_threads - 1 && pool )
+        {
+            g_mutex_lock( join.mutex );
+            join.pending++;
+            g_mutex_unlock( join.mutex );
+            g_thread_pool_push( pool, &shards[i], NULL );
+        }
+        else
+        {
+            shards[i].join = NULL;
+            vfs_dir_load_shard_thread( &shards[i], NULL );
+        }
+    }
+    /* wait for the shards queued to the pool */
+    g_mutex_lock( join.mutex );
+    while ( join.pending > 0 )
+        g_cond_wait( join.cond, join.mutex );
+    g_mutex_unlock( join.mutex );
+    g_cond_free( join.cond );
+    g_mutex_free( join.mutex );
+    return n_threads;
+}
+
+/* Batched loader: reads entries in large getdents64 batches and stats them
+ * relative to the open directory fd.  Returns the number of threads used, or
+ * 0 if the syscall is not available, in which case nothing was loaded. */
+static int vfs_dir_load_batch( VFSDir* dir, GKeyFile* kf )
+{
+    int dfd, n_threads;
+    long nread = 0, pos;
+    int n_batches = 0;
+    char* buf;
+    char* hidden;
+    GStringChunk* name_chunk;
+    GPtrArray* names;
+    struct linux_dirent64* d;
+
+    dfd = open( dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( dfd == -1 )
+        return 1;    // same result as a failed g_dir_open
+
+    hidden = gethidden( dir->path );
+    buf = g_malloc( DIR_LOAD_BATCH_SIZE );
+    name_chunk = g_string_chunk_new( DIR_LOAD_BATCH_SIZE );
+    names = g_ptr_array_sized_new( 1024 );
+
+    /* first pass: names only */
+    while ( !vfs_async_task_is_cancelled( dir->task ) &&
+            ( nread = syscall( SYS_getdents64, dfd, buf,
+                                            DIR_LOAD_BATCH_SIZE ) ) > 0 )
+    {
+        n_batches++;
+        for ( pos = 0; pos < nread; pos += d->d_reclen )
+        {
+            d = (struct linux_dirent64*)( buf + pos );
+            if ( d->d_name[0] == '.' && ( d->d_name[1] == '\0' ||
+                        ( d->d_name[1] == '.' && d->d_name[2] == '\0' ) ) )
+                continue;
+
+            //MOD ignore if in .hidden
+            if ( hidden && ishidden( hidden, d->d_name ) )
+            {
+                dir->xhidden_count++;
+                continue;
+            }
+            g_ptr_array_add( names, g_string_chunk_insert( name_chunk,
+                                                           d->d_name ) );
+        }
+    }
+    g_free( buf );
+    g_free( hidden );
+
+    if ( n_batches == 0 && nread == -1 && errno == ENOSYS )
+        n_threads = 0;
+    else
+        /* second pass: stat, mime type and collate keys */
+        n_threads = vfs_dir_load_names_parallel( dir, dfd, names, kf );
+
+    close( dfd );
+    g_ptr_array_free( names, TRUE );
+    g_string_chunk_free( name_chunk );
+    return n_threads;
+}
+
+static gboolean on_vfs_dir_early_listed( VFSDir* dir )
+{
+    /* skipped if the load already finished and emitted "file-listed" */
+    if ( !dir->file_listed )
+    {
+        dir->file_listed = 1;
+        g_signal_emit( dir, signals[FILE_LISTED_SIGNAL], 0, FALSE );
+    }
+    return FALSE;
+}
+
+static gboolean on_vfs_dir_updates_idle( VFSDir* dir )
+{
+    vfs_dir_apply_updates( dir );
+    return FALSE;
+}
+
+/* hand the info loaded for a placeholder to the main thread */
+static void vfs_dir_queue_update( VFSDir* dir, VFSFileInfo* file,
+                                               VFSFileInfo* info )
+{
+    VFSDirUpdate* update = g_slice_new( VFSDirUpdate );
+    update->file = vfs_file_info_ref( file );
+    update->info = info;
+
+    g_mutex_lock( dir->mutex );
+    dir->pending_updates = g_slist_prepend( dir->pending_updates, update );
+    /* all updates queued until the main loop is idle are applied at once */
+    if ( !dir->update_idle )
+        dir->update_idle = g_idle_add( ( GSourceFunc ) on_vfs_dir_updates_idle,
+                                                                        dir );
+    g_mutex_unlock( dir->mutex );
+}
+
+/* Progressive loader: reads all names with getdents64 and publishes them as
+ * placeholders typed by d_type, so "file-listed" is emitted before any file
+ * is stat'ed.  Then stats the files in directory order, except that
+ * placeholders requested by views with vfs_dir_request_file_info are loaded
+ * first, and applies the results in the main thread in batches.
+ * Returns 0 if the syscall is not available, in which case nothing was
+ * loaded. */
+static int vfs_dir_load_progressive( VFSDir* dir )
+{
+    int dfd;
+    long nread = 0, pos;
+    int n_batches = 0;
+    guint i, idx;
+    char* buf;
+    char* hidden;
+    GStringChunk* name_chunk;
+    GPtrArray* names;
+    GPtrArray* files;
+    GList* placeholders = NULL;
+    GList* l;
+    GHashTable* pending;
+    GString* full_path;
+    gsize dir_len;
+    struct stat64 file_stat;
+    struct linux_dirent64* d;
+    VFSFileInfo* file;
+    VFSFileInfo* info;
+    mode_t type;
+
+    dfd = open( dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( dfd == -1 )
+        return 1;    // same result as a failed g_dir_open
+
+    hidden = gethidden( dir->path );
+    buf = g_malloc( DIR_LOAD_BATCH_SIZE );
+    name_chunk = g_string_chunk_new( DIR_LOAD_BATCH_SIZE );
+    names = g_ptr_array_sized_new( 1024 );
+    files = g_ptr_array_sized_new( 1024 );
+
+    /* first phase: names and types only */
+    while ( !vfs_async_task_is_cancelled( dir->task ) &&
+            ( nread = syscall( SYS_getdents64, dfd, buf,
+                                            DIR_LOAD_BATCH_SIZE ) ) > 0 )
+    {
+        n_batches++;
+        for ( pos = 0; pos < nread; pos += d->d_reclen )
+        {
+            d = (struct linux_dirent64*)( buf + pos );
+            if ( d->d_name[0] == '.' && ( d->d_name[1] == '\0' ||
+                        ( d->d_name[1] == '.' && d->d_name[2] == '\0' ) ) )
+                continue;
+
+            //MOD ignore if in .hidden
+            if ( hidden && ishidden( hidden, d->d_name ) )
+            {
+                dir->xhidden_count++;
+                continue;
+            }
+
+            switch ( d->d_type )
+            {
+            case DT_DIR:
+                type = S_IFDIR;
+                break;
+            case DT_REG:
+                type = S_IFREG;
+                break;
+            case DT_LNK:
+                type = S_IFLNK;
+                break;
+            default:
+                type = 0;   // DT_UNKNOWN or special file
+            }
+            file = vfs_file_info_new_placeholder( d->d_name, type );
+            g_ptr_array_add( names, g_string_chunk_insert( name_chunk,
+                                                           d->d_name ) );
+            g_ptr_array_add( files, file );
+            placeholders = g_list_prepend( placeholders,
+                                           vfs_file_info_ref( file ) );
+        }
+    }
+    g_free( buf );
+    g_free( hidden );
+
+    if ( n_batches == 0 && nread == -1 && errno == ENOSYS )
+    {
+        close( dfd );
+        g_ptr_array_free( names, TRUE );
+        g_string_chunk_free( name_chunk );
+        g_ptr_array_free( files, TRUE );
+        return 0;
+    }
+
+    /* publish the placeholders */
+    g_mutex_lock( dir->mutex );
+    for ( l = placeholders; l; l = l->next )
+        vfs_dir_index_add( dir, l );
+    dir->file_list = g_list_concat( placeholders, dir->file_list );
+    dir->n_files += files->len;
+    dir->priority_files = g_queue_new();
+    g_mutex_unlock( dir->mutex );
+    g_idle_add( ( GSourceFunc ) on_vfs_dir_early_listed, dir );
+
+    if ( G_UNLIKELY( dir_load_report ) )
+        printf( "spacefm: progressive loader listed %u names  %s\n",
+                                                    files->len, dir->path );
+
+    /* second phase: stat, mime type and collate keys */
+    pending = g_hash_table_new( g_direct_hash, g_direct_equal );
+    for ( i = 0; i < files->len; i++ )
+        g_hash_table_insert( pending, files->pdata[i], GUINT_TO_POINTER( i + 1 ) );
+
+    full_path = g_string_new( dir->path );
+    if ( full_path->len == 0 || full_path->str[ full_path->len - 1 ] != '/' )
+        g_string_append_c( full_path, '/' );
+    dir_len = full_path->len;
+
+    i = 0;
+    while ( !vfs_async_task_is_cancelled( dir->task ) )
+    {
+        g_mutex_lock( dir->mutex );
+        file = (VFSFileInfo*)g_queue_pop_tail( dir->priority_files );
+        g_mutex_unlock( dir->mutex );
+
+        if ( file )
+        {
+            /* most recently requested first - rows in view while scrolling */
+            idx = GPOINTER_TO_UINT( g_hash_table_lookup( pending, file ) );
+            vfs_file_info_unref( file );
+            if ( !idx )
+                continue;   // already loaded
+            idx--;
+        }
+        else
+        {
+            while ( i < files->len &&
+                    !g_hash_table_lookup( pending, files->pdata[i] ) )
+                i++;
+            if ( i >= files->len )
+                break;
+            idx = i++;
+        }
+        file = (VFSFileInfo*)files->pdata[idx];
+        g_hash_table_remove( pending, file );
+
+        if ( vfs_dir_stat_at( dfd, names->pdata[idx], &file_stat ) == 0 )
+        {
+            g_string_truncate( full_path, dir_len );
+            g_string_append( full_path, names->pdata[idx] );
+            info = vfs_file_info_new();
+            vfs_dir_get_file_info( info, full_path->str,
+                                   names->pdata[idx], &file_stat );
+            /* Special processing for desktop folder */
+            vfs_file_info_load_special_info( info, full_path->str );
+        }
+        else
+            info = NULL;    // file removed since read
+        vfs_dir_queue_update( dir, file, info );
+    }
+
+    g_mutex_lock( dir->mutex );
+    g_queue_foreach( dir->priority_files, ( GFunc ) vfs_file_info_unref, NULL );
+    g_queue_free( dir->priority_files );
+    dir->priority_files = NULL;
+    g_mutex_unlock( dir->mutex );
+
+    close( dfd );
+    g_string_free( full_path, TRUE );
+    g_hash_table_destroy( pending );
+    g_ptr_array_foreach( files, ( GFunc ) vfs_file_info_unref, NULL );
+    g_ptr_array_free( files, TRUE );
+    g_ptr_array_free( names, TRUE );
+    g_string_chunk_free( name_chunk );
+    return 1;
+}
+#else
+static int vfs_dir_load_batch( VFSDir* dir, GKeyFile* kf )
+{
+    return 0;
+}
+
+static int vfs_dir_load_progressive( VFSDir* dir )
+{
+    return 0;
+}
+#endif
+
+/* Apply the file info loaded by the progressive loader and the sniffed
+ * mime types - main thread only */
+void vfs_dir_apply_updates( VFSDir* dir )
+{
+    GSList* updates;
+    GSList* sniffed;
+    GSList* l;
+    VFSDirUpdate* update;
+    VFSDirSniff* sniff;
+    VFSMimeType* old_mime_type;
+
+    g_mutex_lock( dir->mutex );
+    updates = g_slist_reverse( dir->pending_updates );
+    dir->pending_updates = NULL;
+    sniffed = dir->sniffed_files;
+    dir->sniffed_files = NULL;
+    dir->update_idle = 0;
+    g_mutex_unlock( dir->mutex );
+
+    for ( l = sniffed; l; l = l->next )
+    {
+        sniff = (VFSDirSniff*)l->data;
+        /* skip if sniffed meanwhile, or reloaded with changed contents */
+        if ( sniff->file->mime_pending &&
+                        sniff->file->ino == sniff->file_stat.st_ino &&
+                        sniff->file->mtime == sniff->file_stat.st_mtime &&
+                        sniff->file->size == sniff->file_stat.st_size )
+        {
+            sniff->file->mime_pending = FALSE;
+            if ( sniff->mime_type != sniff->file->mime_type )
+            {
+                old_mime_type = sniff->file->mime_type;
+                sniff->file->mime_type = sniff->mime_type;
+                sniff->mime_type = old_mime_type;
+                g_signal_emit( dir, signals[ FILE_CHANGED_SIGNAL ], 0,
+                                                                sniff->file );
+            }
+        }
+        vfs_dir_sniff_free( sniff );
+    }
+    g_slist_free( sniffed );
+
+    for ( l = updates; l; l = l->next )
+    {
+        update = (VFSDirUpdate*)l->data;
+        /* a monitor event may have already reloaded the file */
+        if ( update->file->placeholder )
+        {
+            if ( update->info )
+            {
+                vfs_file_info_take_data( update->file, update->info );
+                g_signal_emit( dir, signals[ FILE_CHANGED_SIGNAL ], 0,
+                                                            update->file );
+            }
+            else if ( update->file->name )
+                vfs_dir_emit_file_deleted( dir, update->file->name,
+                                                            update->file );
+        }
+        if ( update->info )
+            vfs_file_info_unref( update->info );
+        vfs_file_info_unref( update->file );
+        g_slice_free( VFSDirUpdate, update );
+    }
+    g_slist_free( updates );
+}
+
+void vfs_dir_request_file_info( VFSDir* dir, VFSFileInfo* file )
+{
+    if ( !file->placeholder || file->info_requested )
+        return;
+    file->info_requested = TRUE;
+    g_mutex_lock( dir->mutex );
+    if ( dir->priority_files )
+        g_queue_push_tail( dir->priority_files, vfs_file_info_ref( file ) );
+    g_mutex_unlock( dir->mutex );
+}
+
+static void vfs_dir_sniff_free( VFSDirSniff* sniff )
+{
+    vfs_file_info_unref( sniff->file );
+    g_free( sniff->path );
+    if ( sniff->mime_type )
+        vfs_mime_type_unref( sniff->mime_type );
+    g_slice_free( VFSDirSniff, sniff );
+}
+
+static gpointer vfs_dir_sniff_thread( VFSAsyncTask* task, VFSDir* dir )
+{
+    VFSDirSniff* sniff;
+
+    while ( TRUE )
+    {
+        g_mutex_lock( dir->mutex );
+        if ( vfs_async_task_is_cancelled( task ) )
+            sniff = NULL;
+        else
+            /* most recently requested first - rows in view while scrolling */
+            sniff = (VFSDirSniff*)g_queue_pop_tail( dir->sniff_files );
+        if ( !sniff )
+        {
+            /* a request made after this starts a new thread */
+            g_queue_foreach( dir->sniff_files, (GFunc)vfs_dir_sniff_free,
+                                                                    NULL );
+            g_queue_free( dir->sniff_files );
+            dir->sniff_files = NULL;
+        }
+        g_mutex_unlock( dir->mutex );
+        if ( !sniff )
+            break;
+
+        /* Only we have the reference - the file was removed from the dir */
+        if ( g_atomic_int_get( &sniff->file->n_ref ) == 1 )
+        {
+            vfs_dir_sniff_free( sniff );
+            continue;
+        }
+
+        sniff->mime_type = vfs_mime_type_get_from_file( sniff->path, NULL,
+                                                        &sniff->file_stat );
+        g_mutex_lock( dir->mutex );
+        dir->sniffed_files = g_slist_prepend( dir->sniffed_files, sniff );
+        if ( !dir->update_idle )
+            dir->update_idle = g_idle_add( ( GSourceFunc )
+                                            on_vfs_dir_updates_idle, dir );
+        g_mutex_unlock( dir->mutex );
+    }
+    return NULL;
+}
+
+void vfs_dir_request_mime_type( VFSDir* dir, VFSFileInfo* file )
+{
+    VFSDirSniff* sniff;
+    VFSAsyncTask* old_task = NULL;
+
+    if ( !file->mime_pending || file->mime_requested || !file->name )
+        return;
+    file->mime_requested = TRUE;
+
+    sniff = g_slice_new0( VFSDirSniff );
+    sniff->file = vfs_file_info_ref( file );
+    sniff->path = g_build_filename( dir->path, file->name, NULL );
+    vfs_file_info_get_mime_stat( file, &sniff->file_stat );
+
+    g_mutex_lock( dir->mutex );
+    if ( !dir->sniff_files )
+    {
+        /* the previous thread, if any, has finished or is exiting */
+        old_task = dir->sniff_task;
+        dir->sniff_files = g_queue_new();
+        dir->sniff_task = vfs_async_task_new(
+                            (VFSAsyncFunc)vfs_dir_sniff_thread, dir );
+        g_queue_push_tail( dir->sniff_files, sniff );
+        vfs_async_task_execute( dir->sniff_task );
+    }
+    else
+        g_queue_push_tail( dir->sniff_files, sniff );
+    g_mutex_unlock( dir->mutex );
+
+    if ( old_task )
+        g_object_unref( old_task );
+}
+
+void vfs_dir_load_mime_type( VFSDir* dir, VFSFileInfo* file )
+{
+    char* full_path;
+
+    if ( !file->mime_pending || !file->name )
+        return;
+    full_path = g_build_filename( dir->path, file->name, NULL );
+    vfs_file_info_reload_mime_type( file, full_path );
+    g_free( full_path );
+}
+
+void vfs_dir_set_lazy_mime( gboolean lazy )
+{
+    dir_lazy_mime = lazy;
+}
+
+void vfs_dir_set_load_mode( VFSDirLoadMode mode, int threads, gboolean report )
+{
+    dir_load_mode = mode;
+    dir_load_threads = threads;
+    dir_load_report = report;
+}
+
+gpointer vfs_dir_load_thread(  VFSAsyncTask* task, VFSDir* dir )
+{
+    GKeyFile* kf = NULL;
+    GTimer* timer = NULL;
+    int batch = 0;
+    int progressive = 0;
+
     dir->file_listed = 0;
     dir->load_complete = 0;
     dir->xhidden_count = 0;  //MOD
     if ( dir->path )
     {
+        struct stat64 dir_stat;
+        if ( stat64( dir->path, &dir_stat ) == 0 )
+            dir->mtime = dir_stat.st_mtime;
+
         /* Install file alteration monitor */
         dir->monitor = vfs_file_monitor_add_dir( dir->path,
                                              vfs_dir_monitor_callback,
                                              dir );
 
-        dir_content = g_dir_open( dir->path, 0, NULL );
+        if ( G_UNLIKELY( dir_load_report ) )
+            timer = g_timer_new();
 
-        if ( dir_content )
-        {
-            GKeyFile* kf;
+        if( G_UNLIKELY(dir->is_trash) )
+            kf = g_key_file_new();
 
-            if( G_UNLIKELY(dir->is_trash) )
-                kf = g_key_file_new();
+        /* trash and desktop items need their special info before they
+         * are shown, so they are never listed progressively */
+        if ( dir_load_mode == VFS_DIR_LOAD_PROGRESSIVE && !kf &&
+                                                        !dir->is_desktop )
+            progressive = vfs_dir_load_progressive( dir );
+        if ( !progressive && dir_load_mode != VFS_DIR_LOAD_CLASSIC )
+            batch = vfs_dir_load_batch( dir, kf );
+        if ( !progressive && !batch )
+            vfs_dir_load_classic( dir, kf );
 
-            // MOD  dir contains .hidden file?
-            hidden = gethidden( dir->path );
+        if( G_UNLIKELY(dir->is_trash) )
+            g_key_file_free( kf );
 
-            while ( ! vfs_async_task_is_cancelled( dir->task )
-                        && ( file_name = g_dir_read_name( dir_content ) ) )
-            {
-                full_path = g_build_filename( dir->path, file_name, NULL );
-                if ( !full_path )
-                    continue;
+        if ( G_UNLIKELY( timer ) )
+        {
+            gdouble secs = g_timer_elapsed( timer, NULL );
+            printf( "spacefm: %s loader (%d threads) listed %d entries in %.3f s (%.0f entries/s)  %s\n",
+                                    progressive ? "progressive" :
+                                        ( batch ? "batch" : "classic" ),
+                                    batch ? batch : 1,
+                                    dir->n_files, secs,
+                                    secs > 0 ? dir->n_files / secs : 0,
+                                    dir->path );
+            g_timer_destroy( timer );
+        }
+    }
+    return NULL;
+}
 
-                //MOD ignore if in .hidden
-                if ( hidden && ishidden( hidden, file_name ) )
-                {
-                    dir->xhidden_count++;
-                    continue;
-                }
-                /* FIXME: Is locking GDK needed here? */
-                /* GDK_THREADS_ENTER(); */
-                file = vfs_file_info_new();
-                if ( G_LIKELY( vfs_file_info_get( file, full_path, file_name ) ) )
-                {
-                    g_mutex_lock( dir->mutex );
+/* linear lookup used by vfs_dir_find_file before dir->file_index */
+static GList* vfs_dir_find_file_linear( VFSDir* dir, const char* file_name )
+{
+    GList * l;
+    VFSFileInfo* file2;
+    for ( l = dir->file_list; l; l = l->next )
+    {
+        file2 = ( VFSFileInfo* ) l->data;
+        if ( file2->name && 0 == strcmp( file2->name, file_name ) )
+            return l;
+    }
+    return NULL;
+}
 
-                    /* Special processing for desktop folder */
-                    vfs_file_info_load_special_info( file, full_path );
+void vfs_dir_bench_events( int n_files )
+{
+    VFSDir* dir;
+    VFSFileInfo* file;
+    GTimer* timer;
+    GList* l;
+    char name[ 32 ];
+    int i, found;
+    gdouble linear, indexed, update;
 
-                    /* FIXME: load info, too when new file is added to trash dir */
-                    if( G_UNLIKELY( dir->is_trash ) ) /* load info of trashed files */
-                    {
-                        gboolean info_loaded;
-                        char* info = g_strconcat( home_trash_dir, "/info/", file_name, ".trashinfo", NULL );
+    dir = ( VFSDir* ) g_object_new( VFS_TYPE_DIR, NULL );
+    for ( i = 0; i < n_files; i++ )
+    {
+        g_snprintf( name, sizeof( name ), "file-%08d", i );
+        file = vfs_file_info_new();
+        vfs_file_info_set_name( file, name );
+        dir->file_list = g_list_prepend( dir->file_list, file );
+        vfs_dir_index_add( dir, dir->file_list );
+        ++dir->n_files;
+    }
 
-                        info_loaded = g_key_file_load_from_file( kf, info, 0, NULL );
-                        g_free( info );
-                        if( info_loaded )
-                        {
-                            char* ori_path = g_key_file_get_string( kf, "Trash Info", "Path", NULL );
-                            if( ori_path )
-                            {
-                                /* Thanks to the stupid freedesktop.org spec, the filename is encoded
-                                 * like a URL, which is insane. This add nothing more than overhead. */
-                                char* fake_uri = g_strconcat( "file://", ori_path, NULL );
-                                g_free( ori_path );
-                                ori_path = g_filename_from_uri( fake_uri, NULL, NULL );
-                                /* g_debug( ori_path ); */
-
-                                if( file->disp_name && file->disp_name != file->name )
-                                    g_free( file->disp_name );
-                                file->disp_name = g_filename_display_basename( ori_path );
-                                g_free( ori_path );
-                            }
-                        }
-                    }
+    /* a storm of one event per file, half of them for names not yet listed
+     * as for a burst of creations */
+    timer = g_timer_new();
+    for ( i = found = 0; i < n_files; i++ )
+    {
+        g_snprintf( name, sizeof( name ), "file-%08d", i * 2 );
+        if ( vfs_dir_find_file_linear( dir, name ) )
+            found++;
+    }
+    linear = g_timer_elapsed( timer, NULL );
 
-                    dir->file_list = g_list_prepend( dir->file_list, file );
-                    g_mutex_unlock( dir->mutex );
-                    ++dir->n_files;
-                }
-                else
-                {
-                    vfs_file_info_unref( file );
-                }
-                /* GDK_THREADS_LEAVE(); */
-                g_free( full_path );
-            }
-            g_dir_close( dir_content );
-            if ( hidden )
-                g_free( hidden );
+    g_timer_start( timer );
+    for ( i = 0; i < n_files; i++ )
+    {
+        g_snprintf( name, sizeof( name ), "file-%08d", i * 2 );
+        vfs_dir_find_file( dir, name, NULL );
+    }
+    indexed = g_timer_elapsed( timer, NULL );
 
-            if( G_UNLIKELY(dir->is_trash) )
-                g_key_file_free( kf );
+    /* the same storm when each missing name gets added, as done by
+     * update_created_files, then deleted again */
+    g_timer_start( timer );
+    for ( i = 0; i < n_files; i++ )
+    {
+        g_snprintf( name, sizeof( name ), "new-%08d", i );
+        if ( !vfs_dir_find_file( dir, name, NULL ) )
+        {
+            file = vfs_file_info_new();
+            vfs_file_info_set_name( file, name );
+            dir->file_list = g_list_prepend( dir->file_list, file );
+            vfs_dir_index_add( dir, dir->file_list );
+            ++dir->n_files;
         }
     }
-    return NULL;
+    for ( i = 0; i < n_files; i++ )
+    {
+        g_snprintf( name, sizeof( name ), "new-%08d", i );
+        if ( ( l = vfs_dir_find_file( dir, name, NULL ) ) )
+        {
+            vfs_dir_index_remove( dir, l, name );
+            vfs_file_info_unref( (VFSFileInfo*)l->data );
+            dir->file_list = g_list_delete_link( dir->file_list, l );
+            --dir->n_files;
+        }
+    }
+    update = g_timer_elapsed( timer, NULL );
+    g_timer_destroy( timer );
+
+    printf( "spacefm: %d files, %d lookup events (%d hits)\n"
+            "    linear scan   %.3f s (%.0f events/s)\n"
+            "    hash index    %.3f s (%.0f events/s)\n"
+            "    create+delete %.3f s for %d events\n",
+            n_files, n_files, found,
+            linear, linear > 0 ? n_files / linear : 0,
+            indexed, indexed > 0 ? n_files / indexed : 0,
+            update, n_files * 2 );
+    g_object_unref( dir );
 }
 
 gboolean vfs_dir_is_loading( VFSDir* dir )
@@ -800,7 +1984,8 @@ gboolean update_file_info( VFSDir* dir, VFSFileInfo* file )
     full_path = g_build_filename( dir->path, file_name, NULL );
     if ( G_LIKELY( full_path ) )
     {
-        if( G_LIKELY( vfs_file_info_get( file, full_path, file_name ) ) )
+        if( G_LIKELY( vfs_dir_get_file_info( file, full_path, file_name,
+                                                                    NULL ) ) )
         {
             ret = TRUE;
             /* if( G_UNLIKELY(is_desktop) ) */
@@ -809,9 +1994,10 @@ gboolean update_file_info( VFSDir* dir, VFSFileInfo* file )
         else /* The file doesn't exist */
         {
             GList* l;
-            l = g_list_find( dir->file_list, file );
+            l = vfs_dir_find_file_node( dir, file_name, file );
             if( G_UNLIKELY(l) )
             {
+                vfs_dir_index_remove( dir, l, file_name );
                 dir->file_list = g_list_delete_link( dir->file_list, l );
                 --dir->n_files;
                 if ( file )
@@ -865,6 +2051,7 @@ void update_created_files( gpointer key, gpointer data, gpointer user_data )
     if ( dir->created_files )
     {
         g_mutex_lock( dir->mutex );
+        dir->created_files = g_slist_reverse( dir->created_files );
         for ( l = dir->created_files; l; l = l->next )
         {
             if ( !( ll = vfs_dir_find_file( dir, (char*)l->data, NULL ) ) )
@@ -872,12 +2059,13 @@ void update_created_files( gpointer key, gpointer data, gpointer user_data )
                 // file is not in dir file_list
                 full_path = g_build_filename( dir->path, (char*)l->data, NULL );
                 file = vfs_file_info_new();
-                if ( vfs_file_info_get( file, full_path, NULL ) )
+                if ( vfs_dir_get_file_info( file, full_path, NULL, NULL ) )
                 {
                     // add new file to dir file_list
                     vfs_file_info_load_special_info( file, full_path );
                     dir->file_list = g_list_prepend( dir->file_list,
                                                     vfs_file_info_ref( file ) );
+                    vfs_dir_index_add( dir, dir->file_list );
                     ++dir->n_files;
                     g_signal_emit( dir, signals[ FILE_CREATED_SIGNAL ], 0, file );
                 }
@@ -931,19 +2119,31 @@ void vfs_dir_monitor_callback( VFSFileMonitor* fm,
                                gpointer user_data )
 {
     VFSDir* dir = ( VFSDir* ) user_data;
+    struct stat64 dir_stat;
     GDK_THREADS_ENTER();
 
     switch ( event )
     {
     case VFS_FILE_MONITOR_CREATE:
-        vfs_dir_emit_file_created( dir, file_name, FALSE );
-        break;
     case VFS_FILE_MONITOR_DELETE:
-        vfs_dir_emit_file_deleted( dir, file_name, NULL );
+        if ( event == VFS_FILE_MONITOR_CREATE )
+            vfs_dir_emit_file_created( dir, file_name, FALSE );
+        else
+            vfs_dir_emit_file_deleted( dir, file_name, NULL );
+        // the listing follows the dir, so vfs_dir_get_by_path keeps it
+        if ( stat64( dir->path, &dir_stat ) == 0 )
+            dir->mtime = dir_stat.st_mtime;
         break;
     case VFS_FILE_MONITOR_CHANGE:
         vfs_dir_emit_file_changed( dir, file_name, NULL, FALSE );
         break;
+    case VFS_FILE_MONITOR_RESCAN:
+        // events were dropped - hidden dirs are rescanned when shown
+        if ( dir->n_visible )
+            vfs_dir_rescan( dir );
+        else
+            dir->stale = 1;
+        break;
     default:
         g_warning("Error: unrecognized file monitor signal!");
     }
@@ -982,6 +2182,140 @@ static void on_theme_changed( GtkIconTheme *icon_theme, gpointer user_data )
     g_hash_table_foreach( dir_hash, (GHFunc)reload_icons, NULL );
 }
 
+static gboolean vfs_dir_is_idle( VFSDir* dir )
+{
+    // only the cache holds a reference
+    return G_OBJECT( dir )->ref_count == 1;
+}
+
+/* heap memory used by a listing - the file list and its index, the file
+ * info structs, their strings and thumbnails */
+static gsize vfs_dir_get_memory( VFSDir* dir, gsize* struct_bytes,
+                                 gsize* string_bytes, gsize* thumb_bytes )
+{
+    GList* l;
+    VFSFileInfo* file;
+    gsize structs, strings, thumbs;
+
+    *struct_bytes = sizeof( VFSDir );
+    *string_bytes = 0;
+    *thumb_bytes = 0;
+    g_mutex_lock( dir->mutex );
+    for ( l = dir->file_list; l; l = l->next )
+    {
+        file = ( VFSFileInfo* ) l->data;
+        vfs_file_info_get_memory( file, &structs, &strings, &thumbs );
+        /* list node and index entry with its name copy */
+        *struct_bytes += structs + sizeof( GList ) + 3 * sizeof( gpointer );
+        *string_bytes += strings + ( file->name ? strlen( file->name ) + 1 : 0 );
+        *thumb_bytes += thumbs;
+    }
+    g_mutex_unlock( dir->mutex );
+    return *struct_bytes + *string_bytes + *thumb_bytes;
+}
+
+static gsize vfs_dir_get_memory_total( VFSDir* dir )
+{
+    gsize structs, strings, thumbs;
+    return vfs_dir_get_memory( dir, &structs, &strings, &thumbs );
+}
+
+static void add_memory_report( const char* path, VFSDir* dir, GString* report )
+{
+    gsize structs, strings, thumbs, total;
+
+    total = vfs_dir_get_memory( dir, &structs, &strings, &thumbs );
+    g_string_append_printf( report,
+            "%s files=%d structs=%lu strings=%lu thumbnails=%lu total=%lu per_file=%lu%s\n",
+            path, dir->n_files, (unsigned long)structs, (unsigned long)strings,
+            (unsigned long)thumbs, (unsigned long)total,
+            (unsigned long)( dir->n_files ? total / dir->n_files : 0 ),
+            vfs_dir_is_idle( dir ) ? " (cached)" : "" );
+}
+
+char* vfs_dir_get_memory_report()
+{
+    GString* report = g_string_new( "" );
+    if ( dir_hash )
+        g_hash_table_foreach( dir_hash, (GHFunc)add_memory_report, report );
+    return g_string_free( report, FALSE );
+}
+
+static void vfs_dir_cache_forget( VFSDir* dir )
+{
+    if ( dir->cache_bytes )
+    {
+        dir_cache_n_idle--;
+        dir_cache_idle_bytes -= dir->cache_bytes;
+        dir->cache_bytes = 0;
+    }
+}
+
+static void vfs_dir_cache_remove( GList* l )
+{
+    VFSDir* dir = ( VFSDir* ) l->data;
+
+    vfs_dir_cache_forget( dir );
+    g_queue_delete_link( dir_cache, l );
+    g_object_unref( dir );  // finalizes an idle dir
+}
+
+/* drop the least recently used idle dirs beyond the entry and memory limits.
+ * The memory of a listing is measured once when the dir is found idle - an
+ * idle dir only changes by monitor events. */
+static void vfs_dir_cache_trim()
+{
+    GList* l;
+    GList* prev;
+    VFSDir* dir;
+
+    for ( l = dir_cache->head; l; l = l->next )
+    {
+        dir = ( VFSDir* ) l->data;
+        if ( !vfs_dir_is_idle( dir ) )
+            vfs_dir_cache_forget( dir );  // revived
+        else if ( !dir->cache_bytes )
+        {
+            dir->cache_bytes = vfs_dir_get_memory_total( dir );
+            dir_cache_n_idle++;
+            dir_cache_idle_bytes += dir->cache_bytes;
+        }
+    }
+
+    for ( l = dir_cache->tail; l && ( dir_cache_n_idle > DIR_CACHE_MAX_IDLE ||
+                            dir_cache_idle_bytes > DIR_CACHE_MAX_BYTES ); l = prev )
+    {
+        prev = l->prev;
+        if ( ( ( VFSDir* ) l->data )->cache_bytes )
+            vfs_dir_cache_remove( l );
+    }
+}
+
+static void vfs_dir_cache_touch( VFSDir* dir )
+{
+    GList* l;
+
+    if ( G_UNLIKELY( !dir_cache ) )
+        dir_cache = g_queue_new();
+    if ( ( l = g_queue_find( dir_cache, dir ) ) )
+    {
+        g_queue_unlink( dir_cache, l );
+        g_queue_push_head_link( dir_cache, l );
+    }
+    else
+        g_queue_push_head( dir_cache, g_object_ref( dir ) );
+    vfs_dir_cache_trim();
+}
+
+void vfs_dir_get_cache_stats( guint* hits, guint* misses,
+                              guint* n_idle, gsize* idle_bytes )
+{
+    *hits = dir_cache_hits;
+    *misses = dir_cache_misses;
+    *n_idle = dir_cache_n_idle;
+    *idle_bytes = dir_cache_idle_bytes;
+}
+
 VFSDir* vfs_dir_get_by_path_soft( const char* path )
 {
     if ( G_UNLIKELY( !dir_hash || !path ) )
@@ -999,6 +2333,31 @@ VFSDir* vfs_dir_get_by_path( const char* path )
 
     g_return_val_if_fail( G_UNLIKELY(path), NULL );
 
+    if ( dir_hash && ( dir = g_hash_table_lookup( dir_hash, path ) ) )
+    {
+        struct stat64 dir_stat;
+        gboolean changed = dir->stale || stat64( dir->path, &dir_stat ) != 0 ||
+                                            dir_stat.st_mtime != dir->mtime;
+
+        if ( changed && vfs_dir_is_idle( dir ) )
+        {
+            // a released listing is stale (or the dir was replaced and its
+            // monitor lost) - drop it and list again
+            vfs_dir_cache_remove( g_queue_find( dir_cache, dir ) );
+            dir = NULL;
+        }
+        else
+        {
+            // a dir still shown elsewhere is not a cache hit
+            if ( vfs_dir_is_idle( dir ) )
+                dir_cache_hits++;
+            g_object_ref( dir );
+            // changes are not monitored on blacklisted devices so catch up
+            if ( changed || dir->avoid_changes )
+                vfs_dir_rescan( dir );
+        }
+    }
+
     if ( G_UNLIKELY( ! dir_hash ) )
     {
         dir_hash = g_hash_table_new_full( g_str_hash, g_str_equal, NULL, NULL );
@@ -1006,24 +2365,18 @@ VFSDir* vfs_dir_get_by_path( const char* path )
             theme_change_notify = g_signal_connect( gtk_icon_theme_get_default(), "changed",
                                                                         G_CALLBACK( on_theme_changed ), NULL );
     }
-    else
-    {
-        dir = g_hash_table_lookup( dir_hash, path );
-    }
 
     if( G_UNLIKELY( !mime_cb ) )
         mime_cb = vfs_mime_type_add_reload_cb( on_mime_type_reload, NULL );
 
-    if ( dir )
-    {
-        g_object_ref( dir );
-    }
-    else
+    if ( !dir )
     {
         dir = vfs_dir_new( path );
         vfs_dir_load( dir );  /* asynchronous operation */
         g_hash_table_insert( dir_hash, (gpointer)dir->path, (gpointer)dir );
+        dir_cache_misses++;
     }
+    vfs_dir_cache_touch( dir );
     return dir;
 }
 
@@ -1041,7 +2394,10 @@ static void reload_mime_type( char* key, VFSDir* dir, gpointer user_data )
         file = (VFSFileInfo*)l->data;
         full_path = g_build_filename( dir->path,
                                       vfs_file_info_get_name( file ), NULL );
-        vfs_file_info_reload_mime_type( file, full_path );
+        if ( dir_lazy_mime )
+            vfs_file_info_reload_mime_type_lazy( file, full_path );
+        else
+            vfs_file_info_reload_mime_type( file, full_path );
         /* g_debug( "reload %s", full_path ); */
         g_free( full_path );
     }
@@ -40,6 +40,7 @@ struct _VFSDir
     char* disp_path;
     GList* file_list;
     int n_files;
+    GHashTable* file_index;  /* file name -> node in file_list */
 
     union {
         int flags;
@@ -68,6 +69,34 @@ struct _VFSDir
     GSList* changed_files;
     GSList* created_files;  //MOD
     glong xhidden_count;  //MOD
+
+    /* progressive loader: file info loaded by the load thread waiting to be
+     * applied in the main thread, and placeholders requested by views */
+    GSList* pending_updates;
+    GQueue* priority_files;
+    guint update_idle;
+
+    /* deferred mime sniffing: requests waiting for the sniff thread (the
+     * queue only exists while the thread runs) and the sniffed types
+     * waiting to be applied in the main thread with the updates above */
+    GQueue* sniff_files;
+    GSList* sniffed_files;
+    VFSAsyncTask* sniff_task;
+
+    /* rescan thread comparing the listing with the disk, and whether the
+     * dir needs another rescan when it has finished */
+    VFSAsyncTask* rescan_task;
+    guint rescan_again : 1;
+
+    /* the dir missed monitor events while not visible in any view and is
+     * rescanned when it's shown again */
+    guint stale : 1;
+    guint n_visible;
+
+    time_t mtime;  /* mtime of the dir when it was last listed or rescanned,
+                      or when monitor events were applied */
+    gsize cache_bytes;  /* memory of the listing counted by the cache while
+                           the dir is idle, 0 while in use */
 };
 
 struct _VFSDirClass
@@ -84,6 +113,14 @@ struct _VFSDirClass
     /*  void (*update_mime) ( VFSDir* dir ); */
 };
 
+typedef enum
+{
+    VFS_DIR_LOAD_CLASSIC,   /* g_dir_read_name and lstat per entry */
+    VFS_DIR_LOAD_BATCH,     /* getdents64 batches and fstatat/statx */
+    VFS_DIR_LOAD_PROGRESSIVE  /* list names first, emit "file-listed", then
+                                 load file info and emit "file-changed" */
+}VFSDirLoadMode;
+
 typedef void ( *VFSDirStateCallback ) ( VFSDir* dir, int state, gpointer user_data );
 
 GType vfs_dir_get_type ( void );
@@ -91,12 +128,43 @@ GType vfs_dir_get_type ( void );
 VFSDir* vfs_dir_get_by_path( const char* path );
 VFSDir* vfs_dir_get_by_path_soft( const char* path );
 
+/* select the directory loader used by vfs_dir_load_thread;
+ * threads is the number of stat workers used by the batch loader (0 = auto);
+ * if report is TRUE, entries per second are printed for each load */
+void vfs_dir_set_load_mode( VFSDirLoadMode mode, int threads, gboolean report );
+
+/* if lazy (the default), the contents of files are not read to find their
+ * mime type while loading - see vfs_dir_request_mime_type */
+void vfs_dir_set_lazy_mime( gboolean lazy );
+
 gboolean vfs_dir_is_loading( VFSDir* dir );
 void vfs_dir_cancel_load( VFSDir* dir );
 gboolean vfs_dir_is_file_listed( VFSDir* dir );
 
 void vfs_dir_unload_thumbnails( VFSDir* dir, gboolean is_big );
 
+/* load the info of placeholder file before other files still being loaded */
+void vfs_dir_request_file_info( VFSDir* dir, VFSFileInfo* file );
+
+/* Sniff the contents of a file loaded with mime_pending set.  The request
+ * is queued for a worker thread, most recent first, and "file-changed" is
+ * emitted if the type changed.  load sniffs it now without emitting - for
+ * callers which need the type immediately (sorting by type, actions) */
+void vfs_dir_request_mime_type( VFSDir* dir, VFSFileInfo* file );
+void vfs_dir_load_mime_type( VFSDir* dir, VFSFileInfo* file );
+
+/* compare the file list with the contents on disk by name, mtime, size and
+ * inode and emit only the needed created/deleted/changed signals - used by
+ * refresh, after the inotify queue overflowed, and for dirs where change
+ * detection is avoided.  The dir is read in a thread and the signals are
+ * emitted when it has finished.  Returns FALSE if the dir is still loading. */
+gboolean vfs_dir_rescan( VFSDir* dir );
+
+/* a view showing the dir was shown (mapped) or hidden - after the inotify
+ * queue overflowed only visible dirs are rescanned, the others are marked
+ * stale and rescanned when shown or revived from the cache */
+void vfs_dir_set_visible( VFSDir* dir, gboolean visible );
+
 /* emit signals */
 void vfs_dir_emit_file_created( VFSDir* dir, const char* file_name, gboolean force );
 void vfs_dir_emit_file_deleted( VFSDir* dir, const char* file_name, VFSFileInfo* file );
@@ -120,11 +188,25 @@ gboolean vfs_dir_add_hidden( const char* path, const char* file_name );  //MOD a
  */
 const char* vfs_get_trash_dir();
 
+/* Released dirs are kept listed in a small LRU cache and revived by
+ * vfs_dir_get_by_path.  Get the number of dirs found in memory (hits) and
+ * listed from disk (misses), and the number and estimated size of the
+ * idle dirs held only by the cache. */
+void vfs_dir_get_cache_stats( guint* hits, guint* misses,
+                              guint* n_idle, gsize* idle_bytes );
+
+/* one line per VFSDir with the heap memory used by its listing */
+char* vfs_dir_get_memory_report();
+
 /* call function "func" for every VFSDir instances */
 void vfs_dir_foreach( GHFunc func, gpointer user_data );
 
 void vfs_dir_monitor_mime();
 
+/* replay synthetic inotify event storms against an in-memory dir of
+ * n_files files and print the lookup cost (--bench-dir-events) */
+void vfs_dir_bench_events( int n_files );
+
 G_END_DECLS
 
 #endif
@@ -39,6 +39,53 @@ VFSFileInfo* vfs_file_info_new ()
     return fi;
 }
 
+/* Create a placeholder which only knows the name and the file type
+ * reported by readdir.  The mime type is guessed from the name without any
+ * file access, and the rest is loaded later and moved in with
+ * vfs_file_info_take_data() */
+VFSFileInfo* vfs_file_info_new_placeholder( const char* base_name, mode_t type )
+{
+    VFSFileInfo * fi = vfs_file_info_new();
+    fi->name = g_strdup( base_name );
+    if ( G_LIKELY( utf8_file_name && g_utf8_validate ( fi->name, -1, NULL ) ) )
+        fi->disp_name = fi->name;
+    else
+        fi->disp_name = g_filename_display_name( fi->name );
+    fi->mode = type;
+    if ( S_ISDIR( type ) )
+        fi->mime_type = vfs_mime_type_get_from_type( XDG_MIME_TYPE_DIRECTORY );
+    else
+        fi->mime_type = vfs_mime_type_get_from_file_name( fi->disp_name );
+    fi->placeholder = TRUE;
+    return fi;
+}
+
+/* Both sort keys are stored in one allocation, and for names which are
+ * already case folded (most of them) the two keys are the same string */
+static void vfs_file_info_load_collate_keys( VFSFileInfo* fi )
+{
+    char* key = g_utf8_collate_key_for_filename( fi->disp_name, -1 );
+    char* str = g_utf8_casefold( fi->disp_name, -1 );
+    char* icase_key = g_utf8_collate_key_for_filename( str, -1 );
+    gsize len, icase_len;
+
+    g_free( str );
+    if ( !strcmp( key, icase_key ) )
+    {
+        fi->collate_key = fi->collate_icase_key = key;
+        g_free( icase_key );
+        return;
+    }
+    len = strlen( key ) + 1;
+    icase_len = strlen( icase_key ) + 1;
+    fi->collate_key = g_malloc( len + icase_len );
+    memcpy( fi->collate_key, key, len );
+    fi->collate_icase_key = fi->collate_key + len;
+    memcpy( fi->collate_icase_key, icase_key, icase_len );
+    g_free( key );
+    g_free( icase_key );
+}
+
 static void vfs_file_info_clear( VFSFileInfo* fi )
 {
     if ( fi->disp_name && fi->disp_name != fi->name )
@@ -53,12 +100,9 @@ static void vfs_file_info_clear( VFSFileInfo* fi )
     }
     if ( fi->collate_key )  //sfm
     {
+        /* collate_icase_key lives in the same block */
         g_free( fi->collate_key );
         fi->collate_key = NULL;
-    }    
-    if ( fi->collate_icase_key )  //sfm
-    {
-        g_free( fi->collate_icase_key );
         fi->collate_icase_key = NULL;
     }    
     if ( fi->disp_size )
@@ -66,11 +110,7 @@ static void vfs_file_info_clear( VFSFileInfo* fi )
         g_free( fi->disp_size );
         fi->disp_size = NULL;
     }
-    if ( fi->disp_owner )
-    {
-        g_free( fi->disp_owner );
-        fi->disp_owner = NULL;
-    }
+    fi->disp_owner = NULL;  /* interned */
     if ( fi->disp_mtime )
     {
         g_free( fi->disp_mtime );
@@ -95,6 +135,7 @@ static void vfs_file_info_clear( VFSFileInfo* fi )
         fi->mime_type = NULL;
     }
     fi->flags = VFS_FILE_INFO_NONE;
+    fi->mime_pending = fi->mime_requested = FALSE;
 }
 
 VFSFileInfo* vfs_file_info_ref( VFSFileInfo* fi )
@@ -112,53 +153,151 @@ void vfs_file_info_unref( VFSFileInfo* fi )
     }
 }
 
+static gboolean vfs_file_info_load( VFSFileInfo* fi,
+                                    const char* file_path,
+                                    const char* base_name,
+                                    struct stat64* file_stat,
+                                    gboolean lazy_mime );
+
 gboolean vfs_file_info_get( VFSFileInfo* fi,
                             const char* file_path,
                             const char* base_name )
 {
     struct stat64 file_stat;
-    vfs_file_info_clear( fi );
 
+    if ( lstat64( file_path, &file_stat ) == 0 )
+        return vfs_file_info_load( fi, file_path, base_name,
+                                                    &file_stat, FALSE );
+
+    vfs_file_info_clear( fi );
     if ( base_name )
         fi->name = g_strdup( base_name );
     else
         fi->name = g_path_get_basename( file_path );
+    fi->mime_type = vfs_mime_type_get_from_type( XDG_MIME_TYPE_UNKNOWN );
+    return FALSE;
+}
+
+/* Same as vfs_file_info_get() but uses stat info already gathered by the
+ * caller (eg by fstatat in the directory loader) instead of calling lstat */
+gboolean vfs_file_info_get_with_stat( VFSFileInfo* fi,
+                                      const char* file_path,
+                                      const char* base_name,
+                                      struct stat64* file_stat )
+{
+    return vfs_file_info_load( fi, file_path, base_name, file_stat, FALSE );
+}
+
+/* The lazy versions don't read the contents of the file - if the mime type
+ * can't be found from the name, it is unknown and mime_pending is set */
+gboolean vfs_file_info_get_lazy( VFSFileInfo* fi,
+                                 const char* file_path,
+                                 const char* base_name )
+{
+    struct stat64 file_stat;
 
     if ( lstat64( file_path, &file_stat ) == 0 )
-    {
-        /* This is time-consuming but can save much memory */
-        fi->mode = file_stat.st_mode;
-        fi->dev = file_stat.st_dev;
-        fi->uid = file_stat.st_uid;
-        fi->gid = file_stat.st_gid;
-        fi->size = file_stat.st_size;
+        return vfs_file_info_load( fi, file_path, base_name,
+                                                    &file_stat, TRUE );
+    return vfs_file_info_get( fi, file_path, base_name );
+}
+
+gboolean vfs_file_info_get_with_stat_lazy( VFSFileInfo* fi,
+                                           const char* file_path,
+                                           const char* base_name,
+                                           struct stat64* file_stat )
+{
+    return vfs_file_info_load( fi, file_path, base_name, file_stat, TRUE );
+}
+
+static gboolean vfs_file_info_load( VFSFileInfo* fi,
+                                    const char* file_path,
+                                    const char* base_name,
+                                    struct stat64* file_stat,
+                                    gboolean lazy_mime )
+{
+    vfs_file_info_clear( fi );
+
+    if ( base_name )
+        fi->name = g_strdup( base_name );
+    else
+        fi->name = g_path_get_basename( file_path );
+
+    /* This is time-consuming but can save much memory */
+    fi->placeholder = FALSE;
+    fi->mode = file_stat->st_mode;
+    fi->dev = file_stat->st_dev;
+    fi->ino = file_stat->st_ino;
+    fi->uid = file_stat->st_uid;
+    fi->gid = file_stat->st_gid;
+    fi->size = file_stat->st_size;
 //printf("size %s %llu\n", fi->name, fi->size );
-        fi->mtime = file_stat.st_mtime;
-        fi->atime = file_stat.st_atime;
-        fi->blksize = file_stat.st_blksize;
-        fi->blocks = file_stat.st_blocks;
+    fi->mtime = file_stat->st_mtime;
+    fi->ctime_ns = (gint64)file_stat->st_ctim.tv_sec * 1000000000 +
+                                                file_stat->st_ctim.tv_nsec;
+    fi->atime = file_stat->st_atime;
+    fi->blocks = file_stat->st_blocks;
 
-        if ( G_LIKELY( utf8_file_name && g_utf8_validate ( fi->name, -1, NULL ) ) )
-        {
-            fi->disp_name = fi->name;   /* Don't duplicate the name and save memory */
-        }
-        else
+    if ( G_LIKELY( utf8_file_name && g_utf8_validate ( fi->name, -1, NULL ) ) )
+    {
+        fi->disp_name = fi->name;   /* Don't duplicate the name and save memory */
+    }
+    else
+    {
+        fi->disp_name = g_filename_display_name( fi->name );
+    }
+    if ( lazy_mime )
+    {
+        fi->mime_type = vfs_mime_type_get_from_file_lazy( file_path,
+                                                          fi->disp_name,
+                                                          file_stat );
+        if ( !fi->mime_type )
         {
-            fi->disp_name = g_filename_display_name( fi->name );
+            fi->mime_type = vfs_mime_type_get_from_type(
+                                                XDG_MIME_TYPE_UNKNOWN );
+            fi->mime_pending = TRUE;
         }
-        fi->mime_type = vfs_mime_type_get_from_file( file_path,
-                                                     fi->disp_name,
-                                                     &file_stat );
-        //sfm get collate keys
-        fi->collate_key = g_utf8_collate_key_for_filename( fi->disp_name, -1 );
-        char* str = g_utf8_casefold( fi->disp_name, -1 );
-        fi->collate_icase_key = g_utf8_collate_key_for_filename( str, -1 );
-        g_free( str );
-        return TRUE;
     }
     else
-        fi->mime_type = vfs_mime_type_get_from_type( XDG_MIME_TYPE_UNKNOWN );
-    return FALSE;
+        fi->mime_type = vfs_mime_type_get_from_file( file_path,
+                                                     fi->disp_name,
+                                                     file_stat );
+    //sfm get collate keys
+    vfs_file_info_load_collate_keys( fi );
+    return TRUE;
+}
+
+void vfs_file_info_take_data( VFSFileInfo* fi, VFSFileInfo* src )
+{
+    /* n_ref and info_requested of the placeholder are kept */
+    vfs_file_info_clear( fi );
+
+    fi->mode = src->mode;
+    fi->dev = src->dev;
+    fi->ino = src->ino;
+    fi->uid = src->uid;
+    fi->gid = src->gid;
+    fi->size = src->size;
+    fi->mtime = src->mtime;
+    fi->ctime_ns = src->ctime_ns;
+    fi->atime = src->atime;
+    fi->blocks = src->blocks;
+    fi->name = src->name;
+    fi->disp_name = src->disp_name;
+    fi->collate_key = src->collate_key;
+    fi->collate_icase_key = src->collate_icase_key;
+    fi->mime_type = src->mime_type;
+    fi->big_thumbnail = src->big_thumbnail;
+    fi->small_thumbnail = src->small_thumbnail;
+    fi->flags = src->flags;
+    fi->placeholder = FALSE;
+    fi->mime_pending = src->mime_pending;
+
+    /* src no longer owns any data */
+    src->name = src->disp_name = NULL;
+    src->collate_key = src->collate_icase_key = NULL;
+    src->mime_type = NULL;
+    src->big_thumbnail = src->small_thumbnail = NULL;
 }
 
 const char* vfs_file_info_get_name( VFSFileInfo* fi )
@@ -179,11 +318,7 @@ void vfs_file_info_set_disp_name( VFSFileInfo* fi, const char* name )
     fi->disp_name = g_strdup( name );
     //sfm get new collate keys
     g_free( fi->collate_key );
-    g_free( fi->collate_icase_key );
-    fi->collate_key = g_utf8_collate_key_for_filename( fi->disp_name, -1 );
-    char* str = g_utf8_casefold( fi->disp_name, -1 );
-    fi->collate_icase_key = g_utf8_collate_key_for_filename( str, -1 );
-    g_free( str );
+    vfs_file_info_load_collate_keys( fi );
 }
 
 void vfs_file_info_set_name( VFSFileInfo* fi, const char* name )
@@ -219,35 +354,61 @@ VFSMimeType* vfs_file_info_get_mime_type( VFSFileInfo* fi )
     return fi->mime_type;
 }
 
+void vfs_file_info_get_mime_stat( VFSFileInfo* fi, struct stat64* file_stat )
+{
+    /* convert VFSFileInfo to struct stat */
+    /* In current implementation, only st_mode and the fields used to look
+       up sniffed types (dev, ino, mtime, ctime, size) are used in mime-type
+       detection, so let's save some CPU cycles and don't copy unused fields.
+    */
+    file_stat->st_mode = fi->mode;
+    file_stat->st_dev = fi->dev;
+    file_stat->st_ino = fi->ino;
+    file_stat->st_size = fi->size;
+    file_stat->st_mtime = fi->mtime;
+    file_stat->st_ctim.tv_sec = fi->ctime_ns / 1000000000;
+    file_stat->st_ctim.tv_nsec = fi->ctime_ns % 1000000000;
+    /*
+    file_stat->st_uid = fi->uid;
+    file_stat->st_gid = fi->gid;
+    file_stat->st_atime = fi->atime;
+    file_stat->st_blocks = fi->blocks;
+    */
+}
+
 void vfs_file_info_reload_mime_type( VFSFileInfo* fi,
                                      const char* full_path )
 {
     VFSMimeType * old_mime_type;
     struct stat64 file_stat;
 
-    /* convert VFSFileInfo to struct stat */
-    /* In current implementation, only st_mode is used in
-       mime-type detection, so let's save some CPU cycles
-       and don't copy unused fields.
-    */
-    file_stat.st_mode = fi->mode;
-    /*
-    file_stat.st_dev = fi->dev;
-    file_stat.st_uid = fi->uid;
-    file_stat.st_gid = fi->gid;
-    file_stat.st_size = fi->size;
-    file_stat.st_mtime = fi->mtime;
-    file_stat.st_atime = fi->atime;
-    file_stat.st_blksize = fi->blksize;
-    file_stat.st_blocks = fi->blocks;
-    */
+    vfs_file_info_get_mime_stat( fi, &file_stat );
     old_mime_type = fi->mime_type;
     fi->mime_type = vfs_mime_type_get_from_file( full_path,
                                                  fi->name, &file_stat );
+    fi->mime_pending = FALSE;
     vfs_file_info_load_special_info( fi, full_path );
     vfs_mime_type_unref( old_mime_type );  /* FIXME: is vfs_mime_type_unref needed ?*/
 }
 
+void vfs_file_info_reload_mime_type_lazy( VFSFileInfo* fi,
+                                          const char* full_path )
+{
+    VFSMimeType * old_mime_type;
+    struct stat64 file_stat;
+
+    vfs_file_info_get_mime_stat( fi, &file_stat );
+    old_mime_type = fi->mime_type;
+    fi->mime_type = vfs_mime_type_get_from_file_lazy( full_path,
+                                                      fi->name, &file_stat );
+    fi->mime_pending = !fi->mime_type;
+    fi->mime_requested = FALSE;
+    if ( fi->mime_pending )
+        fi->mime_type = vfs_mime_type_get_from_type( XDG_MIME_TYPE_UNKNOWN );
+    vfs_file_info_load_special_info( fi, full_path );
+    vfs_mime_type_unref( old_mime_type );
+}
+
 const char* vfs_file_info_get_mime_type_desc( VFSFileInfo* fi )
 {
     return vfs_mime_type_get_description( fi->mime_type );
@@ -322,6 +483,10 @@ GdkPixbuf* vfs_file_info_get_small_thumbnail( VFSFileInfo* fi )
     return fi->small_thumbnail ? g_object_ref( fi->small_thumbnail ) : NULL;
 }
 
+/* owner:group strings shared by all files, keyed by uid << 32 | gid */
+static GHashTable* owner_names = NULL;
+G_LOCK_DEFINE_STATIC( owner_names );
+
 const char* vfs_file_info_get_disp_owner( VFSFileInfo* fi )
 {
     struct passwd * puser;
@@ -330,10 +495,21 @@ const char* vfs_file_info_get_disp_owner( VFSFileInfo* fi )
     char* user_name;
     char gid_str_buf[ 32 ];
     char* group_name;
+    gint64 id;
+    gint64* key;
+    char* owner;
 
-    /* FIXME: user names should be cached */
     if ( ! fi->disp_owner )
     {
+        id = ( ( gint64 ) fi->uid << 32 ) | ( guint32 ) fi->gid;
+        G_LOCK( owner_names );
+        if ( G_UNLIKELY( !owner_names ) )
+            owner_names = g_hash_table_new( g_int64_hash, g_int64_equal );
+        fi->disp_owner = ( const char* ) g_hash_table_lookup( owner_names, &id );
+        G_UNLOCK( owner_names );
+        if ( fi->disp_owner )
+            return fi->disp_owner;
+
         puser = getpwuid( fi->uid );
         if ( puser && puser->pw_name && *puser->pw_name )
             user_name = puser->pw_name;
@@ -351,7 +527,20 @@ const char* vfs_file_info_get_disp_owner( VFSFileInfo* fi )
             sprintf( gid_str_buf, "%d", fi->gid );
             group_name = gid_str_buf;
         }
-        fi->disp_owner = g_strdup_printf ( "%s:%s", user_name, group_name );
+        owner = g_strdup_printf ( "%s:%s", user_name, group_name );
+
+        G_LOCK( owner_names );
+        fi->disp_owner = ( const char* ) g_hash_table_lookup( owner_names, &id );
+        if ( !fi->disp_owner )
+        {
+            key = g_new( gint64, 1 );
+            *key = id;
+            g_hash_table_insert( owner_names, key, owner );
+            fi->disp_owner = owner;
+        }
+        else
+            g_free( owner );
+        G_UNLOCK( owner_names );
     }
     return fi->disp_owner;
 }
@@ -786,6 +975,26 @@ gboolean vfs_file_info_load_thumbnail( VFSFileInfo* fi,
     return ( thumbnail != NULL );
 }
 
+/* Set the thumbnail only if it's in the memory cache of loaded thumbnails */
+gboolean vfs_file_info_load_cached_thumbnail( VFSFileInfo* fi,
+                                              const char* full_path,
+                                              gboolean big )
+{
+    GdkPixbuf* thumbnail;
+
+    if ( big ? fi->big_thumbnail : fi->small_thumbnail )
+        return TRUE;
+    thumbnail = vfs_thumbnail_get_cached( full_path,
+                    big ? big_thumb_size : small_thumb_size, fi->mtime, FALSE );
+    if ( !thumbnail )
+        return FALSE;
+    if ( big )
+        fi->big_thumbnail = thumbnail;
+    else
+        fi->small_thumbnail = thumbnail;
+    return TRUE;
+}
+
 void vfs_file_info_set_thumbnail_size( int big, int small )
 {
     big_thumb_size = big;
@@ -847,6 +1056,34 @@ void vfs_file_info_list_free( GList* list )
     g_list_free( list );
 }
 
+void vfs_file_info_get_memory( VFSFileInfo* fi, gsize* struct_bytes,
+                               gsize* string_bytes, gsize* thumb_bytes )
+{
+    *struct_bytes = sizeof( VFSFileInfo );
+    *string_bytes = 0;
+    *thumb_bytes = 0;
+    if ( fi->name )
+        *string_bytes += strlen( fi->name ) + 1;
+    if ( fi->disp_name && fi->disp_name != fi->name )
+        *string_bytes += strlen( fi->disp_name ) + 1;
+    if ( fi->collate_key )
+    {
+        *string_bytes += strlen( fi->collate_key ) + 1;
+        if ( fi->collate_icase_key != fi->collate_key )
+            *string_bytes += strlen( fi->collate_icase_key ) + 1;
+    }
+    if ( fi->disp_size )
+        *string_bytes += strlen( fi->disp_size ) + 1;
+    if ( fi->disp_mtime )
+        *string_bytes += strlen( fi->disp_mtime ) + 1;
+    if ( fi->big_thumbnail )
+        *thumb_bytes += gdk_pixbuf_get_rowstride( fi->big_thumbnail ) *
+                                    gdk_pixbuf_get_height( fi->big_thumbnail );
+    if ( fi->small_thumbnail )
+        *thumb_bytes += gdk_pixbuf_get_rowstride( fi->small_thumbnail ) *
+                                    gdk_pixbuf_get_height( fi->small_thumbnail );
+}
+
 
 char* vfs_file_resolve_path( const char* cwd, const char* relative_path )
 {
@@ -48,29 +48,40 @@ struct _VFSFileInfo
 {
     /* struct stat64 file_stat; */
     /* Only use some members of struct stat64 to reduce memory usage */
-    mode_t mode;
     dev_t dev;
+    ino64_t ino;   /* used by vfs_dir_rescan to detect replaced files */
     uid_t uid;
     gid_t gid;
     off64_t size;           //sfm was off_t
     time_t mtime;
     time_t atime;
-    long blksize;  //sfm was long then blksize_t but blksize_t not defined for squeeze gcc
+    gint64 ctime_ns;  /* status change time in ns, validates the sniffed
+                         type memo in mime-type.c */
     blkcnt64_t blocks;      //sfm was blkcnt_t
 
     char* name; /* real name on file system */
     char* disp_name;  /* displayed name (in UTF-8) */
     char* collate_key;  //sfm sort key
-    char* collate_icase_key;  //sfm case folded sort key
-    char* disp_size;  /* displayed human-readable file size */
-    char* disp_owner; /* displayed owner:group pair */
-    char* disp_mtime; /* displayed last modification time */
+    char* collate_icase_key;  //sfm case folded sort key - shares the
+                              // allocation of collate_key, never freed
+    char* disp_size;  /* displayed human-readable file size, made on demand */
+    const char* disp_owner; /* displayed owner:group pair (interned) */
+    char* disp_mtime; /* displayed last modification time, made on demand */
     char disp_perm[ 12 ];  /* displayed permission in string form */
+    mode_t mode;  /* after disp_perm to fill its padding */
     VFSMimeType* mime_type; /* mime type related information */
     GdkPixbuf* big_thumbnail; /* thumbnail of the file */
     GdkPixbuf* small_thumbnail; /* thumbnail of the file */
 
     VFSFileInfoFlag flags; /* if it's a special file */
+    /* placeholder created from readdir only - stat info, mime type and
+     * collate keys are not loaded yet (see VFS_DIR_LOAD_PROGRESSIVE) */
+    guint placeholder : 1;
+    guint info_requested : 1;  /* placeholder was requested by a view */
+    /* loaded lazily - the mime type was guessed without reading the file's
+     * contents, sniffing them is left for vfs_dir_request_mime_type */
+    guint mime_pending : 1;
+    guint mime_requested : 1;
     /*<private>*/
     int n_ref;
 };
@@ -78,12 +89,31 @@ struct _VFSFileInfo
 void vfs_file_info_set_utf8_filename( gboolean is_utf8 );
 
 VFSFileInfo* vfs_file_info_new ();
+VFSFileInfo* vfs_file_info_new_placeholder( const char* base_name,
+                                            mode_t type );
 VFSFileInfo* vfs_file_info_ref( VFSFileInfo* fi );
 void vfs_file_info_unref( VFSFileInfo* fi );
 
 gboolean vfs_file_info_get( VFSFileInfo* fi,
                             const char* file_path,
                             const char* base_name );
+gboolean vfs_file_info_get_with_stat( VFSFileInfo* fi,
+                                      const char* file_path,
+                                      const char* base_name,
+                                      struct stat64* file_stat );
+
+/* lazy versions: the contents of the file are not read to find its mime
+ * type - if the name isn't enough it's unknown and mime_pending is set */
+gboolean vfs_file_info_get_lazy( VFSFileInfo* fi,
+                                 const char* file_path,
+                                 const char* base_name );
+gboolean vfs_file_info_get_with_stat_lazy( VFSFileInfo* fi,
+                                           const char* file_path,
+                                           const char* base_name,
+                                           struct stat64* file_stat );
+
+/* move the loaded info of src into placeholder fi */
+void vfs_file_info_take_data( VFSFileInfo* fi, VFSFileInfo* src );
 
 const char* vfs_file_info_get_name( VFSFileInfo* fi );
 const char* vfs_file_info_get_disp_name( VFSFileInfo* fi );
@@ -101,6 +131,10 @@ mode_t vfs_file_info_get_mode( VFSFileInfo* fi );
 VFSMimeType* vfs_file_info_get_mime_type( VFSFileInfo* fi );
 void vfs_file_info_reload_mime_type( VFSFileInfo* fi,
                                      const char* full_path );
+void vfs_file_info_reload_mime_type_lazy( VFSFileInfo* fi,
+                                          const char* full_path );
+/* the stat info of fi used by mime_type_get_by_file() */
+void vfs_file_info_get_mime_stat( VFSFileInfo* fi, struct stat64* file_stat );
 
 const char* vfs_file_info_get_mime_type_desc( VFSFileInfo* fi );
 
@@ -115,6 +149,9 @@ void vfs_file_info_set_thumbnail_size( int big, int small );
 gboolean vfs_file_info_load_thumbnail( VFSFileInfo* fi,
                                        const char* full_path,
                                        gboolean big );
+gboolean vfs_file_info_load_cached_thumbnail( VFSFileInfo* fi,
+                                              const char* full_path,
+                                              gboolean big );
 gboolean vfs_file_info_is_thumbnail_loaded( VFSFileInfo* fi,
                                             gboolean big );
 
@@ -159,6 +196,10 @@ void vfs_file_info_load_special_info( VFSFileInfo* fi,
 
 void vfs_file_info_list_free( GList* list );
 
+/* heap memory used by fi: struct, strings and thumbnails */
+void vfs_file_info_get_memory( VFSFileInfo* fi, gsize* struct_bytes,
+                               gsize* string_bytes, gsize* thumb_bytes );
+
 /* resolve file path name */
 char* vfs_file_resolve_path( const char* cwd, const char* relative_path );
 
@@ -38,7 +38,30 @@ typedef struct
 }
 VFSFileMonitorCallbackEntry;
 
+/* a coalesced event waiting in VFSFileMonitor::pending */
+typedef struct
+{
+    char* name;
+    VFSFileMonitorEvent event;
+}
+VFSFileMonitorPending;
+
+/* pending events are flushed after MONITOR_FLUSH_MIN ms while events are
+ * rare, stretching to MONITOR_FLUSH_MAX ms at MONITOR_STORM_RATE events/s */
+#define MONITOR_FLUSH_MIN   20
+#define MONITOR_FLUSH_MAX   500
+#define MONITOR_STORM_RATE  1000.0
+
 static GHashTable* monitor_hash = NULL;
+#ifdef USE_INOTIFY
+static GHashTable* wd_hash = NULL;  /* wd -> monitor */
+#endif
+static GSList* pending_monitors = NULL;  /* monitors with pending events */
+static guint flush_timeout = 0;
+static guint flush_delay = 0;
+static guint n_events = 0;  /* raw events received since the last flush */
+static gdouble event_rate = 0;  /* smoothed events per second */
+static GTimer* rate_timer = NULL;  /* time since the last flush */
 static GIOChannel* fam_io_channel = NULL;
 static guint fam_io_watch = 0;
 #ifdef USE_INOTIFY
@@ -127,6 +150,23 @@ void vfs_file_monitor_clean()
         g_hash_table_destroy( monitor_hash );
         monitor_hash = NULL;
     }
+#ifdef USE_INOTIFY
+    if ( wd_hash )
+    {
+        g_hash_table_destroy( wd_hash );
+        wd_hash = NULL;
+    }
+#endif
+    if ( flush_timeout )
+    {
+        g_source_remove( flush_timeout );
+        flush_timeout = 0;
+    }
+    if ( rate_timer )
+    {
+        g_timer_destroy( rate_timer );
+        rate_timer = NULL;
+    }
 }
 
 /*
@@ -136,6 +176,10 @@ void vfs_file_monitor_clean()
 gboolean vfs_file_monitor_init()
 {
     monitor_hash = g_hash_table_new( g_str_hash, g_str_equal );
+#ifdef USE_INOTIFY
+    wd_hash = g_hash_table_new( g_direct_hash, g_direct_equal );
+#endif
+    rate_timer = g_timer_new();
     if ( ! connect_to_fam() )
         return FALSE;
     return TRUE;
@@ -241,6 +285,7 @@ VFSFileMonitor* vfs_file_monitor_add( char* path,
                         real_path, path, errno, msg );
             return NULL;
         }
+        g_hash_table_insert( wd_hash, GINT_TO_POINTER( monitor->wd ), monitor );
 //printf("vfs_file_monitor_add  %s (%s) %d\n", real_path, path, monitor->wd );
 
 #else /* Use FAM|gamin */
@@ -285,6 +330,23 @@ VFSFileMonitor* vfs_file_monitor_add( char* path,
     return monitor;
 }
 
+static void free_pending( VFSFileMonitor* fm )
+{
+    VFSFileMonitorPending* p;
+
+    if ( !fm->pending )
+        return;
+    while ( ( p = ( VFSFileMonitorPending* ) g_queue_pop_head( fm->pending_order ) ) )
+    {
+        g_free( p->name );
+        g_slice_free( VFSFileMonitorPending, p );
+    }
+    g_queue_free( fm->pending_order );
+    g_hash_table_destroy( fm->pending );
+    fm->pending = NULL;
+    fm->pending_order = NULL;
+}
+
 void vfs_file_monitor_remove( VFSFileMonitor * fm,
                               VFSFileMonitorCallback cb,
                               gpointer user_data )
@@ -311,6 +373,8 @@ void vfs_file_monitor_remove( VFSFileMonitor * fm,
 #ifdef USE_INOTIFY /* Linux inotify */
 //printf( "vfs_file_monitor_remove  %d\n", fm->wd );
         inotify_rm_watch ( inotify_fd, fm->wd );
+        if ( g_hash_table_lookup( wd_hash, GINT_TO_POINTER( fm->wd ) ) == fm )
+            g_hash_table_remove( wd_hash, GINT_TO_POINTER( fm->wd ) );
 #else /*  Use FAM|gamin */
         if ( fam_io_channel )
             FAMCancelMonitor( &fam, &fm->request );
@@ -318,6 +382,11 @@ void vfs_file_monitor_remove( VFSFileMonitor * fm,
             g_warning( "FAM/gamin server is not running ?" );
 #endif
 
+        if ( fm->pending )
+        {
+            pending_monitors = g_slist_remove( pending_monitors, fm );
+            free_pending( fm );
+        }
         g_hash_table_remove( monitor_hash, fm->path );
         g_free( fm->path );
         g_array_free( fm->callbacks, TRUE );
@@ -351,6 +420,7 @@ static void reconnect_fam( gpointer key,
                         g_strerror ( errno ) );
             return ;
         }
+        g_hash_table_insert( wd_hash, GINT_TO_POINTER( monitor->wd ), monitor );
 #else
         if ( S_ISDIR( file_stat.st_mode ) )
         {
@@ -372,15 +442,6 @@ static void reconnect_fam( gpointer key,
 }
 
 #ifdef USE_INOTIFY
-static gboolean find_monitor( gpointer key,
-                              gpointer value,
-                              gpointer user_data )
-{
-    int wd = GPOINTER_TO_INT( user_data );
-    VFSFileMonitor* monitor = ( VFSFileMonitor* ) value;
-    return ( monitor->wd == wd );
-}
-
 static VFSFileMonitorEvent translate_inotify_event( int inotify_mask )
 {
     if ( inotify_mask & ( IN_CREATE | IN_MOVED_TO ) )
@@ -417,6 +478,119 @@ static void dispatch_event( VFSFileMonitor * monitor,
     }
 }
 
+guint vfs_file_monitor_get_delay( guint min_ms, guint max_ms )
+{
+    gdouble load = event_rate / MONITOR_STORM_RATE;
+
+    if ( load > 1 )
+        load = 1;
+    return min_ms + ( guint ) ( ( max_ms - min_ms ) * load );
+}
+
+static gboolean on_flush_events( gpointer user_data )
+{
+    GSList* monitors;
+    GSList* l;
+    VFSFileMonitor* monitor;
+    VFSFileMonitorPending* p;
+    GHashTable* pending;
+    GQueue* pending_order;
+
+    /* update the event rate from the events seen in this window */
+    event_rate = ( event_rate +
+                   n_events * 1000.0 / ( flush_delay ? flush_delay : 1 ) ) / 2;
+    n_events = 0;
+    flush_timeout = 0;
+    g_timer_start( rate_timer );
+
+    monitors = pending_monitors;
+    pending_monitors = NULL;
+
+    /* a callback may remove any monitor, so hold them all while dispatching */
+    for ( l = monitors; l; l = l->next )
+        g_atomic_int_inc( &( ( VFSFileMonitor* ) l->data )->n_ref );
+
+    for ( l = monitors; l; l = l->next )
+    {
+        monitor = ( VFSFileMonitor* ) l->data;
+        pending = monitor->pending;
+        pending_order = monitor->pending_order;
+        monitor->pending = NULL;
+        monitor->pending_order = NULL;
+        if ( pending_order )
+        {
+            while ( ( p = ( VFSFileMonitorPending* ) g_queue_pop_head( pending_order ) ) )
+            {
+                dispatch_event( monitor, p->event, p->name );
+                g_free( p->name );
+                g_slice_free( VFSFileMonitorPending, p );
+            }
+            g_queue_free( pending_order );
+            g_hash_table_destroy( pending );
+        }
+    }
+
+    for ( l = monitors; l; l = l->next )
+        vfs_file_monitor_remove( ( VFSFileMonitor* ) l->data, NULL, NULL );
+    g_slist_free( monitors );
+    return FALSE;
+}
+
+/* Queue an event for dispatch by on_flush_events.  Events on the same file
+ * name are merged so a burst like create->modify->modify->close costs one
+ * callback: the latest event wins, except that a change of a file created in
+ * the same window is still reported as a create. */
+static void queue_event( VFSFileMonitor* monitor,
+                         VFSFileMonitorEvent evt,
+                         const char* file_name )
+{
+    VFSFileMonitorPending* p;
+
+    n_events++;
+    if ( !monitor->pending )
+    {
+        monitor->pending = g_hash_table_new( g_str_hash, g_str_equal );
+        monitor->pending_order = g_queue_new();
+        pending_monitors = g_slist_prepend( pending_monitors, monitor );
+    }
+
+    p = ( VFSFileMonitorPending* ) g_hash_table_lookup( monitor->pending,
+                                                         file_name );
+    if ( p )
+    {
+        if ( evt != VFS_FILE_MONITOR_CHANGE || p->event != VFS_FILE_MONITOR_CREATE )
+            p->event = evt;
+    }
+    else
+    {
+        p = g_slice_new( VFSFileMonitorPending );
+        p->name = g_strdup( file_name );
+        p->event = evt;
+        g_hash_table_insert( monitor->pending, p->name, p );
+        g_queue_push_tail( monitor->pending_order, p );
+    }
+
+    if ( !flush_timeout )
+    {
+        /* a quiet second resets the rate so the first event is fast again */
+        if ( g_timer_elapsed( rate_timer, NULL ) > 1.0 )
+            event_rate = 0;
+        flush_delay = vfs_file_monitor_get_delay( MONITOR_FLUSH_MIN,
+                                                  MONITOR_FLUSH_MAX );
+        flush_timeout = g_timeout_add( flush_delay, on_flush_events, NULL );
+    }
+}
+
+#ifdef USE_INOTIFY
+static void queue_rescan( gpointer key,
+                          gpointer value,
+                          gpointer user_data )
+{
+    VFSFileMonitor* monitor = ( VFSFileMonitor* ) value;
+    queue_event( monitor, VFS_FILE_MONITOR_RESCAN, monitor->path );
+}
+#endif
+
 /* event handler of all FAM events */
 static gboolean on_fam_event( GIOChannel * channel,
                               GIOCondition cond,
@@ -443,8 +617,13 @@ static gboolean on_fam_event( GIOChannel * channel,
               So we have to reconnect to FAM server.
             */
             if ( connect_to_fam() )
+            {
+#ifdef USE_INOTIFY
+                g_hash_table_remove_all( wd_hash );
+#endif
                 g_hash_table_foreach( monitor_hash, ( GHFunc ) reconnect_fam,
                                                                         NULL );
+            }
         }
         return TRUE; /* don't need to remove the event source since
                                     it has been removed by disconnect_from_fam(). */
@@ -474,12 +653,19 @@ static gboolean on_fam_event( GIOChannel * channel,
     while ( i < len )
     {
         struct inotify_event * ievent = ( struct inotify_event * ) & buf [ i ];
+        if ( G_UNLIKELY( ievent->mask & IN_Q_OVERFLOW ) )
+        {
+            /* the kernel queue overflowed and events were dropped - every
+             * monitored dir has to be compared against the disk again */
+            g_warning( "inotify event queue overflow - rescanning" );
+            g_hash_table_foreach( monitor_hash, queue_rescan, NULL );
+            i += sizeof ( struct inotify_event ) + ievent->len;
+            continue;
+        }
         /* FIXME: 2 different paths can have the same wd because of link
          *        This was fixed in spacefm 0.8.7 ?? */
-        monitor = ( VFSFileMonitor* ) g_hash_table_find(
-                      monitor_hash,
-                      find_monitor,
-                      GINT_TO_POINTER( ievent->wd ) );
+        monitor = ( VFSFileMonitor* ) g_hash_table_lookup( wd_hash,
+                                                GINT_TO_POINTER( ievent->wd ) );
         if( G_LIKELY(monitor) )
         {
             const char* file_name;
@@ -503,9 +689,9 @@ else
     printf("inotify-event %s: %s///%s\n", desc, monitor->path, file_name);
 //g_debug("inotify (%d) :%s", ievent->mask, file_name);
 */
-            dispatch_event( monitor,
-                            translate_inotify_event( ievent->mask ),
-                            file_name );
+            queue_event( monitor,
+                         translate_inotify_event( ievent->mask ),
+                         file_name );
         }
         i += sizeof ( struct inotify_event ) + ievent->len;
     }
@@ -526,7 +712,7 @@ else
                 */
                 /* g_debug("FAM event(%d): %s", evt.code, evt.filename); */
                 /* Call the callback functions */
-                dispatch_event( monitor, evt.code, evt.filename );
+                queue_event( monitor, evt.code, evt.filename );
                 break;
                 /* Other events are not supported */
             default:
@@ -38,13 +38,15 @@ G_BEGIN_DECLS
 typedef enum{
   VFS_FILE_MONITOR_CREATE,
   VFS_FILE_MONITOR_DELETE,
-  VFS_FILE_MONITOR_CHANGE
+  VFS_FILE_MONITOR_CHANGE,
+  VFS_FILE_MONITOR_RESCAN   /* events were lost, file_name is the path */
 }VFSFileMonitorEvent;
 #else
 typedef enum{
   VFS_FILE_MONITOR_CREATE = FAMCreated,
   VFS_FILE_MONITOR_DELETE = FAMDeleted,
-  VFS_FILE_MONITOR_CHANGE = FAMChanged
+  VFS_FILE_MONITOR_CHANGE = FAMChanged,
+  VFS_FILE_MONITOR_RESCAN = 100
 }VFSFileMonitorEvent;
 #endif
 
@@ -60,12 +62,16 @@ struct _VFSFileMonitor{
   FAMRequest request;
 #endif
   GArray* callbacks;
+  GHashTable* pending;     /* coalesced events waiting for dispatch */
+  GQueue* pending_order;
 };
 
 /* Callback function which will be called when monitored events happen
  *  NOTE: GDK_THREADS_ENTER and GDK_THREADS_LEAVE might be needed
  *  if gtk+ APIs are called in this callback, since the callback is called from
- *  IO channel handler.
+ *  a timeout handler.
+ *  Events are coalesced per file name before they are dispatched, so
+ *  create->modify->modify is reported as a single create.
  */
 typedef void (*VFSFileMonitorCallback)( VFSFileMonitor* fm,
                                         VFSFileMonitorEvent event,
@@ -120,6 +126,12 @@ void vfs_file_monitor_remove( VFSFileMonitor* fm,
                               VFSFileMonitorCallback cb,
                               gpointer user_data );
 
+/*
+ * Get a delay for processing file events, from min_ms while events are
+ * rare up to max_ms during a storm of events.
+ */
+guint vfs_file_monitor_get_delay( guint min_ms, guint max_ms );
+
 /*
  * Clearn up and shutdown file alteration monitor.
  */
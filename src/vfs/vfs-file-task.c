@@ -17,9 +17,19 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <utime.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#ifndef FICLONE
+#define FICLONE _IOW( 0x94, 9, int )
+#endif
+#endif
 
 #include <glib.h>
 #include "glib-mem.h"
@@ -30,6 +40,7 @@
 #include <stdlib.h> /* for mkstemp, realpath */
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "vfs-dir.h"
 #include "settings.h"
@@ -47,18 +58,20 @@ const mode_t chmod_flags[] =
     };
 
 /*
-* void get_total_size_of_dir( const char* path, off_t* size )
-* Recursively count total size of all files in the specified directory.
-* If the path specified is a file, the size of the file is directly returned.
-* cancel is used to cancel the operation. This function will check the value
-* pointed by cancel in every iteration. If cancel is set to TRUE, the
-* calculation is cancelled.
-* NOTE: *size should be set to zero before calling this function.
+* void get_total_size_of_dir( VFSFileTask* task, const char* path,
+*                             struct stat64* have_stat, guint32 node )
+* Recursively add the size of all files in the specified directory to
+* task->total_size, and count them in task->total_items.
+* If the path specified is a file, the size of the file is directly added.
+* If node is the plan record of path, the listing of each dir is recorded.
+* This function checks task->size_cancel in every iteration. If it is set
+* to TRUE, the calculation is cancelled.
 */
 static void get_total_size_of_dir( VFSFileTask* task,
                                    const char* path,
-                                   off_t* size,
-                                   struct stat64* have_stat );
+                                   struct stat64* have_stat,
+                                   guint32 node );
+static void add_total( VFSFileTask* task, off64_t size );
 void vfs_file_task_error( VFSFileTask* task, int errnox, const char* action,
                                                             const char* target );
 void vfs_file_task_exec_error( VFSFileTask* task, int errnox, char* action );
@@ -105,11 +118,8 @@ static gboolean should_abort( VFSFileTask* task )
         // paused or queued - suspend thread
         g_mutex_lock( task->mutex );
         g_timer_stop( task->timer );
-        task->pause_cond = g_cond_new();
         g_cond_wait( task->pause_cond, task->mutex );
         // resume
-        g_cond_free( task->pause_cond );
-        task->pause_cond = NULL;
         task->last_elapsed = g_timer_elapsed( task->timer, NULL );
         task->last_progress = task->progress;
         task->last_speed = 0;
@@ -120,6 +130,20 @@ static gboolean should_abort( VFSFileTask* task )
     return task->abort;
 }
 
+/* Pool workers sleep while the task is paused - the task thread does the
+ * pausing itself in should_abort() */
+static gboolean worker_should_abort( VFSFileTask* task )
+{
+    if ( task->state_pause != VFS_FILE_TASK_RUNNING && !task->abort )
+    {
+        g_mutex_lock( task->mutex );
+        while ( task->state_pause != VFS_FILE_TASK_RUNNING && !task->abort )
+            g_cond_wait( task->pause_cond, task->mutex );
+        g_mutex_unlock( task->mutex );
+    }
+    return task->abort;
+}
+
 char* vfs_file_task_get_unique_name( const char* dest_dir, const char* base_name,
                                                            const char* ext )
 {   // returns NULL if all names used; otherwise newly allocated string
@@ -327,6 +351,26 @@ void update_file_display( const char* path )
     GDK_THREADS_LEAVE();
 }
 
+static void update_file_deleted( const char* path )
+{
+    // for devices like nfs, show the removal without waiting for the
+    // file monitor
+    GDK_THREADS_ENTER();
+    char* dir_path = g_path_get_dirname( path );
+    VFSDir* vdir = vfs_dir_get_by_path_soft( dir_path );
+    g_free( dir_path );
+    if ( vdir && vdir->avoid_changes )
+    {
+        char* filename = g_path_get_basename( path );
+        vfs_dir_emit_file_deleted( vdir, filename, NULL );
+        g_free( filename );
+        vfs_dir_flush_notify_cache();
+    }
+    if ( vdir )
+        g_object_unref( vdir );
+    GDK_THREADS_LEAVE();
+}
+
 /*
 void update_file_display( const char* path )
 {
@@ -347,12 +391,765 @@ void update_file_display( const char* path )
 }
 */
 
+static gboolean copy_should_abort( VFSFileTask* task );
+
+/* task->progress is added to without task->mutex, by the copy loops */
+static void add_progress( VFSFileTask* task, off64_t bytes )
+{
+    __sync_fetch_and_add( &task->progress, bytes );
+}
+
+/* The ways of copying file data, fastest first */
+enum
+{
+    COPY_REFLINK,       /* share the extents (btrfs, xfs) */
+    COPY_FILE_RANGE,    /* copy in the kernel, or on the server (nfs 4.2) */
+    COPY_SENDFILE,      /* copy in the kernel between page caches */
+    COPY_READ_WRITE,
+    N_COPY_METHODS
+};
+
+static const char* copy_method_names[ N_COPY_METHODS ] =
+                    { "reflink", "copy_file_range", "sendfile", "read/write" };
+
+#define COPY_CHUNK_SIZE ( 8 * 1024 * 1024 )    /* between abort checks */
+#define COPY_BUFFER_SIZE ( 1024 * 1024 )
+
+/* errno of a method not supported for these files */
+static gboolean copy_unsupported( int errnox )
+{
+    return errnox == ENOSYS || errnox == EXDEV || errnox == EINVAL ||
+           errnox == EOPNOTSUPP;
+}
+
+/* errno of copy_file_range or sendfile caused by the destination - the
+ * others, like EIO, are the source's */
+static gboolean copy_dest_error( int errnox )
+{
+    return errnox == ENOSPC || errnox == EDQUOT || errnox == EFBIG ||
+           errnox == EROFS || errnox == ETXTBSY;
+}
+
+/* Copy the data of rfd to wfd, starting with *method and falling back to
+ * the next one if it's unsupported, which is left in *method.  Returns
+ * FALSE on abort or error, which is reported */
+static gboolean copy_file_data( VFSFileTask* task, int rfd, int wfd,
+                                int* method,
+                                const char* src_file, const char* dest_file )
+{
+    ssize_t rsize, wsize, done;
+    char* buffer;
+
+#ifdef __linux__
+    off64_t copied = 0;
+    gboolean read_as_empty = FALSE;
+
+    posix_fadvise( rfd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    if ( *method == COPY_REFLINK )
+    {
+        struct stat64 file_stat;
+        if ( ioctl( wfd, FICLONE, rfd ) == 0 )
+        {
+            if ( fstat64( rfd, &file_stat ) == 0 )
+                add_progress( task, file_stat.st_size );
+            return TRUE;
+        }
+        *method = COPY_FILE_RANGE;
+    }
+#ifdef __NR_copy_file_range
+    if ( *method == COPY_FILE_RANGE )
+    {
+        while ( ( rsize = syscall( __NR_copy_file_range, rfd, NULL, wfd, NULL,
+                                                COPY_CHUNK_SIZE, 0 ) ) > 0 )
+        {
+            copied += rsize;
+            add_progress( task, rsize );
+            if ( copy_should_abort( task ) )
+                return FALSE;
+        }
+        if ( rsize == 0 && copied > 0 )
+            return TRUE;
+        /* procfs, sysfs and some FUSE files read as empty here - leave
+         * those, and files which are empty, to read() */
+        if ( rsize == 0 )
+            read_as_empty = TRUE;
+        else if ( !copy_unsupported( errno ) )
+            goto _copy_error;
+        /* continue from where the copy stopped */
+    }
+#endif
+    if ( *method <= COPY_SENDFILE && !read_as_empty )
+    {
+        *method = COPY_SENDFILE;
+        while ( ( rsize = sendfile64( wfd, rfd, NULL, COPY_CHUNK_SIZE ) ) > 0 )
+        {
+            copied += rsize;
+            add_progress( task, rsize );
+            if ( copy_should_abort( task ) )
+                return FALSE;
+        }
+        if ( rsize == 0 && copied > 0 )
+            return TRUE;
+        if ( rsize == 0 )
+            read_as_empty = TRUE;
+        else if ( !copy_unsupported( errno ) )
+            goto _copy_error;
+    }
+    /* the faster method still suits the next file */
+    if ( !read_as_empty )
+        *method = COPY_READ_WRITE;
+#else
+    *method = COPY_READ_WRITE;
+#endif
+
+    if ( posix_memalign( (void**)&buffer, 4096, COPY_BUFFER_SIZE ) != 0 )
+    {
+        vfs_file_task_error( task, ENOMEM, _("Writing"), dest_file );
+        return FALSE;
+    }
+    while ( ( rsize = read( rfd, buffer, COPY_BUFFER_SIZE ) ) > 0 )
+    {
+        for ( done = 0; done < rsize; done += wsize )
+        {
+            if ( ( wsize = write( wfd, buffer + done, rsize - done ) ) <= 0 )
+            {
+                free( buffer );
+                vfs_file_task_error( task, wsize ? errno : ENOSPC,
+                                                    _("Writing"), dest_file );
+                return FALSE;
+            }
+        }
+        add_progress( task, rsize );
+        if ( copy_should_abort( task ) )
+        {
+            free( buffer );
+            return FALSE;
+        }
+    }
+    free( buffer );
+    if ( rsize == 0 )
+        return TRUE;
+    vfs_file_task_error( task, errno, _("Accessing"), src_file );
+    return FALSE;
+
+#ifdef __linux__
+_copy_error:
+    if ( copy_dest_error( errno ) )
+        vfs_file_task_error( task, errno, _("Writing"), dest_file );
+    else
+        vfs_file_task_error( task, errno, _("Accessing"), src_file );
+    return FALSE;
+#endif
+}
+
+/* Pipelined copying: the task thread walks the tree, creating dirs and
+ * settling overwrites as before, and queues the files with their source
+ * opened for a pool of workers, which copy their data and metadata.  Dir
+ * metadata is applied when the files in them are done. */
+#define COPY_QUEUE_MAX 64
+
+static int copy_threads = 4;
+
+typedef struct
+{
+    int rfd;
+    char* src_file;
+    char* dest_file;
+    struct stat64 file_stat;
+} CopyItem;
+
+typedef struct
+{
+    char* path;
+    mode_t mode;
+    time_t atime;
+    time_t mtime;
+} CopyDir;
+
+typedef struct
+{
+    VFSFileTask* task;
+    GThread* walker;
+    GThread** workers;
+    int n_workers;
+    GMutex* mutex;
+    GCond* cond;            /* an item was queued, taken or done */
+    GQueue* queue;
+    GHashTable* busy_dests; /* dest_file of items queued or being copied */
+    int n_busy;
+    gboolean walk_done;
+    GSList* dirs;
+} CopyPool;
+
+static gboolean copy_should_abort( VFSFileTask* task )
+{
+    CopyPool* pool = (CopyPool*)task->copy_pool;
+
+    if ( !pool || g_thread_self() == pool->walker )
+        return should_abort( task );
+    return worker_should_abort( task );
+}
+
+/* Wait for the workers with pool->mutex held, pausing if the user asks */
+static void copy_pool_wait( CopyPool* pool )
+{
+    GTimeVal until;
+
+    g_get_current_time( &until );
+    g_time_val_add( &until, 100000 );
+    g_cond_timed_wait( pool->cond, pool->mutex, &until );
+    if ( pool->task->state_pause != VFS_FILE_TASK_RUNNING )
+    {
+        g_mutex_unlock( pool->mutex );
+        should_abort( pool->task );
+        g_mutex_lock( pool->mutex );
+    }
+}
+
+static void copy_item( CopyPool* pool, CopyItem* item )
+{
+    VFSFileTask* task = pool->task;
+    struct utimbuf times;
+    int wfd, copy_method;
+    gboolean copy_fail = FALSE;
+
+    if ( ( wfd = creat( item->dest_file,
+                        item->file_stat.st_mode | S_IWUSR ) ) >= 0 )
+    {
+        copy_method = COPY_REFLINK;
+        if ( !copy_file_data( task, item->rfd, wfd, &copy_method,
+                              item->src_file, item->dest_file ) )
+            copy_fail = TRUE;
+        close( wfd );
+        if ( copy_fail )
+        {
+            if ( unlink( item->dest_file ) && errno != 2 /* no such file */ )
+                vfs_file_task_error( task, errno, _("Removing"),
+                                                        item->dest_file );
+        }
+        else
+        {
+            chmod( item->dest_file, item->file_stat.st_mode );
+            times.actime = item->file_stat.st_atime;
+            times.modtime = item->file_stat.st_mtime;
+            utime( item->dest_file, &times );
+            if ( task->avoid_changes )
+                update_file_display( item->dest_file );
+            g_mutex_lock( task->mutex );
+            task->error_first = FALSE;
+            g_mutex_unlock( task->mutex );
+        }
+    }
+    else
+        vfs_file_task_error( task, errno, _("Creating"), item->dest_file );
+}
+
+static void copy_item_free( CopyItem* item )
+{
+    close( item->rfd );
+    g_free( item->src_file );
+    g_free( item->dest_file );
+    g_slice_free( CopyItem, item );
+}
+
+static gpointer copy_pool_thread( CopyPool* pool )
+{
+    CopyItem* item;
+
+    g_mutex_lock( pool->mutex );
+    while ( TRUE )
+    {
+        while ( !pool->queue->length && !pool->walk_done )
+            g_cond_wait( pool->cond, pool->mutex );
+        if ( !( item = (CopyItem*)g_queue_pop_head( pool->queue ) ) )
+            break;
+        g_cond_broadcast( pool->cond );     /* room for the walker */
+        g_mutex_unlock( pool->mutex );
+
+        if ( !pool->task->abort )
+            copy_item( pool, item );
+
+        g_mutex_lock( pool->mutex );
+        g_hash_table_remove( pool->busy_dests, item->dest_file );
+        copy_item_free( item );
+        pool->n_busy--;
+        g_cond_broadcast( pool->cond );
+    }
+    g_mutex_unlock( pool->mutex );
+    return NULL;
+}
+
+static CopyPool* copy_pool_new( VFSFileTask* task )
+{
+    CopyPool* pool = g_slice_new0( CopyPool );
+    int i;
+
+    pool->task = task;
+    pool->walker = g_thread_self();
+    pool->mutex = g_mutex_new();
+    pool->cond = g_cond_new();
+    pool->queue = g_queue_new();
+    pool->busy_dests = g_hash_table_new( g_str_hash, g_str_equal );
+    pool->workers = g_new0( GThread*, copy_threads );
+    for ( i = 0; i < copy_threads; i++ )
+    {
+        if ( !( pool->workers[ pool->n_workers ] = g_thread_create(
+                        (GThreadFunc)copy_pool_thread, pool, TRUE, NULL ) ) )
+            break;
+        pool->n_workers++;
+    }
+    if ( !pool->n_workers )
+    {
+        g_hash_table_destroy( pool->busy_dests );
+        g_queue_free( pool->queue );
+        g_cond_free( pool->cond );
+        g_mutex_free( pool->mutex );
+        g_free( pool->workers );
+        g_slice_free( CopyPool, pool );
+        return NULL;
+    }
+    return pool;
+}
+
+/* Queue a file for the workers, which close rfd.  Returns FALSE on abort */
+static gboolean copy_pool_push( CopyPool* pool, int rfd, const char* src_file,
+                                const char* dest_file,
+                                struct stat64* file_stat )
+{
+    CopyItem* item;
+
+    g_mutex_lock( pool->mutex );
+    while ( pool->queue->length >= COPY_QUEUE_MAX && !pool->task->abort )
+        copy_pool_wait( pool );
+    if ( pool->task->abort )
+    {
+        g_mutex_unlock( pool->mutex );
+        close( rfd );
+        return FALSE;
+    }
+    item = g_slice_new( CopyItem );
+    item->rfd = rfd;
+    item->src_file = g_strdup( src_file );
+    item->dest_file = g_strdup( dest_file );
+    item->file_stat = *file_stat;
+    g_queue_push_tail( pool->queue, item );
+    g_hash_table_insert( pool->busy_dests, item->dest_file, item );
+    pool->n_busy++;
+    g_cond_broadcast( pool->cond );
+    g_mutex_unlock( pool->mutex );
+    return TRUE;
+}
+
+/* Wait until a file queued for dest_file is written, so its existence
+ * is known - only the top level files of a task can have the same dest */
+static void copy_pool_wait_for( CopyPool* pool, const char* dest_file )
+{
+    g_mutex_lock( pool->mutex );
+    while ( g_hash_table_lookup( pool->busy_dests, dest_file ) &&
+                                                        !pool->task->abort )
+        copy_pool_wait( pool );
+    g_mutex_unlock( pool->mutex );
+}
+
+/* check_overwrite() for the walker - an auto-renamed or user chosen dest
+ * may be queued but not written yet, which vfs_file_task_get_unique_name()
+ * can't see, so wait for that file and choose again */
+static gboolean copy_check_overwrite( VFSFileTask* task,
+                                      const char* dest_file,
+                                      gboolean* dest_exists,
+                                      char** new_dest_file )
+{
+    CopyPool* pool = (CopyPool*)task->copy_pool;
+    gboolean busy;
+
+    while ( check_overwrite( task, dest_file, dest_exists, new_dest_file ) )
+    {
+        if ( !pool || !*new_dest_file )
+            return TRUE;
+        g_mutex_lock( pool->mutex );
+        busy = g_hash_table_lookup( pool->busy_dests, *new_dest_file ) != NULL;
+        g_mutex_unlock( pool->mutex );
+        if ( !busy )
+            return TRUE;
+        copy_pool_wait_for( pool, *new_dest_file );
+        g_free( *new_dest_file );
+    }
+    return FALSE;
+}
+
+/* Apply the metadata of a copied dir once its files are done */
+static void copy_pool_add_dir( CopyPool* pool, const char* path,
+                               struct stat64* file_stat )
+{
+    CopyDir* dir = g_slice_new( CopyDir );
+    dir->path = g_strdup( path );
+    dir->mode = file_stat->st_mode;
+    dir->atime = file_stat->st_atime;
+    dir->mtime = file_stat->st_mtime;
+    pool->dirs = g_slist_prepend( pool->dirs, dir );
+}
+
+static void copy_pool_finish( CopyPool* pool )
+{
+    CopyDir* dir;
+    GSList* l;
+    struct utimbuf times;
+    int i;
+
+    g_mutex_lock( pool->mutex );
+    pool->walk_done = TRUE;
+    g_cond_broadcast( pool->cond );
+    while ( pool->n_busy > 0 )
+        copy_pool_wait( pool );
+    g_mutex_unlock( pool->mutex );
+    for ( i = 0; i < pool->n_workers; i++ )
+        g_thread_join( pool->workers[i] );
+
+    /* children were added first */
+    pool->dirs = g_slist_reverse( pool->dirs );
+    for ( l = pool->dirs; l; l = l->next )
+    {
+        dir = (CopyDir*)l->data;
+        chmod( dir->path, dir->mode );
+        times.actime = dir->atime;
+        times.modtime = dir->mtime;
+        utime( dir->path, &times );
+        if ( pool->task->avoid_changes )
+            update_file_display( dir->path );
+        g_free( dir->path );
+        g_slice_free( CopyDir, dir );
+    }
+    g_slist_free( pool->dirs );
+
+    g_hash_table_destroy( pool->busy_dests );
+    g_queue_free( pool->queue );
+    g_cond_free( pool->cond );
+    g_mutex_free( pool->mutex );
+    g_free( pool->workers );
+    g_slice_free( CopyPool, pool );
+}
+
+void vfs_file_task_set_copy_threads( int threads )
+{
+    copy_threads = threads;
+}
+
+/* Transfer plan: the size thread records each dir listing it walks, so the
+ * transfer can walk the same tree without reading the dirs again.  Records
+ * are appended to one buffer, and past plan_mem_limit to an unlinked file
+ * in the user's cache dir.  The children of a dir are contiguous and only
+ * marked listed when all of them were recorded - a dir which isn't listed
+ * yet is read by the transfer itself.
+ * The plan may be minutes old, so it's only a hint: the transfer still
+ * lstats each entry, opens each dir with O_NOFOLLOW, and uses a listing
+ * only while the dir has the inode and mtime it was listed with. */
+#define PLAN_LISTED     1
+#define PLAN_WBUF_SIZE  65536
+
+static guint plan_mem_limit = 64 * 1024 * 1024;
+static gboolean plan_spill = TRUE;
+
+typedef struct
+{
+    guint32 children;   /* offset of first child record */
+    guint32 n_children;
+    guint16 name_len;
+    guint16 flags;
+    guint32 mtime_nsec;
+    guint64 ino;
+    gint64 mtime;
+} PlanRecord;           /* followed by the name, padded to 8 bytes */
+
+typedef struct
+{
+    GMutex* mutex;
+    char* mem;
+    guint32 mem_size;
+    guint32 used;       /* offset of next record, 0 is never a record */
+    int fd;             /* spill file or -1 */
+    guint32 spill_base; /* offset of first record in the spill file */
+    char* wbuf;         /* spilled records not written yet */
+    guint32 wbuf_len;
+    gboolean full;
+    GHashTable* roots;  /* src path -> offset of its record */
+} TransferPlan;
+
+typedef struct
+{
+    DIR* dir;
+    guint32 next;
+    guint32 n;
+    char name[ NAME_MAX + 1 ];
+} PlanDir;
+
+static TransferPlan* plan_new()
+{
+    TransferPlan* plan = g_slice_new0( TransferPlan );
+    plan->mutex = g_mutex_new();
+    plan->fd = -1;
+    plan->used = 8;
+    plan->roots = g_hash_table_new( g_str_hash, g_str_equal );
+    return plan;
+}
+
+static void plan_free( TransferPlan* plan )
+{
+    if ( plan->fd != -1 )
+        close( plan->fd );
+    g_free( plan->wbuf );
+    g_free( plan->mem );
+    g_hash_table_destroy( plan->roots );
+    g_mutex_free( plan->mutex );
+    g_slice_free( TransferPlan, plan );
+}
+
+static gboolean plan_flush( TransferPlan* plan )
+{
+    guint32 pos = plan->used - plan->wbuf_len - plan->spill_base;
+    if ( plan->wbuf_len && pwrite( plan->fd, plan->wbuf, plan->wbuf_len,
+                                            pos ) != (ssize_t)plan->wbuf_len )
+        return FALSE;
+    plan->wbuf_len = 0;
+    return TRUE;
+}
+
+static gboolean plan_start_spill( TransferPlan* plan )
+{
+    char* path;
+
+    if ( !plan_spill )
+        return FALSE;
+    /* not g_get_tmp_dir(), which is often a small tmpfs */
+    path = g_build_filename( g_get_user_cache_dir(), "spacefm", NULL );
+    g_mkdir_with_parents( path, 0700 );
+    g_free( path );
+    path = g_build_filename( g_get_user_cache_dir(), "spacefm",
+                                                "plan-XXXXXX", NULL );
+    plan->fd = mkstemp( path );
+    if ( plan->fd != -1 )
+        unlink( path );
+    g_free( path );
+    if ( plan->fd == -1 )
+        return FALSE;
+    plan->spill_base = plan->used;
+    plan->wbuf = g_malloc( PLAN_WBUF_SIZE );
+    return TRUE;
+}
+
+/* copies len bytes at off in or out of the plan - caller holds plan->mutex */
+static gboolean plan_io( TransferPlan* plan, guint32 off, gpointer buf,
+                                                guint32 len, gboolean write )
+{
+    guint32 wbuf_start = plan->used - plan->wbuf_len;
+    char* p;
+
+    if ( plan->fd == -1 || off < plan->spill_base )
+        p = plan->mem + off;
+    else if ( off >= wbuf_start )
+        p = plan->wbuf + ( off - wbuf_start );
+    else if ( write )
+        return pwrite( plan->fd, buf, len, off - plan->spill_base ) ==
+                                                                (ssize_t)len;
+    else
+        return pread( plan->fd, buf, len, off - plan->spill_base ) ==
+                                                                (ssize_t)len;
+    if ( write )
+        memcpy( p, buf, len );
+    else
+        memcpy( buf, p, len );
+    return TRUE;
+}
+
+/* appends a record and returns its offset, or 0 when the plan is full */
+static guint32 plan_add( TransferPlan* plan, const char* name,
+                                            struct stat64* file_stat )
+{
+    PlanRecord rec = { 0 };
+    guint32 len;
+    guint32 off = 0;
+
+    if ( name && strlen( name ) > NAME_MAX )
+        return 0;
+    rec.name_len = name ? strlen( name ) : 0;
+    rec.ino = file_stat->st_ino;
+    rec.mtime = file_stat->st_mtime;
+    rec.mtime_nsec = file_stat->st_mtim.tv_nsec;
+    len = ( sizeof( PlanRecord ) + rec.name_len + 1 + 7 ) & ~7;
+
+    g_mutex_lock( plan->mutex );
+    if ( plan->full || (guint64)plan->used + len > G_MAXUINT32 )
+        goto _full;
+    if ( plan->fd == -1 && plan->used + len > plan->mem_size )
+    {
+        if ( plan->used + len > plan_mem_limit )
+        {
+            if ( !plan_start_spill( plan ) )
+                goto _full;
+        }
+        else
+        {
+            plan->mem_size = MIN( MAX( (guint64)plan->mem_size * 2, 65536 ),
+                                                            plan_mem_limit );
+            plan->mem = g_realloc( plan->mem, plan->mem_size );
+        }
+    }
+    if ( plan->fd != -1 && plan->wbuf_len + len > PLAN_WBUF_SIZE &&
+                                                        !plan_flush( plan ) )
+        goto _full;
+
+    off = plan->used;
+    if ( plan->fd != -1 )
+        plan->wbuf_len += len;
+    plan->used += len;
+    plan_io( plan, off, &rec, sizeof( PlanRecord ), TRUE );
+    plan_io( plan, off + sizeof( PlanRecord ), (gpointer)( name ? name : "" ),
+                                                    rec.name_len + 1, TRUE );
+    g_mutex_unlock( plan->mutex );
+    return off;
+
+_full:
+    plan->full = TRUE;
+    g_mutex_unlock( plan->mutex );
+    return 0;
+}
+
+static void plan_set_children( TransferPlan* plan, guint32 node,
+                                            guint32 children, guint32 n )
+{
+    PlanRecord rec;
+
+    g_mutex_lock( plan->mutex );
+    if ( plan_io( plan, node, &rec, sizeof( PlanRecord ), FALSE ) )
+    {
+        rec.children = children;
+        rec.n_children = n;
+        rec.flags |= PLAN_LISTED;
+        plan_io( plan, node, &rec, sizeof( PlanRecord ), TRUE );
+    }
+    g_mutex_unlock( plan->mutex );
+}
+
+/* reads the record at node, returning the offset after it or 0 */
+static guint32 plan_get( TransferPlan* plan, guint32 node, char* name,
+                         PlanRecord* rec )
+{
+    PlanRecord r;
+    guint32 next = 0;
+
+    if ( !plan || !node )
+        return 0;
+    if ( !rec )
+        rec = &r;
+    g_mutex_lock( plan->mutex );
+    if ( plan_io( plan, node, rec, sizeof( PlanRecord ), FALSE ) &&
+            ( !name || plan_io( plan, node + sizeof( PlanRecord ), name,
+                                            rec->name_len + 1, FALSE ) ) )
+        next = node + ( ( sizeof( PlanRecord ) + rec->name_len + 1 + 7 ) & ~7 );
+    g_mutex_unlock( plan->mutex );
+    return next;
+}
+
+static guint32 plan_root( VFSFileTask* task, const char* src_file )
+{
+    TransferPlan* plan = (TransferPlan*)task->plan;
+    guint32 node = 0;
+
+    if ( plan )
+    {
+        g_mutex_lock( plan->mutex );
+        node = GPOINTER_TO_UINT( g_hash_table_lookup( plan->roots,
+                                                            src_file ) );
+        g_mutex_unlock( plan->mutex );
+    }
+    return node;
+}
+
+/* Lists dir from node if the size thread listed it and it hasn't changed
+ * since, else reads it.  A dir replaced by a symlink isn't followed */
+static gboolean plan_dir_open( VFSFileTask* task, PlanDir* pdir,
+                               const char* path, guint32 node,
+                               GError** error )
+{
+    PlanRecord rec;
+    struct stat64 file_stat;
+    char* disp_path;
+    int fd, errnox;
+
+    pdir->dir = NULL;
+    fd = open( path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    if ( fd != -1 && plan_get( (TransferPlan*)task->plan, node, NULL, &rec ) &&
+            ( rec.flags & PLAN_LISTED ) && fstat64( fd, &file_stat ) == 0 &&
+            file_stat.st_ino == rec.ino && file_stat.st_mtime == rec.mtime &&
+            file_stat.st_mtim.tv_nsec == rec.mtime_nsec )
+    {
+        close( fd );
+        pdir->next = rec.children;
+        pdir->n = rec.n_children;
+        return TRUE;
+    }
+    if ( fd != -1 && ( pdir->dir = fdopendir( fd ) ) )
+        return TRUE;
+    errnox = errno;
+    if ( fd != -1 )
+        close( fd );
+    disp_path = g_filename_display_name( path );
+    g_set_error( error, G_FILE_ERROR, g_file_error_from_errno( errnox ),
+                 _("Error opening directory '%s': %s"), disp_path,
+                 g_strerror( errnox ) );
+    g_free( disp_path );
+    return FALSE;
+}
+
+static const char* plan_dir_read( VFSFileTask* task, PlanDir* pdir,
+                                                        guint32* node )
+{
+    struct dirent* ent;
+    guint32 next;
+
+    if ( pdir->dir )
+    {
+        *node = 0;
+        while ( ( ent = readdir( pdir->dir ) ) )
+        {
+            if ( strcmp( ent->d_name, "." ) && strcmp( ent->d_name, ".." ) )
+                return ent->d_name;
+        }
+        return NULL;
+    }
+    if ( !pdir->n || !( next = plan_get( (TransferPlan*)task->plan,
+                                        pdir->next, pdir->name, NULL ) ) )
+        return NULL;
+    *node = pdir->next;
+    pdir->next = next;
+    pdir->n--;
+    return pdir->name;
+}
+
+static void plan_dir_close( PlanDir* pdir )
+{
+    if ( pdir->dir )
+        closedir( pdir->dir );
+}
+
+void vfs_file_task_set_plan_mem( int mb )
+{
+    plan_mem_limit = (guint)MIN( MAX( mb, 0 ), 4095 ) << 20;
+}
+
+void vfs_file_task_set_plan_spill( gboolean spill )
+{
+    plan_spill = spill;
+}
+
 static gboolean
 vfs_file_task_do_copy( VFSFileTask* task,
                        const char* src_file,
-                       const char* dest_file )
+                       const char* dest_file,
+                       guint32 node )
 {
-    GDir * dir;
+    PlanDir dir;
+    guint32 sub_node;
     const gchar* file_name;
     gchar* sub_src_file;
     gchar* sub_dest_file;
@@ -360,7 +1157,7 @@ vfs_file_task_do_copy( VFSFileTask* task,
     char buffer[ 4096 ];
     int rfd;
     int wfd;
-    ssize_t rsize;
+    int copy_method;
     char* new_dest_file = NULL;
     gboolean dest_exists;
     gboolean copy_fail = FALSE;
@@ -382,14 +1179,17 @@ vfs_file_task_do_copy( VFSFileTask* task,
         return FALSE;
     }
 
+    if ( task->copy_pool )
+        copy_pool_wait_for( (CopyPool*)task->copy_pool, dest_file );
+
     result = 0;
     if ( S_ISDIR( file_stat.st_mode ) )
     {
         if ( check_dest_in_src( task, src_file ) )
             goto _return_;
 
-        if ( ! check_overwrite( task, dest_file,
-                                &dest_exists, &new_dest_file ) )
+        if ( ! copy_check_overwrite( task, dest_file,
+                                     &dest_exists, &new_dest_file ) )
             goto _return_;
         if ( new_dest_file )
         {
@@ -405,27 +1205,25 @@ vfs_file_task_do_copy( VFSFileTask* task,
         if ( result == 0 )
         {
             struct utimbuf times;
-            g_mutex_lock( task->mutex );
-            task->progress += file_stat.st_size;
-            g_mutex_unlock( task->mutex );
+            add_progress( task, file_stat.st_size );
 
             error = NULL;
-            dir = g_dir_open( src_file, 0, &error );
-            if ( dir )
+            if ( plan_dir_open( task, &dir, src_file, node, &error ) )
             {
-                while ( (file_name = g_dir_read_name( dir )) )
+                while ( (file_name = plan_dir_read( task, &dir, &sub_node )) )
                 {
                     if ( should_abort( task ) )
                         break;
                     sub_src_file = g_build_filename( src_file, file_name, NULL );
                     sub_dest_file = g_build_filename( dest_file, file_name, NULL );
-                    if ( !vfs_file_task_do_copy( task, sub_src_file, sub_dest_file )
+                    if ( !vfs_file_task_do_copy( task, sub_src_file, sub_dest_file,
+                                                        sub_node )
                                                         && !copy_fail )
                         copy_fail = TRUE;
                     g_free(sub_dest_file );
                     g_free(sub_src_file );
                 }
-                g_dir_close( dir );
+                plan_dir_close( &dir );
             }
             else if ( error )
             {
@@ -438,13 +1236,19 @@ vfs_file_task_do_copy( VFSFileTask* task,
                     goto _return_;
             }
 
-            chmod( dest_file, file_stat.st_mode );
-            times.actime = file_stat.st_atime;
-            times.modtime = file_stat.st_mtime;
-            utime( dest_file, &times );
+            if ( task->copy_pool )
+                copy_pool_add_dir( (CopyPool*)task->copy_pool, dest_file,
+                                                                &file_stat );
+            else
+            {
+                chmod( dest_file, file_stat.st_mode );
+                times.actime = file_stat.st_atime;
+                times.modtime = file_stat.st_mtime;
+                utime( dest_file, &times );
 
-            if ( task->avoid_changes )
-                update_file_display( dest_file );
+                if ( task->avoid_changes )
+                    update_file_display( dest_file );
+            }
 
             /* Move files to different device: Need to delete source dir */
             if ( ( task->type == VFS_FILE_TASK_MOVE
@@ -471,8 +1275,8 @@ vfs_file_task_do_copy( VFSFileTask* task,
         if ( ( rfd = readlink( src_file, buffer, sizeof( buffer ) - 1 ) ) > 0 )
         {
             buffer[rfd] = '\0';  //MOD terminate buffer string
-            if ( ! check_overwrite( task, dest_file,
-                                    &dest_exists, &new_dest_file ) )
+            if ( ! copy_check_overwrite( task, dest_file,
+                                         &dest_exists, &new_dest_file ) )
                 goto _return_;
 
             if ( new_dest_file )
@@ -511,9 +1315,7 @@ vfs_file_task_do_copy( VFSFileTask* task,
                         copy_fail = TRUE;
                     }
                 }
-                g_mutex_lock( task->mutex );
-                task->progress += file_stat.st_size;
-                g_mutex_unlock( task->mutex );
+                add_progress( task, file_stat.st_size );
             }
             else
             {
@@ -531,8 +1333,8 @@ vfs_file_task_do_copy( VFSFileTask* task,
     {
         if ( ( rfd = open( src_file, O_RDONLY ) ) >= 0 )
         {
-            if ( ! check_overwrite( task, dest_file,
-                                    &dest_exists, &new_dest_file ) )
+            if ( ! copy_check_overwrite( task, dest_file,
+                                         &dest_exists, &new_dest_file ) )
             {
                 close( rfd );
                 goto _return_;
@@ -558,34 +1360,25 @@ vfs_file_task_do_copy( VFSFileTask* task,
                 }                
             }
             
-            if ( ( wfd = creat( dest_file,
+            if ( task->copy_pool )
+            {
+                /* a worker copies it and closes rfd */
+                if ( !copy_pool_push( (CopyPool*)task->copy_pool, rfd,
+                                      src_file, dest_file, &file_stat ) )
+                    copy_fail = TRUE;
+                rfd = -1;
+            }
+            else if ( ( wfd = creat( dest_file,
                                 file_stat.st_mode | S_IWUSR ) ) >= 0 )
             {
                 // sshfs becomes unresponsive with this, nfs is okay with it
                 //if ( task->avoid_changes )
                 //    emit_created( dest_file );
                 struct utimbuf times;
-                while ( ( rsize = read( rfd, buffer, sizeof( buffer ) ) ) > 0 )
-                {
-                    if ( should_abort( task ) )
-                    {
-                        copy_fail = TRUE;
-                        break;
-                    }
-                    
-                    if ( write( wfd, buffer, rsize ) > 0 )
-                    {
-                        g_mutex_lock( task->mutex );
-                        task->progress += rsize;
-                        g_mutex_unlock( task->mutex );
-                    }
-                    else
-                    {
-                        vfs_file_task_error( task, errno, _("Writing"), dest_file );
-                        copy_fail = TRUE;
-                        break;
-                    }
-                }
+                copy_method = COPY_REFLINK;
+                if ( !copy_file_data( task, rfd, wfd, &copy_method,
+                                                    src_file, dest_file ) )
+                    copy_fail = TRUE;
                 close( wfd );
                 if ( copy_fail )
                 {
@@ -627,7 +1420,8 @@ vfs_file_task_do_copy( VFSFileTask* task,
                 vfs_file_task_error( task, errno, _("Creating"), dest_file );
                 copy_fail = TRUE;
             }
-            close( rfd );
+            if ( rfd != -1 )
+                close( rfd );
         }
         else
         {
@@ -656,7 +1450,8 @@ vfs_file_task_copy( char* src_file, VFSFileTask* task )
     file_name = g_path_get_basename( src_file );
     dest_file = g_build_filename( task->dest_dir, file_name, NULL );
     g_free(file_name );
-    vfs_file_task_do_copy( task, src_file, dest_file );
+    vfs_file_task_do_copy( task, src_file, dest_file,
+                                        plan_root( task, src_file ) );
     g_free(dest_file );
 }
 
@@ -759,8 +1554,8 @@ vfs_file_task_do_move ( VFSFileTask* task,
     else if ( ! g_file_test( dest_file, G_FILE_TEST_IS_SYMLINK ) )
         chmod( dest_file, file_stat.st_mode );
     
+    add_progress( task, file_stat.st_size );
     g_mutex_lock( task->mutex );
-    task->progress += file_stat.st_size;
     if ( task->error_first )
         task->error_first = FALSE;
     g_mutex_unlock( task->mutex );
@@ -811,7 +1606,8 @@ vfs_file_task_move( char* src_file, VFSFileTask* task )
         if ( src_stat.st_dev != dest_stat.st_dev )
         {
             /* g_print("not on the same dev: %s\n", src_file); */
-            vfs_file_task_do_copy( task, src_file, dest_file );
+            vfs_file_task_do_copy( task, src_file, dest_file,
+                                        plan_root( task, src_file ) );
         }
         /*
         else if ( S_ISDIR( src_stat.st_mode ) && 
@@ -827,7 +1623,8 @@ vfs_file_task_move( char* src_file, VFSFileTask* task )
             {
                 //MOD Invalid cross-device link (st_dev not always accurate test)
                 // so now redo move as copy
-                vfs_file_task_do_copy( task, src_file, dest_file );
+                vfs_file_task_do_copy( task, src_file, dest_file,
+                                        plan_root( task, src_file ) );
             }
         }
     }
@@ -844,9 +1641,11 @@ on_error:
 }
 
 static void
-vfs_file_task_delete( char* src_file, VFSFileTask* task )
+vfs_file_task_do_delete( VFSFileTask* task, const char* src_file,
+                                                        guint32 node )
 {
-    GDir * dir;
+    PlanDir dir;
+    guint32 sub_node;
     const gchar* file_name;
     gchar* sub_src_file;
     struct stat64 file_stat;
@@ -870,18 +1669,17 @@ vfs_file_task_delete( char* src_file, VFSFileTask* task )
     if ( S_ISDIR( file_stat.st_mode ) )
     {
         error = NULL;
-        dir = g_dir_open( src_file, 0, &error );
-        if ( dir )
+        if ( plan_dir_open( task, &dir, src_file, node, &error ) )
         {
-            while ( (file_name = g_dir_read_name( dir )) )
+            while ( (file_name = plan_dir_read( task, &dir, &sub_node )) )
             {
                 if ( should_abort( task ) )
                     break;
                 sub_src_file = g_build_filename( src_file, file_name, NULL );
-                vfs_file_task_delete( sub_src_file, task );
+                vfs_file_task_do_delete( task, sub_src_file, sub_node );
                 g_free(sub_src_file );
             }
-            g_dir_close( dir );
+            plan_dir_close( &dir );
         }
         else if ( error )
         {
@@ -894,6 +1692,12 @@ vfs_file_task_delete( char* src_file, VFSFileTask* task )
         if ( should_abort( task ) )
             return ;
         result = rmdir( src_file );
+        if ( result != 0 && errno == ENOTEMPTY && node )
+        {
+            // created since the plan listed it in the same clock tick
+            vfs_file_task_do_delete( task, src_file, 0 );
+            return;
+        }
         if ( result != 0 )
         {
             vfs_file_task_error( task, errno, _("Removing"), src_file );
@@ -909,13 +1713,300 @@ vfs_file_task_delete( char* src_file, VFSFileTask* task )
             return ;
         }
     }
+    add_progress( task, file_stat.st_size );
     g_mutex_lock( task->mutex );
-    task->progress += file_stat.st_size;
     if ( task->error_first )
         task->error_first = FALSE;
     g_mutex_unlock( task->mutex );
 }
 
+/* Fast deleting: each dir of a tree is read and emptied relative to its fd,
+ * using d_type to find the subdirs without stating, and the subdirs are
+ * shared out to a pool of workers.  A dir keeps its fd open until its last
+ * subdir is done, and is then removed by whichever thread finished that. */
+static int delete_threads = 4;
+
+/* entries of a dir counted before they're added to the progress */
+#define DELETE_COUNT_BATCH 256
+
+typedef struct _DeleteDir DeleteDir;
+struct _DeleteDir
+{
+    DeleteDir* parent;
+    char* path;         /* for error messages */
+    const char* name;   /* basename in path */
+    int fd;
+    gint pending;       /* subdirs not done, plus one while reading */
+};
+
+typedef struct
+{
+    VFSFileTask* task;
+    GThread* walker;    /* the thread which made the pool */
+    GThread** workers;
+    int n_workers;
+    GMutex* mutex;
+    GCond* cond;        /* a dir was queued or read */
+    GSList* stack;      /* dirs to read, newest first to keep the open
+                           dirs along a few paths */
+    int n_reading;
+    gboolean quit;
+} DeletePool;
+
+static gboolean delete_should_abort( DeletePool* pool )
+{
+    VFSFileTask* task = pool->task;
+
+    if ( g_thread_self() == pool->walker )
+        return should_abort( task );
+    return worker_should_abort( task );
+}
+
+static DeleteDir* delete_dir_new( DeleteDir* parent, const char* path )
+{
+    DeleteDir* dd = g_slice_new( DeleteDir );
+    dd->parent = parent;
+    dd->path = g_strdup( path );
+    dd->name = parent ? strrchr( dd->path, '/' ) + 1 : dd->path;
+    dd->fd = -1;
+    dd->pending = 1;
+    return dd;
+}
+
+/* drops a reference on dd, removing it and maybe its parents when done */
+static void delete_dir_done( VFSFileTask* task, DeleteDir* dd )
+{
+    DeleteDir* parent;
+
+    while ( dd && g_atomic_int_dec_and_test( &dd->pending ) )
+    {
+        parent = dd->parent;
+        if ( dd->fd != -1 )
+            close( dd->fd );
+        if ( !task->abort )
+        {
+            if ( unlinkat( parent ? parent->fd : AT_FDCWD, dd->name,
+                                                        AT_REMOVEDIR ) == 0 )
+            {
+                g_atomic_int_inc( (gint*)&task->current_item );
+                g_mutex_lock( task->mutex );
+                task->error_first = FALSE;
+                g_mutex_unlock( task->mutex );
+                if ( task->avoid_changes )
+                    update_file_deleted( dd->path );
+            }
+            else
+                vfs_file_task_error( task, errno, _("Removing"), dd->path );
+        }
+        g_free( dd->path );
+        g_slice_free( DeleteDir, dd );
+        dd = parent;
+    }
+}
+
+static gboolean delete_is_dir( int fd, struct dirent* ent )
+{
+    struct stat64 file_stat;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+    if ( ent->d_type != DT_UNKNOWN )
+        return ent->d_type == DT_DIR;
+#endif
+    return fstatat64( fd, ent->d_name, &file_stat,
+                                            AT_SYMLINK_NOFOLLOW ) == 0 &&
+                                            S_ISDIR( file_stat.st_mode );
+}
+
+static void delete_dir_read( DeletePool* pool, DeleteDir* dd )
+{
+    VFSFileTask* task = pool->task;
+    DIR* dir = NULL;
+    struct dirent* ent;
+    DeleteDir* sub;
+    GSList* subs = NULL;
+    GSList* l;
+    char* path;
+    int dfd;
+    int n = 0;
+    int n_entries = 0;
+    int n_removed = 0;
+    gboolean removed = FALSE;
+
+    if ( delete_should_abort( pool ) )
+        goto _done;
+    g_mutex_lock( task->mutex );
+    string_copy_free( &task->current_file, dd->path );
+    g_mutex_unlock( task->mutex );
+
+    dd->fd = openat( dd->parent ? dd->parent->fd : AT_FDCWD, dd->name,
+                        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    if ( dd->fd != -1 && ( dfd = dup( dd->fd ) ) != -1 &&
+                                        !( dir = fdopendir( dfd ) ) )
+        close( dfd );
+    if ( !dir )
+    {
+        vfs_file_task_error( task, errno, _("Accessing"), dd->path );
+        goto _done;
+    }
+    /* there's no size thread, so the entries are counted for the progress
+     * as they're found, adding to the total first */
+    while ( ( ent = readdir( dir ) ) )
+    {
+        if ( ent->d_name[0] == '.' && ( !ent->d_name[1] ||
+                        ( ent->d_name[1] == '.' && !ent->d_name[2] ) ) )
+            continue;
+        if ( delete_should_abort( pool ) )
+            break;
+        if ( ++n_entries == DELETE_COUNT_BATCH )
+        {
+            g_atomic_int_add( (gint*)&task->total_items, n_entries );
+            g_atomic_int_add( (gint*)&task->current_item, n_removed );
+            n_entries = n_removed = 0;
+        }
+        path = g_build_filename( dd->path, ent->d_name, NULL );
+        if ( delete_is_dir( dd->fd, ent ) )
+        {
+            subs = g_slist_prepend( subs, delete_dir_new( dd, path ) );
+            n++;
+        }
+        else if ( unlinkat( dd->fd, ent->d_name, 0 ) == 0 )
+        {
+            n_removed++;
+            removed = TRUE;
+        }
+        else
+            vfs_file_task_error( task, errno, _("Removing"), path );
+        g_free( path );
+    }
+    g_atomic_int_add( (gint*)&task->total_items, n_entries );
+    g_atomic_int_add( (gint*)&task->current_item, n_removed );
+    closedir( dir );
+    if ( removed )
+    {
+        g_mutex_lock( task->mutex );
+        task->error_first = FALSE;
+        g_mutex_unlock( task->mutex );
+    }
+
+    if ( subs )
+    {
+        g_atomic_int_add( &dd->pending, n );
+        g_mutex_lock( pool->mutex );
+        for ( l = subs; l; l = l->next )
+            pool->stack = g_slist_prepend( pool->stack, l->data );
+        g_cond_broadcast( pool->cond );
+        g_mutex_unlock( pool->mutex );
+        g_slist_free( subs );
+    }
+_done:
+    if ( !dir && dd->fd != -1 )
+    {
+        close( dd->fd );
+        dd->fd = -1;
+    }
+    delete_dir_done( task, dd );
+}
+
+/* reads dirs from the stack until it is empty and no dir is being read, or
+ * with until_quit until the pool is freed */
+static void delete_pool_work( DeletePool* pool, gboolean until_quit )
+{
+    DeleteDir* dd;
+
+    g_mutex_lock( pool->mutex );
+    while ( !pool->quit )
+    {
+        if ( pool->stack )
+        {
+            dd = (DeleteDir*)pool->stack->data;
+            pool->stack = g_slist_delete_link( pool->stack, pool->stack );
+            pool->n_reading++;
+            g_mutex_unlock( pool->mutex );
+            delete_dir_read( pool, dd );
+            g_mutex_lock( pool->mutex );
+            pool->n_reading--;
+            g_cond_broadcast( pool->cond );
+        }
+        else if ( !until_quit && !pool->n_reading )
+            break;
+        else
+            g_cond_wait( pool->cond, pool->mutex );
+    }
+    g_mutex_unlock( pool->mutex );
+}
+
+static gpointer delete_pool_thread( DeletePool* pool )
+{
+    delete_pool_work( pool, TRUE );
+    return NULL;
+}
+
+static DeletePool* delete_pool_new( VFSFileTask* task, int threads )
+{
+    int i;
+    DeletePool* pool = g_slice_new0( DeletePool );
+
+    pool->task = task;
+    pool->walker = g_thread_self();
+    pool->mutex = g_mutex_new();
+    pool->cond = g_cond_new();
+    /* the calling thread reads dirs too */
+    pool->workers = g_new0( GThread*, MAX( threads - 1, 1 ) );
+    for ( i = 0; i < threads - 1; i++ )
+    {
+        pool->workers[ pool->n_workers ] = g_thread_create(
+                                    (GThreadFunc)delete_pool_thread,
+                                    pool, TRUE, NULL );
+        if ( pool->workers[ pool->n_workers ] )
+            pool->n_workers++;
+    }
+    return pool;
+}
+
+static void delete_pool_delete( DeletePool* pool, const char* path )
+{
+    g_mutex_lock( pool->mutex );
+    pool->stack = g_slist_prepend( pool->stack, delete_dir_new( NULL, path ) );
+    g_cond_broadcast( pool->cond );
+    g_mutex_unlock( pool->mutex );
+    delete_pool_work( pool, FALSE );
+}
+
+static void delete_pool_free( DeletePool* pool )
+{
+    int i;
+
+    g_mutex_lock( pool->mutex );
+    pool->quit = TRUE;
+    g_cond_broadcast( pool->cond );
+    g_mutex_unlock( pool->mutex );
+    for ( i = 0; i < pool->n_workers; i++ )
+        g_thread_join( pool->workers[ i ] );
+    g_free( pool->workers );
+    g_cond_free( pool->cond );
+    g_mutex_free( pool->mutex );
+    g_slice_free( DeletePool, pool );
+}
+
+void vfs_file_task_set_delete_threads( int threads )
+{
+    delete_threads = threads;
+}
+
+static void
+vfs_file_task_delete( char* src_file, VFSFileTask* task )
+{
+    struct stat64 file_stat;
+
+    if ( task->delete_pool )
+        g_atomic_int_inc( (gint*)&task->total_items );
+    if ( task->delete_pool && lstat64( src_file, &file_stat ) == 0 &&
+                                            S_ISDIR( file_stat.st_mode ) )
+        delete_pool_delete( (DeletePool*)task->delete_pool, src_file );
+    else
+        vfs_file_task_do_delete( task, src_file, plan_root( task, src_file ) );
+}
+
 static void
 vfs_file_task_link( char* src_file, VFSFileTask* task )
 {
@@ -986,8 +2077,8 @@ vfs_file_task_link( char* src_file, VFSFileTask* task )
             return ;
     }
 
+    add_progress( task, src_stat.st_size );
     g_mutex_lock( task->mutex );
-    task->progress += src_stat.st_size;
     if ( task->error_first )
         task->error_first = FALSE;
     g_mutex_unlock( task->mutex );
@@ -998,11 +2089,13 @@ vfs_file_task_link( char* src_file, VFSFileTask* task )
 }
 
 static void
-vfs_file_task_chown_chmod( char* src_file, VFSFileTask* task )
+vfs_file_task_do_chown_chmod( VFSFileTask* task, const char* src_file,
+                                                            guint32 node )
 {
     struct stat64 src_stat;
     int i;
-    GDir* dir;
+    PlanDir dir;
+    guint32 sub_node;
     gchar* sub_src_file;
     const gchar* file_name;
     mode_t new_mode;
@@ -1056,9 +2149,7 @@ vfs_file_task_chown_chmod( char* src_file, VFSFileTask* task )
             }
         }
 
-        g_mutex_lock( task->mutex );
-        task->progress += src_stat.st_size;
-        g_mutex_unlock( task->mutex );
+        add_progress( task, src_stat.st_size );
 
         if ( task->avoid_changes )
             update_file_display( src_file );
@@ -1066,18 +2157,17 @@ vfs_file_task_chown_chmod( char* src_file, VFSFileTask* task )
         if ( S_ISDIR( src_stat.st_mode ) && task->recursive )
         {
             error = NULL;
-            dir = g_dir_open( src_file, 0, &error );
-            if ( dir )
+            if ( plan_dir_open( task, &dir, src_file, node, &error ) )
             {
-                while ( (file_name = g_dir_read_name( dir )) )
+                while ( (file_name = plan_dir_read( task, &dir, &sub_node )) )
                 {
                     if ( should_abort( task ) )
                         break;
                     sub_src_file = g_build_filename( src_file, file_name, NULL );
-                    vfs_file_task_chown_chmod( sub_src_file, task );
+                    vfs_file_task_do_chown_chmod( task, sub_src_file, sub_node );
                     g_free(sub_src_file );
                 }
-                g_dir_close( dir );
+                plan_dir_close( &dir );
             }
             else if ( error )
             {
@@ -1100,6 +2190,13 @@ vfs_file_task_chown_chmod( char* src_file, VFSFileTask* task )
         task->error_first = FALSE;
 }
 
+static void
+vfs_file_task_chown_chmod( char* src_file, VFSFileTask* task )
+{
+    vfs_file_task_do_chown_chmod( task, src_file,
+                                        plan_root( task, src_file ) );
+}
+
 char* vfs_file_task_get_cpids( GPid pid )
 {   // get child pids recursively as multi-line string
     char* nl;
@@ -2027,20 +3124,56 @@ _exit_with_error_lean:
 //printf("vfs_file_task_exec DONE ERROR\n");
 }
 
-gboolean on_size_timeout( VFSFileTask* task )
+/* Add up task->total_size and task->total_items while the task runs, since
+ * this can be VERY slow for network filesystems */
+static gpointer vfs_file_task_size_thread( VFSFileTask* task )
 {
-    if ( !task->abort )
-        task->state = VFS_FILE_TASK_SIZE_TIMEOUT;
-    return FALSE;
+    GList* l;
+    struct stat64 file_stat;
+    dev_t dest_dev = 0;
+    TransferPlan* plan = (TransferPlan*)task->plan;
+    guint32 node;
+
+    if ( !task->recursive && task->dest_dir &&
+                                    stat64( task->dest_dir, &file_stat ) == 0 )
+        dest_dev = file_stat.st_dev;
+    for ( l = task->src_paths; l && !task->abort && !task->size_cancel;
+                                                                l = l->next )
+    {
+        if ( lstat64( ( char* ) l->data, &file_stat ) == -1 )
+        {
+            // don't report error here since it's reported later
+            continue;
+        }
+        if ( task->recursive || ( ( task->type == VFS_FILE_TASK_MOVE ||
+                                        task->type == VFS_FILE_TASK_TRASH )
+                                        && file_stat.st_dev != dest_dev ) )
+        {
+            // recursive size
+            node = 0;
+            if ( plan && S_ISDIR( file_stat.st_mode ) &&
+                            ( node = plan_add( plan, NULL, &file_stat ) ) )
+            {
+                g_mutex_lock( plan->mutex );
+                g_hash_table_insert( plan->roots, l->data,
+                                                GUINT_TO_POINTER( node ) );
+                g_mutex_unlock( plan->mutex );
+            }
+            get_total_size_of_dir( task, ( char* ) l->data, &file_stat, node );
+        }
+        else
+            add_total( task, file_stat.st_size );
+    }
+    task->size_scanning = FALSE;
+    return NULL;
 }
 
 static gpointer vfs_file_task_thread ( VFSFileTask* task )
 //void * vfs_file_task_thread ( void * ptr )
 {
-    GList * l;
     struct stat64 file_stat;
-    dev_t dest_dev = 0;
-    off64_t size;
+    int i;
+    GList* l;
     GFunc funcs[] = {( GFunc ) vfs_file_task_move,
                      ( GFunc ) vfs_file_task_copy,
                      ( GFunc ) vfs_file_task_move,  /* trash */
@@ -2071,109 +3204,52 @@ static gpointer vfs_file_task_thread ( VFSFileTask* task )
     if ( task->abort )
         goto _exit_thread;
 
-    /* Calculate total size of all files */
-    guint size_timeout = 0;
-    if ( task->recursive )
+    if ( !task->recursive && task->type != VFS_FILE_TASK_EXEC &&
+                                    task->type != VFS_FILE_TASK_CHMOD_CHOWN )
     {
-        // start timer to limit the amount of time to spend on this - can be 
-        // VERY slow for network filesystems
-        size_timeout = g_timeout_add_seconds( 5,
-                                       ( GSourceFunc ) on_size_timeout, task );
-        for ( l = task->src_paths; l; l = l->next )
+        if ( !( task->dest_dir && stat64( task->dest_dir, &file_stat ) == 0 ) )
         {
-            if ( lstat64( (char*)l->data, &file_stat ) == -1 )
-            {
-                // don't report error here since its reported later
-                //vfs_file_task_error( task, errno, _("Accessing"), (char*)l->data );
-            }
-            else
-            {
-                size = 0;
-                get_total_size_of_dir( task, ( char* ) l->data, &size, &file_stat );
-                g_mutex_lock( task->mutex );
-                task->total_size += size;
-                g_mutex_unlock( task->mutex );
-            }
-            if ( task->abort )
-                goto _exit_thread;
-            if ( task->state == VFS_FILE_TASK_SIZE_TIMEOUT )
-                break;
+            vfs_file_task_error( task, errno, _("Accessing"), task->dest_dir );
+            task->abort = TRUE;
+            goto _exit_thread;
         }
     }
-    else if ( task->type != VFS_FILE_TASK_EXEC )
-    {
-        // start timer to limit the amount of time to spend on this - can be 
-        // VERY slow for network filesystems
-        size_timeout = g_timeout_add_seconds( 5,
-                                       ( GSourceFunc ) on_size_timeout, task );
-        if ( task->type != VFS_FILE_TASK_CHMOD_CHOWN )
-        {
-            if ( !( task->dest_dir && stat64( task->dest_dir, &file_stat ) == 0 ) )
-            {
-                vfs_file_task_error( task, errno, _("Accessing"), task->dest_dir );
-                task->abort = TRUE;
-                goto _exit_thread;
-            }
-            dest_dev = file_stat.st_dev;
-        }
 
+    /* Calculate total size of all files while running */
+    if ( task->type == VFS_FILE_TASK_DELETE && delete_threads > 0 )
+    {
+        // the delete pool reads the dirs and counts the items itself, since
+        // it doesn't stat the files - a size thread would only walk the tree
+        // while it's removed.  Just find the devices for the smart queue
+        task->item_progress = TRUE;
         for ( l = task->src_paths; l; l = l->next )
         {
-            if ( lstat64( ( char* ) l->data, &file_stat ) == -1 )
-            {
-                // don't report error here since it's reported later
-                //vfs_file_task_error( task, errno, _("Accessing"), ( char* ) l->data );
-            }
-            else
-            {
-                /*
-                // sfm why does this code change task->recursive back and forth?
-                if ( S_ISLNK( file_stat.st_mode ) )      // Don't do deep copy for symlinks
-                    task->recursive = FALSE;
-                else if ( task->type == VFS_FILE_TASK_MOVE || task->type == VFS_FILE_TASK_TRASH )
-                    task->recursive = ( file_stat.st_dev != dest_dev );
-                else
-                    task->recursive = FALSE;
-                if ( task->recursive )
-                */
-                if ( ( task->type == VFS_FILE_TASK_MOVE ||
-                                                task->type == VFS_FILE_TASK_TRASH )
-                                                && file_stat.st_dev != dest_dev )
-                {
-                    // recursive size
-                    size = 0;
-                    get_total_size_of_dir( task, ( char* ) l->data, &size, &file_stat );
-                    g_mutex_lock( task->mutex );
-                    task->total_size += size;
-                    g_mutex_unlock( task->mutex );
-                }
-                else
-                {
-                    g_mutex_lock( task->mutex );
-                    task->total_size += file_stat.st_size;
-                    g_mutex_unlock( task->mutex );
-                }
-            }
-            if ( task->abort )
-                goto _exit_thread;
-            if ( task->state == VFS_FILE_TASK_SIZE_TIMEOUT )
-                break;
+            if ( lstat64( (char*)l->data, &file_stat ) == 0 )
+                add_task_dev( task, file_stat.st_dev );
         }
     }
+    else if ( task->type != VFS_FILE_TASK_EXEC )
+    {
+        if ( plan_mem_limit && ( task->recursive ||
+                                    task->type == VFS_FILE_TASK_MOVE ||
+                                    task->type == VFS_FILE_TASK_TRASH ) )
+            task->plan = plan_new();
+        task->size_scanning = TRUE;
+        if ( !( task->size_thread = g_thread_create(
+                                    (GThreadFunc)vfs_file_task_size_thread,
+                                    task, TRUE, NULL ) ) )
+            task->size_scanning = FALSE;
+    }
 
     if ( task->dest_dir && stat64( task->dest_dir, &file_stat ) != -1 )
         add_task_dev( task, file_stat.st_dev );
 
-    if ( task->abort )
-        goto _exit_thread;
-
-    // cancel the timer
-    if ( size_timeout )
-        g_source_remove_by_user_data( task );
-
     if ( task->state_pause == VFS_FILE_TASK_QUEUE )
     {
-        if ( task->state != VFS_FILE_TASK_SIZE_TIMEOUT && xset_get_b( "task_q_smart" ) )
+        // the smart queue needs the devices and size - wait up to 5 seconds
+        for ( i = 0; i < 100 && task->size_scanning && !task->abort; i++ )
+            g_usleep( 50000 );
+        if ( !task->size_scanning && xset_get_b( "task_q_smart" ) )
         {
             // make queue exception for smaller tasks
             off64_t exlimit;
@@ -2191,24 +3267,43 @@ static gpointer vfs_file_task_thread ( VFSFileTask* task )
         // device list is populated so signal queue start
         task->queue_start = TRUE;
     }
-    
-    if ( task->state == VFS_FILE_TASK_SIZE_TIMEOUT )
-    {
-        append_add_log( task, _("Timed out calculating total size\n"), -1 );
-        task->total_size = 0;
-    }
+    if ( task->abort )
+        goto _exit_thread;
     task->state = VFS_FILE_TASK_RUNNING;
     if ( should_abort( task ) )
         goto _exit_thread;
 
+    if ( task->type == VFS_FILE_TASK_COPY && copy_threads > 1 )
+        task->copy_pool = copy_pool_new( task );
+    else if ( task->type == VFS_FILE_TASK_DELETE && delete_threads > 0 )
+        task->delete_pool = delete_pool_new( task, delete_threads );
     g_list_foreach( task->src_paths,
                     funcs[ task->type ],
                     task );
+    if ( task->copy_pool )
+    {
+        copy_pool_finish( (CopyPool*)task->copy_pool );
+        task->copy_pool = NULL;
+    }
+    if ( task->delete_pool )
+    {
+        delete_pool_free( (DeletePool*)task->delete_pool );
+        task->delete_pool = NULL;
+    }
 
 _exit_thread:
     task->state = VFS_FILE_TASK_RUNNING;
-    if ( size_timeout )
-        g_source_remove_by_user_data( task );
+    if ( task->size_thread )
+    {
+        task->size_cancel = TRUE;
+        g_thread_join( task->size_thread );
+        task->size_thread = NULL;
+    }
+    if ( task->plan )
+    {
+        plan_free( (TransferPlan*)task->plan );
+        task->plan = NULL;
+    }
     if ( task->state_cb )
     {
         call_state_callback( task, VFS_FILE_TASK_FINISH );
@@ -2275,7 +3370,7 @@ VFSFileTask* vfs_task_new ( VFSFileTaskType type,
     task->exec_cond = NULL;
     task->exec_ptask = NULL;
     
-    task->pause_cond = NULL;
+    task->pause_cond = g_cond_new();
     task->state_pause = VFS_FILE_TASK_RUNNING;
     task->queue_start = FALSE;
     task->devs = NULL;
@@ -2407,6 +3502,7 @@ void vfs_file_task_free ( VFSFileTask* task )
         g_free(task->exec_script );
 
     g_mutex_free( task->mutex );
+    g_cond_free( task->pause_cond );
     
     gtk_text_buffer_set_text( task->add_log_buf, "", -1 );
     g_object_unref( task->add_log_buf );
@@ -2437,25 +3533,46 @@ void add_task_dev( VFSFileTask* task, dev_t dev )
 }
 
 /*
-* void get_total_size_of_dir( const char* path, off_t* size )
-* Recursively count total size of all files in the specified directory.
-* If the path specified is a file, the size of the file is directly returned.
-* cancel is used to cancel the operation. This function will check the value
-* pointed by cancel in every iteration. If cancel is set to TRUE, the
-* calculation is cancelled.
-* NOTE: *size should be set to zero before calling this function.
+* void get_total_size_of_dir( VFSFileTask* task, const char* path,
+*                             struct stat64* have_stat, guint32 node )
+* Recursively add the size of all files in the specified directory to
+* task->total_size, and count them in task->total_items.
+* If the path specified is a file, the size of the file is directly added.
+* If node is the plan record of path, the listing of each dir is recorded.
+* This function checks task->size_cancel in every iteration. If it is set
+* to TRUE, the calculation is cancelled.
 */
+static void add_total( VFSFileTask* task, off64_t size )
+{
+    __sync_fetch_and_add( &task->total_size, size );
+    g_atomic_int_inc( (gint*)&task->total_items );
+}
+
+typedef struct
+{
+    char* path;
+    guint32 node;
+    struct stat64 file_stat;
+} SizeDir;
+
 void get_total_size_of_dir( VFSFileTask* task,
                             const char* path,
-                            off64_t* size,
-                            struct stat64* have_stat )
+                            struct stat64* have_stat,
+                            guint32 node )
 {
     GDir * dir;
     const char* name;
     char* full_path;
     struct stat64 file_stat;
-
-    if ( task->abort )
+    TransferPlan* plan = (TransferPlan*)task->plan;
+    GArray* subdirs;
+    SizeDir* sub;
+    guint32 child;
+    guint32 children = 0;
+    guint32 n = 0;
+    guint i;
+
+    if ( task->abort || task->size_cancel )
         return;
 
     if ( have_stat )
@@ -2463,7 +3580,7 @@ void get_total_size_of_dir( VFSFileTask* task,
     else if ( lstat64( path, &file_stat ) == -1 )
         return;
 
-    *size += file_stat.st_size;
+    add_total( task, file_stat.st_size );
 
     // remember device for smart queue
     if ( !task->devs )
@@ -2476,24 +3593,53 @@ void get_total_size_of_dir( VFSFileTask* task,
         return;
 
     dir = g_dir_open( path, 0, NULL );
-    if ( dir )
+    if ( !dir )
+        return;
+    // record the whole listing before descending so the children of a
+    // dir are contiguous in the plan
+    subdirs = g_array_new( FALSE, FALSE, sizeof( SizeDir ) );
+    while ( (name = g_dir_read_name( dir )) )
     {
-        while ( (name = g_dir_read_name( dir )) )
+        if ( task->size_cancel || task->abort )
+        {
+            node = 0;
+            break;
+        }
+        full_path = g_build_filename( path, name, NULL );
+        if ( lstat64( full_path, &file_stat ) != -1 )
         {
-            if ( task->state == VFS_FILE_TASK_SIZE_TIMEOUT || task->abort )
-                break;
-            full_path = g_build_filename( path, name, NULL );
-            if ( lstat64( full_path, &file_stat ) != -1 )
+            child = node ? plan_add( plan, name, &file_stat ) : 0;
+            if ( !child )
+                node = 0;  // leave the transfer to read this dir
+            else if ( !n++ )
+                children = child;
+            if ( S_ISDIR( file_stat.st_mode ) )
             {
-                if ( S_ISDIR( file_stat.st_mode ) )
-                    get_total_size_of_dir( task, full_path, size, &file_stat );
-                else
-                    *size += file_stat.st_size;
+                g_array_set_size( subdirs, subdirs->len + 1 );
+                sub = &g_array_index( subdirs, SizeDir, subdirs->len - 1 );
+                sub->path = full_path;
+                sub->node = child;
+                sub->file_stat = file_stat;
+                continue;
             }
-            g_free(full_path );
+            add_total( task, file_stat.st_size );
         }
-        g_dir_close( dir );
+        else
+            node = 0;  // let the transfer report the error
+        g_free( full_path );
+    }
+    g_dir_close( dir );
+    if ( node )
+        plan_set_children( plan, node, children, n );
+
+    for ( i = 0; i < subdirs->len; i++ )
+    {
+        sub = &g_array_index( subdirs, SizeDir, i );
+        get_total_size_of_dir( task, sub->path, &sub->file_stat,
+                                                    node ? sub->node : 0 );
+        g_free( sub->path );
     }
+    g_array_free( subdirs, TRUE );
 }
 
 void vfs_file_task_set_recursive( VFSFileTask* task, gboolean recursive )
@@ -2526,7 +3672,11 @@ void vfs_file_task_set_state_callback( VFSFileTask* task,
 void vfs_file_task_error( VFSFileTask* task, int errnox, const char* action,
                                                             const char* target )
 {
+    /* copy and delete workers may report errors at the same time.  The
+     * callback takes task->mutex itself, and may wait for the gdk lock */
+    g_mutex_lock( task->mutex );
     task->error = errnox;
+    g_mutex_unlock( task->mutex );
     char* msg = g_strdup_printf( _("\n%s %s\nError: %s\n"), action, target,
                                                         g_strerror( errnox ) );
     append_add_log( task, msg, -1 );
@@ -2534,3 +3684,147 @@ void vfs_file_task_error( VFSFileTask* task, int errnox, const char* action,
     call_state_callback( task, VFS_FILE_TASK_ERROR );
 }
 
+
+/* MB/s copying src_file next to itself with each copy method, for
+ * comparing file systems */
+void vfs_file_task_bench_copy( const char* src_file )
+{
+    VFSFileTask* task;
+    GTimer* timer;
+    char* dest_file;
+    char* dir;
+    struct stat64 file_stat;
+    int method, used_method, rfd, wfd;
+    gboolean ok;
+    gdouble secs;
+
+    if ( stat64( src_file, &file_stat ) == -1 || !S_ISREG( file_stat.st_mode ) )
+    {
+        printf( "spacefm: %s is not a file\n", src_file );
+        return;
+    }
+    dir = g_path_get_dirname( src_file );
+    task = vfs_task_new( VFS_FILE_TASK_COPY, NULL, dir );
+    g_free( dir );
+    dest_file = g_strdup_printf( "%s.spacefm-bench-copy", src_file );
+    timer = g_timer_new();
+
+    printf( "%s: %" G_GINT64_FORMAT " bytes\n", src_file,
+                                                (gint64)file_stat.st_size );
+    for ( method = 0; method < N_COPY_METHODS; method++ )
+    {
+        if ( ( rfd = open( src_file, O_RDONLY ) ) == -1 )
+            break;
+        if ( ( wfd = creat( dest_file, 0600 ) ) == -1 )
+        {
+            close( rfd );
+            printf( "spacefm: cannot create %s\n", dest_file );
+            break;
+        }
+        task->progress = 0;
+        used_method = method;
+        g_timer_start( timer );
+        ok = copy_file_data( task, rfd, wfd, &used_method, src_file, dest_file )
+                                                        && fsync( wfd ) == 0;
+        secs = g_timer_elapsed( timer, NULL );
+        close( wfd );
+        close( rfd );
+        unlink( dest_file );
+        if ( !ok )
+            printf( "%-16s failed\n", copy_method_names[ method ] );
+        else if ( used_method != method )
+            printf( "%-16s unsupported (used %s)\n",
+                                            copy_method_names[ method ],
+                                            copy_method_names[ used_method ] );
+        else
+            printf( "%-16s %10.1f MB/s\n", copy_method_names[ method ],
+                            file_stat.st_size / MAX( secs, 1e-9 ) / 1000000 );
+    }
+    g_timer_destroy( timer );
+    g_free( dest_file );
+    vfs_file_task_free( task );
+}
+
+/* makes a tree of about entries entries under root, in groups of a dir
+ * with 9 subdirs of 110 empty files */
+static gboolean bench_delete_make_tree( const char* root, int entries )
+{
+    int g, d, f, fd;
+    char* path;
+    gboolean ok = mkdir( root, 0700 ) == 0;
+
+    for ( g = 0; ok && g < MAX( entries / 1000, 1 ); g++ )
+    {
+        path = g_strdup_printf( "%s/g%d", root, g );
+        ok = mkdir( path, 0700 ) == 0;
+        g_free( path );
+        for ( d = 0; ok && d < 9; d++ )
+        {
+            path = g_strdup_printf( "%s/g%d/d%d", root, g, d );
+            ok = mkdir( path, 0700 ) == 0;
+            g_free( path );
+            for ( f = 0; ok && f < 110; f++ )
+            {
+                path = g_strdup_printf( "%s/g%d/d%d/f%d", root, g, d, f );
+                if ( ( fd = creat( path, 0600 ) ) == -1 )
+                    ok = FALSE;
+                else
+                    close( fd );
+                g_free( path );
+            }
+        }
+    }
+    return ok;
+}
+
+void vfs_file_task_bench_delete( const char* dir, int entries )
+{
+    VFSFileTask* task;
+    DeletePool* pool;
+    GTimer* timer;
+    char* root;
+    int threads;
+    gdouble secs;
+    const int runs[] = { 0, 1, 4, 8 };
+    guint i;
+
+    root = g_build_filename( dir, "spacefm-bench-delete", NULL );
+    task = vfs_task_new( VFS_FILE_TASK_DELETE, NULL, NULL );
+    timer = g_timer_new();
+
+    for ( i = 0; i < G_N_ELEMENTS( runs ); i++ )
+    {
+        threads = runs[ i ];
+        if ( !bench_delete_make_tree( root, entries ) )
+        {
+            printf( "spacefm: cannot create tree in %s\n", root );
+            break;
+        }
+        sync();
+        task->current_item = 0;
+        g_timer_start( timer );
+        if ( threads == 0 )
+            vfs_file_task_do_delete( task, root, 0 );
+        else
+        {
+            pool = delete_pool_new( task, threads );
+            delete_pool_delete( pool, root );
+            delete_pool_free( pool );
+        }
+        secs = g_timer_elapsed( timer, NULL );
+        if ( g_file_test( root, G_FILE_TEST_EXISTS ) )
+        {
+            printf( "spacefm: %s was not deleted\n", root );
+            break;
+        }
+        if ( threads == 0 )
+            printf( "path based      " );
+        else
+            printf( "unlinkat x%-5d ", threads );
+        printf( "%8.2f s %10.0f entries/s\n", secs,
+                                    task->current_item / MAX( secs, 1e-9 ) );
+    }
+    g_timer_destroy( timer );
+    g_free( root );
+    vfs_file_task_free( task );
+}
@@ -110,6 +110,14 @@ struct _VFSFileTask
     guchar *chmod_actions;  /* If chmod is not needed, this should be NULL */
 
     off64_t total_size; /* Total size of the files to be processed, in bytes */
+    guint total_items; /* Number of files found so far by the size thread,
+                          or by the delete pool */
+    gboolean size_scanning; /* size thread is still adding to total_size */
+    gboolean size_cancel;
+    GThread* size_thread;
+    gpointer plan;  /* tree listing recorded by the size thread */
+    gboolean item_progress; /* progress is counted in current_item, not
+                               in bytes */
     off64_t progress; /* Total size of current processed files, in btytes */
     int percent; /* progress (percentage) */
     gboolean custom_percent;
@@ -141,6 +149,8 @@ struct _VFSFileTask
     gpointer state_cb_data;
     
     GMutex* mutex;
+    gpointer copy_pool;     /* workers copying files while copying a tree */
+    gpointer delete_pool;   /* workers deleting the dirs of a tree */
 
     //sfm write directly to gtk buffer for speed
     GtkTextBuffer* add_log_buf;
@@ -226,4 +236,13 @@ void vfs_file_task_kill_cpids( char* cpids, int signal );
 char* vfs_file_task_get_unique_name( const char* dest_dir, const char* base_name,
                                                            const char* ext );
 
+void vfs_file_task_bench_copy( const char* src_file );
+
+/* Copy files with this many threads, or one at a time if 1 (default 4) */
+void vfs_file_task_set_copy_threads( int threads );
+void vfs_file_task_set_plan_mem( int mb );
+void vfs_file_task_set_plan_spill( gboolean spill );
+void vfs_file_task_set_delete_threads( int threads );
+void vfs_file_task_bench_delete( const char* dir, int entries );
+
 #endif
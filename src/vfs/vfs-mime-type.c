@@ -87,6 +87,7 @@ static void on_mime_cache_changed( VFSFileMonitor* fm,
         if( ! cache->buffer )
             return;
     case VFS_FILE_MONITOR_CHANGE:
+    case VFS_FILE_MONITOR_RESCAN:
         mime_cache_reload( cache );
         /* g_debug( "reload cache: %s", file_name ); */
         if( 0 == reload_callback_id )
@@ -166,6 +167,15 @@ VFSMimeType* vfs_mime_type_get_from_file( const char* file_path,
     return vfs_mime_type_get_from_type( type );
 }
 
+VFSMimeType* vfs_mime_type_get_from_file_lazy( const char* file_path,
+                                               const char* base_name,
+                                               struct stat64* pstat )
+{
+    const char * type;
+    type = mime_type_get_by_file_lazy( file_path, pstat, base_name );
+    return type ? vfs_mime_type_get_from_type( type ) : NULL;
+}
+
 VFSMimeType* vfs_mime_type_get_from_type( const char* type )
 {
     VFSMimeType * mime_type;
@@ -176,9 +186,14 @@ VFSMimeType* vfs_mime_type_get_from_type( const char* type )
 
     if ( !mime_type )
     {
-        mime_type = vfs_mime_type_new( type );
         g_static_rw_lock_writer_lock( &mime_hash_lock );
-        g_hash_table_insert( mime_hash, mime_type->type, mime_type );
+        /* another loader thread may have added it meanwhile */
+        mime_type = g_hash_table_lookup( mime_hash, type );
+        if ( !mime_type )
+        {
+            mime_type = vfs_mime_type_new( type );
+            g_hash_table_insert( mime_hash, mime_type->type, mime_type );
+        }
         g_static_rw_lock_writer_unlock( &mime_hash_lock );
     }
     vfs_mime_type_ref( mime_type );
@@ -44,6 +44,11 @@ VFSMimeType* vfs_mime_type_get_from_file( const char* file_path,  /* Should be o
                                           const char* base_name,  /* Should be in UTF-8 */
                                           struct stat64* pstat );   /* Can be NULL */
 
+/* returns NULL if the contents of the file have to be sniffed */
+VFSMimeType* vfs_mime_type_get_from_file_lazy( const char* file_path,
+                                               const char* base_name,
+                                               struct stat64* pstat );
+
 VFSMimeType* vfs_mime_type_get_from_type( const char* type );
 
 VFSMimeType* vfs_mime_type_new( const char* type_name );
@@ -24,9 +24,20 @@
 #include "vfs-thumbnail-loader.h"
 #include "glib-mem.h" /* for g_slice API */
 #include "glib-utils.h" /* for g_mkdir_with_parents() */
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
 #ifdef HAVE_FFMPEG
 #include <libffmpegthumbnailer/videothumbnailerc.h>
 #endif
@@ -35,13 +46,19 @@
     #include "md5.h"    /* for thumbnails */
 #endif
 
+/* Thumbnails of all dirs are loaded by one process-wide pool of threads.
+ * Pending requests are kept in a heap: requests for rows being drawn (see
+ * vfs_thumbnail_loader_raise) come first, most recently drawn first, then
+ * the others in the order they were requested.  A file has at most one
+ * request, found with file_requests. */
+#define THUMBNAIL_MAX_THREADS 8
+
 struct _VFSThumbnailLoader
 {
     VFSDir* dir;
-    GQueue* queue;
-    VFSAsyncTask* task;
+    guint n_pending;        /* requests queued or being loaded */
     guint idle_handler;
-    GQueue* update_queue;
+    GQueue* update_queue;   /* loaded files waiting for the idle handler */
 };
 
 enum
@@ -55,11 +72,26 @@ typedef struct _ThumbnailRequest
 {
     int n_requests[ N_LOAD_TYPES ];
     VFSFileInfo* file;
+    VFSThumbnailLoader* loader;
+    guint64 seq;            /* when requested, or drawn if visible */
+    gboolean visible;
+    int heap_index;         /* -1 while being loaded */
 }
 ThumbnailRequest;
 
-static gpointer thumbnail_loader_thread( VFSAsyncTask* task, VFSThumbnailLoader* loader );
-/* static void on_load_finish( VFSAsyncTask* task, gboolean is_cancelled, VFSThumbnailLoader* loader ); */
+/* the pool and all loaders are protected by pool_mutex */
+static GMutex* pool_mutex = NULL;
+static GCond* pool_cond = NULL;
+static GPtrArray* pool_heap = NULL;
+static GHashTable* file_requests = NULL;
+static guint64 request_seq = 0;
+static int n_threads = 0;
+static int n_idle_threads = 0;
+
+static gboolean thumbnail_use_helper = TRUE;
+static gboolean thumbnail_is_helper = FALSE;    /* in spacefm --thumbnailer */
+
+static gpointer thumbnail_pool_thread( gpointer data );
 static void thumbnail_request_free( ThumbnailRequest* req );
 static gboolean on_thumbnail_idle( VFSThumbnailLoader* loader );
 
@@ -69,13 +101,11 @@ VFSThumbnailLoader* vfs_thumbnail_loader_new( VFSDir* dir )
     VFSThumbnailLoader* loader = g_slice_new0( VFSThumbnailLoader );
     loader->idle_handler = 0;
     loader->dir = g_object_ref( dir );
-    loader->queue = g_queue_new();
     loader->update_queue = g_queue_new();
-    loader->task = vfs_async_task_new( (VFSAsyncFunc)thumbnail_loader_thread, loader );
-    /* g_signal_connect( loader->task, "finish", G_CALLBACK(on_load_finish), loader ); */
     return loader;
 }
 
+/* the loader must have no pending requests */
 void vfs_thumbnail_loader_free( VFSThumbnailLoader* loader )
 {
     if( loader->idle_handler )
@@ -84,23 +114,6 @@ void vfs_thumbnail_loader_free( VFSThumbnailLoader* loader )
         loader->idle_handler = 0;
     }
 
-    /* g_signal_handlers_disconnect_by_func( loader->task, on_load_finish, loader ); */
-    /* stop the running thread, if any. */
-    vfs_async_task_cancel( loader->task );
-
-    if( loader->idle_handler )
-    {
-        g_source_remove( loader->idle_handler );
-        loader->idle_handler = 0;
-    }
-
-    g_object_unref( loader->task );
-
-    if( loader->queue )
-    {
-        g_queue_foreach( loader->queue, (GFunc) thumbnail_request_free, NULL );
-        g_queue_free( loader->queue );
-    }
     if( loader->update_queue )
     {
         g_queue_foreach( loader->update_queue, (GFunc) vfs_file_info_unref, NULL );
@@ -111,15 +124,9 @@ void vfs_thumbnail_loader_free( VFSThumbnailLoader* loader )
     /* prevent recursive unref called from vfs_dir_finalize */
     loader->dir->thumbnail_loader = NULL;
     g_object_unref( loader->dir );
+    g_slice_free( VFSThumbnailLoader, loader );
 }
 
-#if 0  /* This is not used in the program. For debug only */
-void on_load_finish( VFSAsyncTask* task, gboolean is_cancelled, VFSThumbnailLoader* loader )
-{
-    g_debug( "TASK FINISHED" );
-}
-#endif
-
 void thumbnail_request_free( ThumbnailRequest* req )
 {
     vfs_file_info_unref( req->file );
@@ -127,30 +134,103 @@ void thumbnail_request_free( ThumbnailRequest* req )
     /* g_debug( "FREE REQUEST!" ); */
 }
 
+/* TRUE if request a should be loaded before b */
+static inline gboolean thumbnail_request_before( ThumbnailRequest* a,
+                                                 ThumbnailRequest* b )
+{
+    if ( a->visible != b->visible )
+        return a->visible;
+    return a->visible ? a->seq > b->seq : a->seq < b->seq;
+}
+
+static inline void thumbnail_heap_set( guint i, ThumbnailRequest* req )
+{
+    pool_heap->pdata[i] = req;
+    req->heap_index = i;
+}
+
+static void thumbnail_heap_sift_up( guint i )
+{
+    ThumbnailRequest* req = (ThumbnailRequest*)pool_heap->pdata[i];
+    guint parent;
+
+    while ( i > 0 )
+    {
+        parent = ( i - 1 ) / 2;
+        if ( !thumbnail_request_before( req, pool_heap->pdata[parent] ) )
+            break;
+        thumbnail_heap_set( i, pool_heap->pdata[parent] );
+        i = parent;
+    }
+    thumbnail_heap_set( i, req );
+}
+
+static void thumbnail_heap_sift_down( guint i )
+{
+    ThumbnailRequest* req = (ThumbnailRequest*)pool_heap->pdata[i];
+    guint child;
+
+    while ( ( child = i * 2 + 1 ) < pool_heap->len )
+    {
+        if ( child + 1 < pool_heap->len &&
+                    thumbnail_request_before( pool_heap->pdata[child + 1],
+                                              pool_heap->pdata[child] ) )
+            child++;
+        if ( !thumbnail_request_before( pool_heap->pdata[child], req ) )
+            break;
+        thumbnail_heap_set( i, pool_heap->pdata[child] );
+        i = child;
+    }
+    thumbnail_heap_set( i, req );
+}
+
+static void thumbnail_heap_remove( ThumbnailRequest* req )
+{
+    guint i = req->heap_index;
+    ThumbnailRequest* last = (ThumbnailRequest*)g_ptr_array_remove_index(
+                                            pool_heap, pool_heap->len - 1 );
+
+    req->heap_index = -1;
+    if ( last == req )
+        return;
+    thumbnail_heap_set( i, last );
+    thumbnail_heap_sift_up( i );
+    thumbnail_heap_sift_down( last->heap_index );
+}
+
 gboolean on_thumbnail_idle( VFSThumbnailLoader* loader )
 {
     VFSFileInfo* file;
+    GList* updates;
+    GList* l;
+    gboolean done;
 
     /* g_debug( "ENTER ON_THUMBNAIL_IDLE" ); */
-    vfs_async_task_lock( loader->task );
+    g_mutex_lock( pool_mutex );
+    updates = loader->update_queue->head;
+    loader->update_queue->head = loader->update_queue->tail = NULL;
+    loader->update_queue->length = 0;
+    loader->idle_handler = 0;
+    g_mutex_unlock( pool_mutex );
 
-    while( ( file = (VFSFileInfo*)g_queue_pop_head(loader->update_queue) )  )
+    for( l = updates; l; l = l->next )
     {
+        file = (VFSFileInfo*)l->data;
         GDK_THREADS_ENTER();
         vfs_dir_emit_thumbnail_loaded( loader->dir, file );
         vfs_file_info_unref( file );
         GDK_THREADS_LEAVE();
     }
+    g_list_free( updates );
 
-    loader->idle_handler = 0;
-
-    vfs_async_task_unlock( loader->task );
-
-    if( vfs_async_task_is_finished( loader->task ) )
+    /* the handlers above may have made new requests */
+    g_mutex_lock( pool_mutex );
+    done = loader->n_pending == 0 && !loader->idle_handler;
+    g_mutex_unlock( pool_mutex );
+    if( done )
     {
         /* g_debug( "FREE LOADER IN IDLE HANDLER" ); */
-        loader->dir->thumbnail_loader = NULL;
-        vfs_thumbnail_loader_free(loader);
+        vfs_thumbnail_loader_free( loader );
     }
     /* g_debug( "LEAVE ON_THUMBNAIL_IDLE" ); */
 
@@ -166,91 +246,85 @@ void on_video_thumbnailer_log_message(ThumbnailerLogLevel lvl, const char* msg)
 }
 #endif
 
-gpointer thumbnail_loader_thread( VFSAsyncTask* task, VFSThumbnailLoader* loader )
+gpointer thumbnail_pool_thread( gpointer data )
 {
     ThumbnailRequest* req;
+    VFSThumbnailLoader* loader;
+    char* full_path;
+    gboolean load[ N_LOAD_TYPES ];
+    gboolean loaded[ N_LOAD_TYPES ];
+    gboolean need_update;
+    gboolean more;
     int i;
-    gboolean load_big, need_update;
 
-    while( G_LIKELY( ! vfs_async_task_is_cancelled(task) ))
+    g_mutex_lock( pool_mutex );
+    while( TRUE )
     {
-        vfs_async_task_lock( task );
-        req = (ThumbnailRequest*)g_queue_pop_head( loader->queue );
-        vfs_async_task_unlock( task );
-        if( G_UNLIKELY( ! req ) )
-            break;
-        /* g_debug("pop: %s", req->file->name); */
-
-        /* Only we have the reference. That means, no body is using the file */
-        if( req->file->n_ref == 1 )
+        while ( pool_heap->len == 0 )
         {
-            thumbnail_request_free( req );
-            continue;
+            n_idle_threads++;
+            g_cond_wait( pool_cond, pool_mutex );
+            n_idle_threads--;
         }
-
+        req = (ThumbnailRequest*)pool_heap->pdata[0];
+        thumbnail_heap_remove( req );
+        loader = req->loader;
+        /* g_debug("pop: %s", req->file->name); */
+        full_path = g_build_filename( loader->dir->path,
+                                      vfs_file_info_get_name( req->file ),
+                                      NULL );
         need_update = FALSE;
-        for ( i = 0; i < 2; ++i )
+        for ( i = 0; i < N_LOAD_TYPES; ++i )
+            loaded[i] = FALSE;
+        /* a request for the other size made while this one is loaded is
+         * merged into it, so look again before it's dropped */
+        while ( TRUE )
         {
-            if ( 0 == req->n_requests[ i ] )
-                continue;
-
-            load_big = ( i == LOAD_BIG_THUMBNAIL );
-            if ( ! vfs_file_info_is_thumbnail_loaded( req->file, load_big ) )
+            more = FALSE;
+            for ( i = 0; i < N_LOAD_TYPES; ++i )
             {
-                char* full_path;
-                full_path = g_build_filename( loader->dir->path,
-                                              vfs_file_info_get_name( req->file ),
-                                              NULL );
-                vfs_file_info_load_thumbnail( req->file, full_path, load_big );
-                g_free( full_path );
-                /*  Slow donwn for debugging.
-                g_debug( "DELAY!!" );
-                g_usleep(G_USEC_PER_SEC/2);
-                */
-
-                /* g_debug( "thumbnail loaded: %s", req->file ); */
+                load[i] = req->n_requests[i] > 0 && !loaded[i];
+                more = more || load[i];
             }
-            need_update = TRUE;
-        }
+            if ( !more )
+                break;
+            g_mutex_unlock( pool_mutex );
 
-        if( ! vfs_async_task_is_cancelled(task) && need_update )
-        {
-            vfs_async_task_lock( task );
-            g_queue_push_tail( loader->update_queue, vfs_file_info_ref(req->file) );
-            if( 0 == loader->idle_handler)
+            for ( i = 0; i < N_LOAD_TYPES; ++i )
             {
-                loader->idle_handler = g_idle_add_full( G_PRIORITY_LOW, (GSourceFunc) on_thumbnail_idle, loader, NULL );
+                if ( !load[i] )
+                    continue;
+                loaded[i] = TRUE;
+                /* Only we have the reference. That means, no body is using
+                 * the file */
+                if ( g_atomic_int_get( &req->file->n_ref ) <= 1 )
+                    continue;
+                if ( ! vfs_file_info_is_thumbnail_loaded( req->file,
+                                                    i == LOAD_BIG_THUMBNAIL ) )
+                    vfs_file_info_load_thumbnail( req->file, full_path,
+                                                    i == LOAD_BIG_THUMBNAIL );
+                need_update = TRUE;
             }
-            vfs_async_task_unlock( task );
+            g_mutex_lock( pool_mutex );
         }
+        g_free( full_path );
+
+        g_hash_table_remove( file_requests, req->file );
+        if ( need_update )
+            g_queue_push_tail( loader->update_queue,
+                                            vfs_file_info_ref( req->file ) );
+        loader->n_pending--;
+        /* the idle handler also frees the loader once it's done */
+        if ( !loader->idle_handler && ( need_update || !loader->n_pending ) )
+            loader->idle_handler = g_idle_add_full( G_PRIORITY_LOW,
+                                    (GSourceFunc) on_thumbnail_idle, loader,
+                                    NULL );
         /* g_debug( "NEED_UPDATE: %d", need_update ); */
+        g_mutex_unlock( pool_mutex );
         thumbnail_request_free( req );
+        g_mutex_lock( pool_mutex );
     }
-
-    if( vfs_async_task_is_cancelled(task) )
-    {
-        /* g_debug( "THREAD CANCELLED!!!" ); */
-        vfs_async_task_lock( task );
-        if( loader->idle_handler)
-        {
-            g_source_remove( loader->idle_handler );
-            loader->idle_handler = 0;
-        }
-        vfs_async_task_unlock( task );
-    }
-    else
-    {
-        if( 0 == loader->idle_handler)
-        {
-            /* g_debug( "ADD IDLE HANDLER BEFORE THREAD ENDING" ); */
-            /* FIXME: add2 This source always causes a "Source ID was not
-             * found" critical warning if removed in vfs_thumbnail_loader_free.
-             * Where is this being removed?  See comment in
-             * vfs_thumbnail_loader_cancel_all_requests. */
-            loader->idle_handler = g_idle_add_full( G_PRIORITY_LOW, (GSourceFunc) on_thumbnail_idle, loader, NULL );
-        }
-    }
-    /* g_debug("THREAD ENDED!");  */
+    g_mutex_unlock( pool_mutex );
     return NULL;
 }
 
@@ -258,156 +332,721 @@ void vfs_thumbnail_loader_request( VFSDir* dir, VFSFileInfo* file, gboolean is_b
 {
     VFSThumbnailLoader* loader;
     ThumbnailRequest* req;
-    gboolean new_task = FALSE;
-    GList* l;
+    char* full_path;
+    gboolean cached = FALSE;
+    long n;
 
     /* g_debug( "request thumbnail: %s, is_big: %d", file->name, is_big ); */
-    if( G_UNLIKELY( ! dir->thumbnail_loader ) )
+    if( G_UNLIKELY( ! pool_mutex ) )
     {
-        dir->thumbnail_loader = vfs_thumbnail_loader_new( dir );
-        new_task = TRUE;
+        pool_mutex = g_mutex_new();
+        pool_cond = g_cond_new();
+        pool_heap = g_ptr_array_sized_new( 1024 );
+        file_requests = g_hash_table_new( g_direct_hash, g_direct_equal );
     }
 
-    loader = dir->thumbnail_loader;
+    full_path = dir->path ? g_build_filename( dir->path,
+                                vfs_file_info_get_name( file ), NULL ) : NULL;
 
-    if( G_UNLIKELY( ! loader->task ) )
-    {
-        loader->task = vfs_async_task_new( (VFSAsyncFunc)thumbnail_loader_thread, loader );
-        new_task = TRUE;
-    }
-    vfs_async_task_lock( loader->task );
+    g_mutex_lock( pool_mutex );
+    if( G_UNLIKELY( ! dir->thumbnail_loader ) )
+        dir->thumbnail_loader = vfs_thumbnail_loader_new( dir );
+    loader = dir->thumbnail_loader;
 
     /* Check if the request is already scheduled */
-    for( l = loader->queue->head; l; l = l->next )
-    {
-        req = (ThumbnailRequest*)l->data;
-        /* If file with the same name is already in our queue */
-        if( req->file == file || 0 == strcmp( req->file->name, file->name ) )
-            break;
-    }
-    if( l )
+    req = (ThumbnailRequest*)g_hash_table_lookup( file_requests, file );
+
+    /* shown before at this size - no need to wait for a thread.  Scaling
+     * one of another size is left to the pool threads.  While a thread has
+     * a request for the file it sets the thumbnails, so leave them to it */
+    if ( !req && full_path )
+        cached = vfs_file_info_load_cached_thumbnail( file, full_path, is_big );
+    g_free( full_path );
+    if ( cached )
     {
-        req = (ThumbnailRequest*)l->data;
+        g_queue_push_tail( loader->update_queue, vfs_file_info_ref( file ) );
+        if ( !loader->idle_handler )
+            loader->idle_handler = g_idle_add_full( G_PRIORITY_LOW,
+                                (GSourceFunc) on_thumbnail_idle, loader,
+                                NULL );
+        g_mutex_unlock( pool_mutex );
+        return;
     }
-    else
+
+    if( ! req )
     {
         req = g_slice_new0( ThumbnailRequest );
         req->file = vfs_file_info_ref(file);
-        g_queue_push_tail( dir->thumbnail_loader->queue, req );
+        req->loader = loader;
+        req->seq = ++request_seq;
+        g_hash_table_insert( file_requests, file, req );
+        g_ptr_array_add( pool_heap, req );
+        thumbnail_heap_sift_up( pool_heap->len - 1 );
+        loader->n_pending++;
+
+        if ( n_idle_threads > 0 )
+            g_cond_signal( pool_cond );
+        else
+        {
+            n = sysconf( _SC_NPROCESSORS_ONLN );
+            if ( n_threads < CLAMP( n, 1, THUMBNAIL_MAX_THREADS ) &&
+                    g_thread_create( thumbnail_pool_thread, NULL, FALSE, NULL ) )
+                n_threads++;
+        }
     }
 
     ++req->n_requests[ is_big ? LOAD_BIG_THUMBNAIL : LOAD_SMALL_THUMBNAIL ];
 
-    vfs_async_task_unlock( loader->task );
+    g_mutex_unlock( pool_mutex );
+}
+
+void vfs_thumbnail_loader_raise( VFSDir* dir, VFSFileInfo* file )
+{
+    ThumbnailRequest* req;
 
-    if( new_task )
-        vfs_async_task_execute( loader->task );
+    if ( !dir->thumbnail_loader )
+        return;
+    g_mutex_lock( pool_mutex );
+    req = (ThumbnailRequest*)g_hash_table_lookup( file_requests, file );
+    if ( req && req->heap_index >= 0 )
+    {
+        req->visible = TRUE;
+        req->seq = ++request_seq;
+        thumbnail_heap_sift_up( req->heap_index );
+    }
+    g_mutex_unlock( pool_mutex );
 }
 
 void vfs_thumbnail_loader_cancel_all_requests( VFSDir* dir, gboolean is_big )
 {
-    GList* l;
     VFSThumbnailLoader* loader;
     ThumbnailRequest* req;
+    GSList* cancelled = NULL;
+    GSList* l;
+    guint i;
+    gboolean done;
 
     if( G_UNLIKELY( (loader=dir->thumbnail_loader) ) )
     {
-        vfs_async_task_lock( loader->task );
+        g_mutex_lock( pool_mutex );
         /* g_debug( "TRY TO CANCEL REQUESTS!!" ); */
-        for( l = loader->queue->head; l;  )
+        for ( i = 0; i < pool_heap->len; i++ )
         {
-            req = (ThumbnailRequest*)l->data;
+            req = (ThumbnailRequest*)pool_heap->pdata[i];
+            if ( req->loader != loader )
+                continue;
             --req->n_requests[ is_big ? LOAD_BIG_THUMBNAIL : LOAD_SMALL_THUMBNAIL ];
 
             if( req->n_requests[0]  <= 0 && req->n_requests[1] <= 0 )   /* nobody needs this */
-            {
-                GList* next = l->next;
-                g_queue_delete_link( loader->queue, l );
-                l = next;
-            }
-            else
-                l = l->next;
+                cancelled = g_slist_prepend( cancelled, req );
+        }
+        for ( l = cancelled; l; l = l->next )
+        {
+            req = (ThumbnailRequest*)l->data;
+            thumbnail_heap_remove( req );
+            g_hash_table_remove( file_requests, req->file );
+            loader->n_pending--;
         }
+        /* requests being loaded finish in the idle handler */
+        done = loader->n_pending == 0 && !loader->idle_handler;
+        g_mutex_unlock( pool_mutex );
 
-        if( g_queue_get_length( loader->queue ) == 0 )
+        g_slist_foreach( cancelled, (GFunc) thumbnail_request_free, NULL );
+        g_slist_free( cancelled );
+        if ( done )
         {
             /* g_debug( "FREE LOADER IN vfs_thumbnail_loader_cancel_all_requests!" ); */
-            vfs_async_task_unlock( loader->task );
-            loader->dir->thumbnail_loader = NULL;
-            
-            /* FIXME: added idle_handler = 0 to prevent idle_handler being
-             * removed in vfs_thumbnail_loader_free - BUT causes a segfault
-             * in vfs_async_task_lock ??
-             * If source is removed here or in vfs_thumbnail_loader_free
-             * it causes a "GLib-CRITICAL **: Source ID N was not found when
-             * attempting to remove it" warning.  Such a source ID is always
-             * the one added in thumbnail_loader_thread at the "add2" comment. */
-            //loader->idle_handler = 0;
-            
             vfs_thumbnail_loader_free( loader );
-            return;
         }
-        vfs_async_task_unlock( loader->task );
     }
 }
 
-static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
-                                                    int size, time_t mtime )
+/* Loaded thumbnails are kept in an LRU bounded by pixel bytes, so the
+ * thumbnails of a folder visited again are shown without disk access.
+ * Keyed by size and path, and only valid for the mtime they were made for.
+ * The thumbnail of the freedesktop tier size it was scaled from is kept too,
+ * keyed by minus that size, so other sizes up to it are made in memory */
+#define THUMBNAIL_CACHE_MAX_BYTES ( 64 * 1024 * 1024 )
+
+/* the ~/.thumbnails dirs by thumbnail size */
+#define N_THUMBNAIL_TIERS 3
+static const int thumbnail_tier_sizes[ N_THUMBNAIL_TIERS ] = { 128, 256, 512 };
+static const char* thumbnail_tier_dirs[ N_THUMBNAIL_TIERS ] =
+                                            { "normal", "large", "x-large" };
+
+typedef struct
 {
-#if GLIB_CHECK_VERSION(2, 16, 0)
-    GChecksum *cs;
-#else
-    md5_state_t md5_state;
-    md5_byte_t md5[ 16 ];
-#endif
-    char file_name[ 40 ];
-    char* thumbnail_file;
-    char mtime_str[ 32 ];
-    const char* thumb_mtime;
-    int i, w, h;
+    char* key;
+    time_t mtime;
+    GdkPixbuf* pixbuf;
+    gsize bytes;
+    GList* link;            /* in thumbnail_lru, most recent first */
+} ThumbnailCacheEntry;
+
+static GHashTable* thumbnail_cache = NULL;
+static GQueue* thumbnail_lru = NULL;
+static gsize thumbnail_cache_bytes = 0;
+G_LOCK_DEFINE_STATIC( thumbnail_cache );
+
+/* Index of the thumbnail files in ~/.thumbnails/normal, mapped from the
+ * user's cache dir and shared by all threads: for each md5 of a file's uri,
+ * the mtime of the file it was made for, its size, and the mtime and size
+ * of the png to detect changes by other programs.  This tells whether a
+ * thumbnail is stale or too small without decoding it. */
+#define THUMBNAIL_INDEX_MAGIC   0x32444954   /* "TID2" */
+#define THUMBNAIL_INDEX_BUCKETS 8192
+#define THUMBNAIL_INDEX_WAYS    4
+
+typedef struct
+{
+    guint8 md5[ 16 ];
+    gint64 mtime;           /* mtime of the file */
+    gint64 thumb_mtime;     /* of the png */
+    guint32 thumb_size;
+    guint16 width;
+    guint16 height;
+    guint32 tier_size;      /* 128 normal, 256 large, 512 x-large */
+} ThumbnailIndexRecord;
+
+typedef struct
+{
+    guint32 magic;
+    guint32 n_buckets;
+    ThumbnailIndexRecord records[ 1 ];
+} ThumbnailIndex;
+
+#define THUMBNAIL_INDEX_SIZE ( G_STRUCT_OFFSET( ThumbnailIndex, records ) + \
+    THUMBNAIL_INDEX_BUCKETS * THUMBNAIL_INDEX_WAYS * sizeof( ThumbnailIndexRecord ) )
+
+/* shared by all spacefm instances, so it's also locked with flock */
+static ThumbnailIndex* thumbnail_index = NULL;
+static int thumbnail_index_fd = -1;
+G_LOCK_DEFINE_STATIC( thumbnail_index );
+
+static void thumbnail_index_lock( gboolean write )
+{
+    G_LOCK( thumbnail_index );
+    while ( flock( thumbnail_index_fd, write ? LOCK_EX : LOCK_SH ) == -1 &&
+                                                            errno == EINTR );
+}
+
+static void thumbnail_index_unlock()
+{
+    flock( thumbnail_index_fd, LOCK_UN );
+    G_UNLOCK( thumbnail_index );
+}
+
+static void thumbnail_cache_entry_free( ThumbnailCacheEntry* entry )
+{
+    g_free( entry->key );
+    g_object_unref( entry->pixbuf );
+    g_slice_free( ThumbnailCacheEntry, entry );
+}
+
+/* returns a new reference, or NULL */
+static GdkPixbuf* thumbnail_cache_lookup( const char* key, time_t mtime )
+{
+    ThumbnailCacheEntry* entry;
+    GdkPixbuf* pixbuf = NULL;
+
+    G_LOCK( thumbnail_cache );
+    if ( thumbnail_cache &&
+            ( entry = (ThumbnailCacheEntry*)g_hash_table_lookup(
+                                                thumbnail_cache, key ) ) &&
+            entry->mtime == mtime )
+    {
+        g_queue_unlink( thumbnail_lru, entry->link );
+        g_queue_push_head_link( thumbnail_lru, entry->link );
+        pixbuf = g_object_ref( entry->pixbuf );
+    }
+    G_UNLOCK( thumbnail_cache );
+    return pixbuf;
+}
+
+static void thumbnail_cache_remove( ThumbnailCacheEntry* entry )
+{
+    g_hash_table_remove( thumbnail_cache, entry->key );
+    g_queue_delete_link( thumbnail_lru, entry->link );
+    thumbnail_cache_bytes -= entry->bytes;
+    thumbnail_cache_entry_free( entry );
+}
+
+static void thumbnail_cache_store( const char* key, time_t mtime,
+                                   GdkPixbuf* pixbuf )
+{
+    ThumbnailCacheEntry* entry;
+
+    if ( thumbnail_is_helper )
+        return;
+    G_LOCK( thumbnail_cache );
+    if ( !thumbnail_cache )
+    {
+        thumbnail_cache = g_hash_table_new( g_str_hash, g_str_equal );
+        thumbnail_lru = g_queue_new();
+    }
+    if ( ( entry = (ThumbnailCacheEntry*)g_hash_table_lookup(
+                                                thumbnail_cache, key ) ) )
+        thumbnail_cache_remove( entry );
+    entry = g_slice_new( ThumbnailCacheEntry );
+    entry->key = g_strdup( key );
+    entry->mtime = mtime;
+    entry->pixbuf = g_object_ref( pixbuf );
+    entry->bytes = gdk_pixbuf_get_rowstride( pixbuf ) *
+                                        gdk_pixbuf_get_height( pixbuf );
+    g_queue_push_head( thumbnail_lru, entry );
+    entry->link = thumbnail_lru->head;
+    g_hash_table_insert( thumbnail_cache, entry->key, entry );
+    thumbnail_cache_bytes += entry->bytes;
+
+    while ( thumbnail_cache_bytes > THUMBNAIL_CACHE_MAX_BYTES &&
+                                            thumbnail_lru->length > 1 )
+        thumbnail_cache_remove( (ThumbnailCacheEntry*)thumbnail_lru->tail->data );
+    G_UNLOCK( thumbnail_cache );
+}
+
+static char* thumbnail_cache_key( const char* file_path, int size )
+{
+    return g_strdup_printf( "%d:%s", size, file_path );
+}
+
+/* the smallest tier with thumbnails of at least size */
+static int thumbnail_get_tier( int size )
+{
+    int i;
+    for ( i = 0; i < N_THUMBNAIL_TIERS - 1; i++ )
+    {
+        if ( size <= thumbnail_tier_sizes[i] )
+            break;
+    }
+    return i;
+}
+
+/* Scale thumbnail so its longer side is size */
+static GdkPixbuf* thumbnail_scale( GdkPixbuf* thumbnail, int size )
+{
+    int w = gdk_pixbuf_get_width( thumbnail );
+    int h = gdk_pixbuf_get_height( thumbnail );
+
+    if ( w > h )
+    {
+        h = h * size / w;
+        w = size;
+    }
+    else if ( h > w )
+    {
+        w = w * size / h;
+        h = size;
+    }
+    else
+    {
+        w = h = size;
+    }
+    if ( w > 0 && h > 0 )
+        return gdk_pixbuf_scale_simple( thumbnail, w, h, GDK_INTERP_BILINEAR );
+    return NULL;
+}
+
+GdkPixbuf* vfs_thumbnail_get_cached( const char* file, int size, time_t mtime,
+                                     gboolean scale )
+{
+    char* key = thumbnail_cache_key( file, size );
+    char* tier_key;
+    GdkPixbuf* pixbuf = thumbnail_cache_lookup( key, mtime );
+    GdkPixbuf* tier_pixbuf;
+    int i;
+
+    /* make it from a thumbnail of a larger size loaded before */
+    for ( i = thumbnail_get_tier( size ); scale && !pixbuf &&
+                                            i < N_THUMBNAIL_TIERS; i++ )
+    {
+        tier_key = thumbnail_cache_key( file, -thumbnail_tier_sizes[i] );
+        tier_pixbuf = thumbnail_cache_lookup( tier_key, mtime );
+        g_free( tier_key );
+        if ( !tier_pixbuf )
+            continue;
+        if ( gdk_pixbuf_get_width( tier_pixbuf ) <= size &&
+                                    gdk_pixbuf_get_height( tier_pixbuf ) <= size )
+            pixbuf = g_object_ref( tier_pixbuf );  /* a small image */
+        else
+            pixbuf = thumbnail_scale( tier_pixbuf, size );
+        g_object_unref( tier_pixbuf );
+        if ( pixbuf )
+            thumbnail_cache_store( key, mtime, pixbuf );
+    }
+    g_free( key );
+    return pixbuf;
+}
+
+static void thumbnail_index_open()
+{
+    char* path;
+    char* dir;
+    int fd;
     struct stat statbuf;
-    GdkPixbuf* thumbnail, *result = NULL;
-    int create_size;
-    
-    if ( size > 256 )
-        create_size = 512;
-    else if ( size > 128 )
-        create_size = 256;
+    ThumbnailIndex* index;
+
+    path = g_build_filename( g_get_user_cache_dir(), "spacefm",
+                                                "thumbnail-index", NULL );
+    dir = g_path_get_dirname( path );
+    g_mkdir_with_parents( dir, 0700 );
+    g_free( dir );
+    fd = open( path, O_RDWR | O_CREAT, 0600 );
+    g_free( path );
+    if ( fd == -1 )
+        return;
+    /* kept open for flock - not for the helper */
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+    thumbnail_index_fd = fd;
+    thumbnail_index_lock( TRUE );
+    if ( fstat( fd, &statbuf ) == -1 || ( statbuf.st_size != THUMBNAIL_INDEX_SIZE
+                            && ftruncate( fd, THUMBNAIL_INDEX_SIZE ) == -1 ) )
+        index = (ThumbnailIndex*)-1;
     else
-        create_size = 128;
-    
-    gboolean file_is_video = FALSE;
-#ifdef HAVE_FFMPEG
-    VFSMimeType* mimetype = vfs_mime_type_get_from_file_name( file_path );
-    if ( mimetype )
+        index = (ThumbnailIndex*)mmap( NULL, THUMBNAIL_INDEX_SIZE,
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( index != (void*)-1 && ( index->magic != THUMBNAIL_INDEX_MAGIC ||
+                                index->n_buckets != THUMBNAIL_INDEX_BUCKETS ) )
     {
-        if ( strncmp( vfs_mime_type_get_type( mimetype ), "video/", 6 ) == 0 )
-            file_is_video = TRUE;
-        vfs_mime_type_unref( mimetype );
+        memset( index, 0, THUMBNAIL_INDEX_SIZE );
+        index->magic = THUMBNAIL_INDEX_MAGIC;
+        index->n_buckets = THUMBNAIL_INDEX_BUCKETS;
     }
-#endif
+    thumbnail_index_unlock();
+    if ( index == (void*)-1 )
+    {
+        close( fd );
+        thumbnail_index_fd = -1;
+        return;
+    }
+    thumbnail_index = index;
+}
 
+static void thumbnail_index_get_md5( const char* md5_str, guint8* md5 )
+{
+    int i;
+    for ( i = 0; i < 16; i++ )
+        md5[i] = ( g_ascii_xdigit_value( md5_str[ i * 2 ] ) << 4 ) |
+                   g_ascii_xdigit_value( md5_str[ i * 2 + 1 ] );
+}
 
-    if ( file_is_video == FALSE )
+/* the record for md5 in its bucket, or the one to replace if !found */
+static ThumbnailIndexRecord* thumbnail_index_find( const guint8* md5,
+                                                   int tier_size,
+                                                   gboolean* found )
+{
+    guint32 hash;
+    ThumbnailIndexRecord* bucket;
+    int i;
+
+    memcpy( &hash, md5, sizeof( hash ) );
+    hash += tier_size;
+    bucket = &thumbnail_index->records[ ( hash % THUMBNAIL_INDEX_BUCKETS ) *
+                                                    THUMBNAIL_INDEX_WAYS ];
+    for ( i = 0; i < THUMBNAIL_INDEX_WAYS; i++ )
     {
-        if ( !gdk_pixbuf_get_file_info( file_path, &w, &h ) )
-            return NULL;   /* image format cannot be recognized */
+        if ( bucket[i].tier_size == tier_size &&
+                                        !memcmp( bucket[i].md5, md5, 16 ) )
+        {
+            *found = TRUE;
+            return &bucket[i];
+        }
+    }
+    *found = FALSE;
+    for ( i = 0; i < THUMBNAIL_INDEX_WAYS; i++ )
+    {
+        if ( bucket[i].thumb_size == 0 )
+            return &bucket[i];
+    }
+    return &bucket[ md5[ 4 ] % THUMBNAIL_INDEX_WAYS ];
+}
 
-        /* If the image itself is very small, we should load it directly */
-        if ( w <= create_size && h <= create_size )
+/* Returns 1 if the thumbnail file is current and big enough for size,
+ * 0 if it has to be made again, or -1 if that's unknown - then the file
+ * has to be decoded to check its tEXt::Thumb::MTime */
+static int thumbnail_index_check( const char* md5_str,
+                                  const char* thumbnail_file,
+                                  int tier_size, int size, time_t mtime )
+{
+    guint8 md5[ 16 ];
+    ThumbnailIndexRecord rec;
+    struct stat statbuf;
+    gboolean found;
+
+    if ( !thumbnail_index )
+        return -1;
+    thumbnail_index_get_md5( md5_str, md5 );
+    thumbnail_index_lock( FALSE );
+    rec = *thumbnail_index_find( md5, tier_size, &found );
+    thumbnail_index_unlock();
+    if ( !found )
+        return -1;
+    /* the png may have been replaced by another program */
+    if ( stat( thumbnail_file, &statbuf ) == -1 )
+        return 0;
+    if ( statbuf.st_mtime != rec.thumb_mtime ||
+                                    statbuf.st_size != rec.thumb_size )
+        return -1;
+    if ( rec.mtime != mtime || ( rec.width < size && rec.height < size ) )
+        return 0;
+    return 1;
+}
+
+static void thumbnail_index_store( const char* md5_str,
+                                   const char* thumbnail_file, int tier_size,
+                                   time_t mtime, int width, int height )
+{
+    guint8 md5[ 16 ];
+    ThumbnailIndexRecord* rec;
+    struct stat statbuf;
+    gboolean found;
+
+    if ( !thumbnail_index || stat( thumbnail_file, &statbuf ) == -1 )
+        return;
+    thumbnail_index_get_md5( md5_str, md5 );
+    thumbnail_index_lock( TRUE );
+    rec = thumbnail_index_find( md5, tier_size, &found );
+    memcpy( rec->md5, md5, 16 );
+    rec->tier_size = tier_size;
+    rec->mtime = mtime;
+    rec->thumb_mtime = statbuf.st_mtime;
+    rec->thumb_size = statbuf.st_size ? statbuf.st_size : 1;
+    rec->width = width;
+    rec->height = height;
+    thumbnail_index_unlock();
+}
+
+/* Most cameras embed a small jpeg preview in the EXIF data of their photos,
+ * which is much faster to decode than the photo itself */
+#define EXIF_READ_MAX ( 128 * 1024 )
+
+static guint16 exif_get16( const guchar* p, gboolean big_endian )
+{
+    return big_endian ? ( p[0] << 8 ) | p[1] : ( p[1] << 8 ) | p[0];
+}
+
+static guint32 exif_get32( const guchar* p, gboolean big_endian )
+{
+    return big_endian ?
+            ( (guint32)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3] :
+            ( (guint32)p[3] << 24 ) | ( p[2] << 16 ) | ( p[1] << 8 ) | p[0];
+}
+
+/* Rotate and flip as gdk_pixbuf_apply_embedded_orientation() does for the
+ * EXIF orientation of the photo - the preview has none of its own */
+static GdkPixbuf* exif_apply_orientation( GdkPixbuf* src, int orientation )
+{
+    GdkPixbuf* temp;
+    GdkPixbuf* dest;
+
+    switch ( orientation )
+    {
+    case 2:
+        dest = gdk_pixbuf_flip( src, TRUE );
+        break;
+    case 3:
+        dest = gdk_pixbuf_rotate_simple( src, GDK_PIXBUF_ROTATE_UPSIDEDOWN );
+        break;
+    case 4:
+        dest = gdk_pixbuf_flip( src, FALSE );
+        break;
+    case 5:
+        temp = gdk_pixbuf_rotate_simple( src, GDK_PIXBUF_ROTATE_CLOCKWISE );
+        dest = gdk_pixbuf_flip( temp, TRUE );
+        g_object_unref( temp );
+        break;
+    case 6:
+        dest = gdk_pixbuf_rotate_simple( src, GDK_PIXBUF_ROTATE_CLOCKWISE );
+        break;
+    case 7:
+        temp = gdk_pixbuf_rotate_simple( src, GDK_PIXBUF_ROTATE_CLOCKWISE );
+        dest = gdk_pixbuf_flip( temp, FALSE );
+        g_object_unref( temp );
+        break;
+    case 8:
+        dest = gdk_pixbuf_rotate_simple( src, GDK_PIXBUF_ROTATE_COUNTERCLOCKWISE );
+        break;
+    default:
+        return src;
+    }
+    g_object_unref( src );
+    return dest;
+}
+
+/* Returns the EXIF preview of a jpeg of w x h scaled to fit create_size,
+ * or NULL if there's none or it's too small or of another aspect ratio (some
+ * cameras pad it with black bars).  w and h must be the size of the jpeg
+ * itself from gdk_pixbuf_get_file_info - not of an old thumbnail */
+static GdkPixbuf* thumbnail_load_exif( const char* file_path, int create_size,
+                                       int w, int h )
+{
+    guchar* data;
+    const guchar* tiff;
+    const guchar* entry;
+    int fd, len, pos, seg_len, tw, th;
+    guint32 tiff_len = 0, ifd, n, i, thumb_offset = 0, thumb_len = 0;
+    guint16 tag;
+    int orientation = 1;
+    gboolean be;
+    GdkPixbufLoader* loader;
+    GdkPixbuf* pixbuf = NULL;
+    GdkPixbuf* scaled;
+
+    /* the aspect ratio can't be checked without the size of the image */
+    if ( w <= 0 || h <= 0 )
+        return NULL;
+    if ( ( fd = open( file_path, O_RDONLY ) ) == -1 )
+        return NULL;
+    data = g_malloc( EXIF_READ_MAX );
+    len = read( fd, data, EXIF_READ_MAX );
+    close( fd );
+    if ( len < 4 || data[0] != 0xff || data[1] != 0xd8 )
+        goto _out;
+
+    /* find the APP1 Exif segment */
+    tiff = NULL;
+    for ( pos = 2; pos + 4 <= len && data[pos] == 0xff; pos += 2 + seg_len )
+    {
+        if ( data[pos + 1] == 0xda )    /* start of scan */
+            break;
+        seg_len = ( data[pos + 2] << 8 ) | data[pos + 3];
+        if ( data[pos + 1] == 0xe1 && seg_len >= 16 && pos + 10 <= len &&
+                                    !memcmp( data + pos + 4, "Exif\0\0", 6 ) )
+        {
+            tiff = data + pos + 10;
+            tiff_len = MIN( seg_len - 8, len - pos - 10 );
+            break;
+        }
+    }
+    if ( !tiff || tiff_len < 8 )
+        goto _out;
+    if ( tiff[0] == 'M' && tiff[1] == 'M' )
+        be = TRUE;
+    else if ( tiff[0] == 'I' && tiff[1] == 'I' )
+        be = FALSE;
+    else
+        goto _out;
+    if ( exif_get16( tiff + 2, be ) != 42 )
+        goto _out;
+
+    /* IFD0 has the orientation of the photo, IFD1 the preview */
+    ifd = exif_get32( tiff + 4, be );
+    for ( i = 0; i < 2; i++ )
+    {
+        if ( ifd < 8 || ifd > tiff_len - 6 )
+            goto _out;
+        n = exif_get16( tiff + ifd, be );
+        if ( n > ( tiff_len - ifd - 6 ) / 12 )
+            goto _out;
+        for ( entry = tiff + ifd + 2; entry < tiff + ifd + 2 + n * 12;
+                                                                entry += 12 )
+        {
+            tag = exif_get16( entry, be );
+            if ( i == 0 && tag == 0x0112 )
+                orientation = exif_get16( entry + 8, be );
+            else if ( i == 1 && tag == 0x0201 )
+                thumb_offset = exif_get32( entry + 8, be );
+            else if ( i == 1 && tag == 0x0202 )
+                thumb_len = exif_get32( entry + 8, be );
+        }
+        ifd = exif_get32( tiff + ifd + 2 + n * 12, be );
+    }
+    if ( !thumb_offset || !thumb_len || thumb_offset > tiff_len ||
+                                        thumb_len > tiff_len - thumb_offset )
+        goto _out;
+
+    loader = gdk_pixbuf_loader_new_with_type( "jpeg", NULL );
+    if ( !loader )
+        goto _out;
+    if ( gdk_pixbuf_loader_write( loader, tiff + thumb_offset, thumb_len, NULL )
+                        && gdk_pixbuf_loader_close( loader, NULL ) &&
+                        ( pixbuf = gdk_pixbuf_loader_get_pixbuf( loader ) ) )
+        g_object_ref( pixbuf );
+    else
+        gdk_pixbuf_loader_close( loader, NULL );
+    g_object_unref( loader );
+    if ( !pixbuf )
+        goto _out;
+
+    tw = gdk_pixbuf_get_width( pixbuf );
+    th = gdk_pixbuf_get_height( pixbuf );
+    if ( ( tw < create_size && th < create_size ) ||
+                ABS( (gint64)tw * h - (gint64)th * w ) > (gint64)tw * h / 50 )
+    {
+        g_object_unref( pixbuf );
+        pixbuf = NULL;
+        goto _out;
+    }
+    if ( tw > create_size || th > create_size )
+    {
+        if ( tw > th )
+        {
+            th = MAX( 1, th * create_size / tw );
+            tw = create_size;
+        }
+        else
         {
-            if( w <= size && h <= size )
-                return gdk_pixbuf_new_from_file( file_path, NULL );
-            return gdk_pixbuf_new_from_file_at_size( file_path, size, size, NULL );
+            tw = MAX( 1, tw * create_size / th );
+            th = create_size;
         }
+        scaled = gdk_pixbuf_scale_simple( pixbuf, tw, th, GDK_INTERP_BILINEAR );
+        g_object_unref( pixbuf );
+        pixbuf = scaled;
+    }
+    if ( pixbuf )
+        pixbuf = exif_apply_orientation( pixbuf, orientation );
+_out:
+    g_free( data );
+    return pixbuf;
+}
+
+/* An image no larger than its thumbnail tier is shown as is */
+static GdkPixbuf* thumbnail_use_small( const char* file_path, int size,
+                                       time_t mtime, GdkPixbuf* thumbnail )
+{
+    GdkPixbuf* result;
+    char* tier_key;
+
+    if( gdk_pixbuf_get_width( thumbnail ) <= size &&
+                                    gdk_pixbuf_get_height( thumbnail ) <= size )
+        result = g_object_ref( thumbnail );
+    else
+        result = thumbnail_scale( thumbnail, size );
+    tier_key = thumbnail_cache_key( file_path,
+                        -thumbnail_tier_sizes[ thumbnail_get_tier( size ) ] );
+    thumbnail_cache_store( tier_key, mtime, thumbnail );
+    g_free( tier_key );
+    return result;
+}
+
+static GdkPixbuf* thumbnail_load_small( const char* file_path, int size,
+                                        time_t mtime )
+{
+    GdkPixbuf* thumbnail, *result = NULL;
+
+    thumbnail = gdk_pixbuf_new_from_file( file_path, NULL );
+    if ( thumbnail )
+    {
+        result = thumbnail_use_small( file_path, size, mtime, thumbnail );
+        g_object_unref( thumbnail );
     }
+    return result;
+}
 
+/* the name of the thumbnail files of uri: its md5 and .png */
+static void thumbnail_get_file_name( const char* uri, char* file_name )
+{
 #if GLIB_CHECK_VERSION(2, 16, 0)
+    GChecksum *cs;
+
     cs = g_checksum_new(G_CHECKSUM_MD5);
     g_checksum_update(cs, uri, strlen(uri));
     memcpy( file_name, g_checksum_get_string(cs), 32 );
     g_checksum_free(cs);
 #else
+    md5_state_t md5_state;
+    md5_byte_t md5[ 16 ];
+    int i;
+
     md5_init( &md5_state );
     md5_append( &md5_state, ( md5_byte_t * ) uri, strlen( uri ) );
     md5_finish( &md5_state, md5 );
@@ -416,9 +1055,54 @@ static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
         sprintf( ( file_name + i * 2 ), "%02x", md5[ i ] );
 #endif
     strcpy( ( file_name + 32 ), ".png" );
+}
 
-    thumbnail_file = g_build_filename( g_get_home_dir(),
-                                       ".thumbnails/normal",
+/* With decode FALSE, only thumbnails existing in ~/.thumbnails are loaded */
+static GdkPixbuf* thumbnail_create_real( const char* file_path, const char* uri,
+                                         int size, time_t mtime,
+                                         gboolean file_is_video,
+                                         gboolean decode )
+{
+    char file_name[ 40 ];
+    char* thumbnail_file;
+    char mtime_str[ 32 ];
+    const char* thumb_mtime;
+    int w, h, valid;
+    struct stat statbuf;
+    GdkPixbuf* thumbnail, *result = NULL;
+    int tier, create_size;
+    int image_w = 0, image_h = 0;
+    char* tier_key;
+    GdkPixbufFormat* format;
+    gboolean is_jpeg = FALSE;
+    
+    tier = thumbnail_get_tier( size );
+    create_size = thumbnail_tier_sizes[ tier ];
+    tier_key = thumbnail_cache_key( file_path, -create_size );
+
+    if ( file_is_video == FALSE && decode )
+    {
+        if ( !( format = gdk_pixbuf_get_file_info( file_path,
+                                                    &image_w, &image_h ) ) )
+        {
+            g_free( tier_key );
+            return NULL;   /* image format cannot be recognized */
+        }
+
+        /* If the image itself is very small, we should load it directly */
+        if ( image_w <= create_size && image_h <= create_size )
+        {
+            g_free( tier_key );
+            return thumbnail_load_small( file_path, size, mtime );
+        }
+        char* format_name = gdk_pixbuf_format_get_name( format );
+        is_jpeg = !g_strcmp0( format_name, "jpeg" );
+        g_free( format_name );
+    }
+
+    thumbnail_get_file_name( uri, file_name );
+    thumbnail_file = g_build_filename( g_get_home_dir(), ".thumbnails",
+                                       thumbnail_tier_dirs[ tier ],
                                        file_name, NULL );
 
     if( G_UNLIKELY( 0 == mtime ) )
@@ -432,26 +1116,38 @@ static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
          * don't create a thumbnail (is copying?)
          * FIXME: This means that a newly saved file may not show a thumbnail
          * until refresh. */
+    {
+        g_free( tier_key );
+        g_free( thumbnail_file );
         return NULL;
+    }
 
-    /* load existing thumbnail */
-    thumbnail = gdk_pixbuf_new_from_file( thumbnail_file, NULL );
+    /* load existing thumbnail, unless the index says it's unusable */
+    valid = thumbnail_index_check( file_name, thumbnail_file, create_size,
+                                                                size, mtime );
+    thumbnail = valid ? gdk_pixbuf_new_from_file( thumbnail_file, NULL ) : NULL;
     if ( thumbnail )
     {
         w = gdk_pixbuf_get_width( thumbnail );
         h = gdk_pixbuf_get_height( thumbnail );
     }
-    if ( !thumbnail || ( w < size && h < size ) ||
+    if ( !thumbnail || ( valid == -1 && ( ( w < size && h < size ) ||
                 !( thumb_mtime = gdk_pixbuf_get_option( thumbnail,
                                                 "tEXt::Thumb::MTime" ) ) ||
-                atol( thumb_mtime ) != mtime )
+                atol( thumb_mtime ) != mtime ) ) )
     {
         if( thumbnail )
             g_object_unref( thumbnail );
+        thumbnail = NULL;
         /* create new thumbnail */
-        if ( file_is_video == FALSE )
+        if ( decode && file_is_video == FALSE )
         {
-            thumbnail = gdk_pixbuf_new_from_file_at_size( file_path,
+            thumbnail = is_jpeg ?
+                    thumbnail_load_exif( file_path, create_size,
+                                                    image_w, image_h ) : NULL;
+            /* the jpeg loader decodes at 1/2 .. 1/8 scale for this */
+            if ( !thumbnail )
+                thumbnail = gdk_pixbuf_new_from_file_at_size( file_path,
                                             create_size, create_size, NULL );
             if ( thumbnail )
             {
@@ -461,14 +1157,18 @@ static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
                 thumbnail = gdk_pixbuf_apply_embedded_orientation( thumbnail );
                 g_object_unref( thumbnail_old );
                 sprintf( mtime_str, "%lu", mtime );
-                gdk_pixbuf_save( thumbnail, thumbnail_file, "png", NULL,
+                if ( gdk_pixbuf_save( thumbnail, thumbnail_file, "png", NULL,
                                  "tEXt::Thumb::URI", uri, "tEXt::Thumb::MTime",
-                                 mtime_str, NULL );
+                                 mtime_str, NULL ) )
+                    thumbnail_index_store( file_name, thumbnail_file,
+                                        create_size, mtime,
+                                        gdk_pixbuf_get_width( thumbnail ),
+                                        gdk_pixbuf_get_height( thumbnail ) );
                 chmod( thumbnail_file, 0600 );  /* only the owner can read it. */
             }
         }
 #ifdef HAVE_FFMPEG
-        else
+        else if ( decode )
         {
             video_thumbnailer* video_thumb = video_thumbnailer_create();
 
@@ -490,38 +1190,454 @@ static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
 
                 chmod( thumbnail_file, 0600 );  /* only the owner can read it. */
                 thumbnail = gdk_pixbuf_new_from_file( thumbnail_file, NULL );
+                /* without its MTime it would be made again on every load */
+                if ( thumbnail && !gdk_pixbuf_get_option( thumbnail,
+                                                    "tEXt::Thumb::MTime" ) )
+                {
+                    sprintf( mtime_str, "%lu", mtime );
+                    gdk_pixbuf_save( thumbnail, thumbnail_file, "png", NULL,
+                                 "tEXt::Thumb::URI", uri, "tEXt::Thumb::MTime",
+                                 mtime_str, NULL );
+                }
             }
         }
 #endif
     }
+    else if ( valid == -1 )
+        thumbnail_index_store( file_name, thumbnail_file, create_size,
+                                                                mtime, w, h );
 
     if ( thumbnail )
     {
-        w = gdk_pixbuf_get_width( thumbnail );
-        h = gdk_pixbuf_get_height( thumbnail );
+        result = thumbnail_scale( thumbnail, size );
+        thumbnail_cache_store( tier_key, mtime, thumbnail );
+        g_object_unref( thumbnail );
+    }
 
-        if ( w > h )
+    g_free( tier_key );
+    g_free( thumbnail_file );
+    return result;
+}
+
+/* Thumbnails are made by spacefm --thumbnailer helper processes, so a
+ * decoder that hangs or crashes on some file costs only that thumbnail.
+ * Each pool thread streams its requests to its own helper, which is killed
+ * after THUMBNAIL_HELPER_TIMEOUT and started again for the next request.
+ * The helper first says "ready".  A request is a line "size mtime is_video
+ * uri", answered by "1" once a thumbnail file which loads without decoding
+ * the file again is written, "0" if none can be made, or for an image small
+ * enough to be shown as is, by "2 width height has_alpha" and its RGB(A)
+ * rows.  Files the helper failed on are recorded in ~/.thumbnails/fail,
+ * and not tried again until they change */
+#define THUMBNAIL_HELPER_TIMEOUT 15000      /* ms */
+#define THUMBNAIL_HELPER_MAX_MEM ( 1024 * 1024 * 1024 )
+
+typedef struct
+{
+    GPid pid;
+    int fd;
+} ThumbnailHelper;
+
+static GStaticPrivate thumbnail_helper_key = G_STATIC_PRIVATE_INIT;
+
+static void thumbnail_helper_stop( ThumbnailHelper* helper )
+{
+    if ( helper->fd == -1 )
+        return;
+    close( helper->fd );
+    helper->fd = -1;
+    kill( helper->pid, SIGKILL );
+    waitpid( helper->pid, NULL, 0 );
+    g_spawn_close_pid( helper->pid );
+}
+
+static void thumbnail_helper_free( ThumbnailHelper* helper )
+{
+    thumbnail_helper_stop( helper );
+    g_slice_free( ThumbnailHelper, helper );
+}
+
+static void thumbnail_helper_child_setup( gpointer user_data )
+{
+    int fd = GPOINTER_TO_INT( user_data );
+    dup2( fd, 0 );
+    dup2( fd, 1 );
+}
+
+/* Read up to buf_size bytes, or up to and including a newline if
+ * line, killing the helper on timeout or error */
+static int thumbnail_helper_read( ThumbnailHelper* helper, char* buf,
+                                  int buf_size, gboolean line )
+{
+    struct pollfd pfd;
+    char* nl;
+    int len, n;
+
+    pfd.fd = helper->fd;
+    pfd.events = POLLIN;
+    for ( len = 0; len < buf_size; len += n )
+    {
+        n = poll( &pfd, 1, THUMBNAIL_HELPER_TIMEOUT );
+        /* only peek at a line, to leave the data after it */
+        if ( n > 0 )
+            n = recv( helper->fd, buf + len, buf_size - len,
+                                                    line ? MSG_PEEK : 0 );
+        if ( n > 0 && line )
         {
-            h = h * size / w;
-            w = size;
+            if ( ( nl = memchr( buf + len, '\n', n ) ) )
+                n = nl - ( buf + len ) + 1;
+            n = recv( helper->fd, buf + len, n, 0 );
         }
-        else if ( h > w )
+        if ( n <= 0 )
         {
-            w = w * size / h;
-            h = size;
+            thumbnail_helper_stop( helper );
+            return -1;
         }
-        else
+        if ( line && buf[ len + n - 1 ] == '\n' )
+            return len + n;
+    }
+    return len;
+}
+
+/* Read a reply without its newline */
+static gboolean thumbnail_helper_read_line( ThumbnailHelper* helper,
+                                            char* buf, int buf_size )
+{
+    int len = thumbnail_helper_read( helper, buf, buf_size - 1, TRUE );
+
+    if ( len < 0 )
+        return FALSE;
+    if ( len > 0 && buf[ len - 1 ] == '\n' )
+        len--;
+    buf[ len ] = '\0';
+    return TRUE;
+}
+
+static gboolean thumbnail_helper_start( ThumbnailHelper* helper )
+{
+    static char* exe = NULL;
+    char* argv[ 3 ];
+    char reply[ 8 ];
+    int fds[ 2 ];
+    gboolean ret;
+
+    if ( !exe && !( exe = g_file_read_link( "/proc/self/exe", NULL ) ) )
+        exe = g_strdup( "spacefm" );
+    /* a socket rather than pipes, to send without SIGPIPE */
+    if ( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == -1 )
+        return FALSE;
+    fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+    argv[0] = exe;
+    argv[1] = "--thumbnailer";
+    argv[2] = NULL;
+    ret = g_spawn_async( NULL, argv, NULL,
+                         G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                         thumbnail_helper_child_setup,
+                         GINT_TO_POINTER( fds[1] ), &helper->pid, NULL );
+    close( fds[1] );
+    if ( !ret )
+    {
+        close( fds[0] );
+        return FALSE;
+    }
+    helper->fd = fds[0];
+    if ( !thumbnail_helper_read_line( helper, reply, sizeof( reply ) ) ||
+                                                    strcmp( reply, "ready" ) )
+    {
+        /* not a spacefm which knows --thumbnailer - decode in process */
+        g_warning( "thumbnailer %s didn't start", exe );
+        thumbnail_helper_stop( helper );
+        thumbnail_use_helper = FALSE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Returns the helper's reply, 0 if it failed, or -1 if there's no helper.
+ * For 2, small is set to the image */
+static int thumbnail_helper_request( const char* uri, int size, time_t mtime,
+                                     gboolean file_is_video,
+                                     GdkPixbuf** small )
+{
+    ThumbnailHelper* helper;
+    char* msg;
+    char reply[ 32 ];
+    int len, sent, n;
+    int reply_code, w, h, has_alpha, tier_size;
+    char* pixels;
+
+    helper = (ThumbnailHelper*)g_static_private_get( &thumbnail_helper_key );
+    if ( !helper )
+    {
+        helper = g_slice_new0( ThumbnailHelper );
+        helper->fd = -1;
+        g_static_private_set( &thumbnail_helper_key, helper,
+                                        (GDestroyNotify)thumbnail_helper_free );
+    }
+    if ( helper->fd == -1 && !thumbnail_helper_start( helper ) )
+        return -1;
+
+    msg = g_strdup_printf( "%d %ld %d %s\n", size, (long)mtime,
+                                                    file_is_video ? 1 : 0, uri );
+    len = strlen( msg );
+    for ( sent = 0; sent < len; sent += n )
+    {
+        if ( ( n = send( helper->fd, msg + sent, len - sent,
+                                                    MSG_NOSIGNAL ) ) <= 0 )
+            break;
+    }
+    g_free( msg );
+    if ( sent < len || !thumbnail_helper_read_line( helper, reply,
+                                                        sizeof( reply ) ) )
+    {
+        g_warning( "thumbnailer failed or timed out on %s", uri );
+        thumbnail_helper_stop( helper );
+        return 0;
+    }
+    reply_code = atoi( reply );
+    if ( reply_code != 2 )
+        return reply_code;
+
+    /* the pixels of a small image */
+    tier_size = thumbnail_tier_sizes[ thumbnail_get_tier( size ) ];
+    if ( sscanf( reply, "2 %d %d %d", &w, &h, &has_alpha ) != 3 ||
+                                w < 1 || w > tier_size || h < 1 || h > tier_size )
+    {
+        thumbnail_helper_stop( helper );
+        return 0;
+    }
+    len = w * h * ( has_alpha ? 4 : 3 );
+    pixels = g_malloc( len );
+    if ( thumbnail_helper_read( helper, pixels, len, FALSE ) != len )
+    {
+        g_free( pixels );
+        return 0;
+    }
+    *small = gdk_pixbuf_new_from_data( (guchar*)pixels, GDK_COLORSPACE_RGB,
+                                       has_alpha, 8, w, h,
+                                       w * ( has_alpha ? 4 : 3 ),
+                                       (GdkPixbufDestroyNotify)g_free, NULL );
+    return 2;
+}
+
+static char* thumbnail_fail_get_path( const char* uri )
+{
+    char file_name[ 40 ];
+
+    thumbnail_get_file_name( uri, file_name );
+    return g_build_filename( g_get_home_dir(), ".thumbnails", "fail",
+                             "spacefm", file_name, NULL );
+}
+
+/* whether the helper failed on this version of the file before */
+static gboolean thumbnail_fail_check( const char* uri, time_t mtime )
+{
+    char* path;
+    struct stat statbuf;
+    GdkPixbuf* fail;
+    const char* fail_mtime;
+    gboolean ret = FALSE;
+
+    path = thumbnail_fail_get_path( uri );
+    /* the fail file is written by us, so it's safe to load in process */
+    if ( stat( path, &statbuf ) == 0 &&
+                    ( fail = gdk_pixbuf_new_from_file( path, NULL ) ) )
+    {
+        ret = ( fail_mtime = gdk_pixbuf_get_option( fail,
+                                                "tEXt::Thumb::MTime" ) ) &&
+              atol( fail_mtime ) == mtime;
+        g_object_unref( fail );
+    }
+    g_free( path );
+    return ret;
+}
+
+static void thumbnail_fail_store( const char* uri, time_t mtime )
+{
+    char* path;
+    GdkPixbuf* fail;
+    char mtime_str[ 32 ];
+
+    if ( !( fail = gdk_pixbuf_new( GDK_COLORSPACE_RGB, TRUE, 8, 1, 1 ) ) )
+        return;
+    gdk_pixbuf_fill( fail, 0 );
+    path = thumbnail_fail_get_path( uri );
+    sprintf( mtime_str, "%lu", mtime );
+    if ( gdk_pixbuf_save( fail, path, "png", NULL, "tEXt::Thumb::URI", uri,
+                          "tEXt::Thumb::MTime", mtime_str, NULL ) )
+        chmod( path, 0600 );
+    g_free( path );
+    g_object_unref( fail );
+}
+
+static GdkPixbuf* vfs_thumbnail_create( const char* file_path, const char* uri,
+                                        int size, time_t mtime )
+{
+    GdkPixbuf* result;
+    GdkPixbuf* small = NULL;
+    gboolean file_is_video = FALSE;
+
+#ifdef HAVE_FFMPEG
+    VFSMimeType* mimetype = vfs_mime_type_get_from_file_name( file_path );
+    if ( mimetype )
+    {
+        if ( strncmp( vfs_mime_type_get_type( mimetype ), "video/", 6 ) == 0 )
+            file_is_video = TRUE;
+        vfs_mime_type_unref( mimetype );
+    }
+#endif
+
+    if ( !thumbnail_use_helper )
+        return thumbnail_create_real( file_path, uri, size, mtime,
+                                      file_is_video, TRUE );
+
+    /* existing thumbnails are loaded here, new ones made by the helper */
+    result = thumbnail_create_real( file_path, uri, size, mtime,
+                                    file_is_video, FALSE );
+    if ( result || thumbnail_fail_check( uri, mtime ) )
+        return result;
+    switch ( thumbnail_helper_request( uri, size, mtime, file_is_video,
+                                                                &small ) )
+    {
+    case -1:
+        return thumbnail_create_real( file_path, uri, size, mtime,
+                                      file_is_video, TRUE );
+    case 1:
+        return thumbnail_create_real( file_path, uri, size, mtime,
+                                      file_is_video, FALSE );
+    case 2:
+        /* the helper has decoded it safely, and it's small */
+        result = thumbnail_use_small( file_path, size, mtime, small );
+        g_object_unref( small );
+        return result;
+    }
+    /* a video still being written is tried again (see
+     * thumbnail_create_real) */
+    if ( !( file_is_video && time( NULL ) - mtime < 5 ) )
+        thumbnail_fail_store( uri, mtime );
+    return NULL;
+}
+
+void vfs_thumbnail_set_helper( gboolean use_helper )
+{
+    thumbnail_use_helper = use_helper;
+}
+
+/* The main loop of spacefm --thumbnailer */
+int vfs_thumbnail_helper_main()
+{
+    struct rlimit limit;
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    char* uri;
+    char* file_path;
+    int size, is_video;
+    long mtime;
+    GdkPixbuf* result;
+    FILE* out;
+    int reply, image_w, image_h, tier_size, y;
+
+    thumbnail_is_helper = TRUE;
+    /* decoders may print to stdout - keep that out of the replies */
+    if ( !( out = fdopen( dup( 1 ), "w" ) ) )
+        return 1;
+    dup2( 2, 1 );
+    /* stay out of the way of spacefm, and don't let a decoder take all
+     * memory */
+    setpriority( PRIO_PROCESS, 0, 10 );
+    if ( getrlimit( RLIMIT_AS, &limit ) == 0 &&
+            ( limit.rlim_cur == RLIM_INFINITY ||
+              limit.rlim_cur > THUMBNAIL_HELPER_MAX_MEM ) )
+    {
+        limit.rlim_cur = THUMBNAIL_HELPER_MAX_MEM;
+        setrlimit( RLIMIT_AS, &limit );
+    }
+
+    fprintf( out, "ready\n" );
+    fflush( out );
+    while ( ( len = getline( &line, &line_size, stdin ) ) > 0 )
+    {
+        if ( line[ len - 1 ] == '\n' )
+            line[ len - 1 ] = '\0';
+        reply = 0;
+        result = NULL;
+        if ( sscanf( line, "%d %ld %d", &size, &mtime, &is_video ) == 3 &&
+                ( uri = strchr( line, ' ' ) ) &&
+                ( uri = strchr( uri + 1, ' ' ) ) &&
+                ( uri = strchr( uri + 1, ' ' ) ) &&
+                ( file_path = g_filename_from_uri( uri + 1, NULL, NULL ) ) )
+        {
+            tier_size = thumbnail_tier_sizes[ thumbnail_get_tier( size ) ];
+            if ( !is_video && gdk_pixbuf_get_file_info( file_path,
+                                                    &image_w, &image_h ) &&
+                        image_w <= tier_size && image_h <= tier_size )
+            {
+                /* a small image has no thumbnail file - send its pixels */
+                if ( ( result = gdk_pixbuf_new_from_file( file_path, NULL ) ) &&
+                        gdk_pixbuf_get_colorspace( result ) ==
+                                                        GDK_COLORSPACE_RGB &&
+                        gdk_pixbuf_get_bits_per_sample( result ) == 8 &&
+                        gdk_pixbuf_get_n_channels( result ) ==
+                                ( gdk_pixbuf_get_has_alpha( result ) ? 4 : 3 ) &&
+                        gdk_pixbuf_get_width( result ) <= tier_size &&
+                        gdk_pixbuf_get_height( result ) <= tier_size )
+                    reply = 2;
+            }
+            else if ( ( result = thumbnail_create_real( file_path, uri + 1,
+                                size, (time_t)mtime, is_video, TRUE ) ) )
+            {
+                g_object_unref( result );
+                /* say whether spacefm will get it without decoding */
+                if ( ( result = thumbnail_create_real( file_path, uri + 1,
+                                size, (time_t)mtime, is_video, FALSE ) ) )
+                    reply = 1;
+            }
+            g_free( file_path );
+        }
+        if ( reply == 2 )
         {
-            w = h = size;
+            fprintf( out, "2 %d %d %d\n", gdk_pixbuf_get_width( result ),
+                                          gdk_pixbuf_get_height( result ),
+                                          gdk_pixbuf_get_has_alpha( result ) );
+            for ( y = 0; y < gdk_pixbuf_get_height( result ); y++ )
+                fwrite( gdk_pixbuf_get_pixels( result ) +
+                                    y * gdk_pixbuf_get_rowstride( result ),
+                        gdk_pixbuf_get_n_channels( result ),
+                        gdk_pixbuf_get_width( result ), out );
         }
-        if ( w > 0 && h > 0 )
-            result = gdk_pixbuf_scale_simple(
-                         thumbnail,
-                         w, h, GDK_INTERP_BILINEAR );
-        g_object_unref( thumbnail );
+        else
+            fprintf( out, "%d\n", reply );
+        fflush( out );
+        if ( result )
+            g_object_unref( result );
     }
+    free( line );
+    return 0;
+}
 
-    g_free( thumbnail_file );
+static GdkPixbuf* _vfs_thumbnail_load( const char* file_path, const char* uri,
+                                                    int size, time_t mtime )
+{
+    struct stat statbuf;
+    char* key;
+    GdkPixbuf* result;
+
+    if( G_UNLIKELY( 0 == mtime ) )
+    {
+        if( stat( file_path, &statbuf ) != -1 )
+            mtime = statbuf.st_mtime;
+    }
+    if ( !( result = vfs_thumbnail_get_cached( file_path, size, mtime, TRUE ) ) )
+    {
+        result = vfs_thumbnail_create( file_path, uri, size, mtime );
+        if ( result )
+        {
+            key = thumbnail_cache_key( file_path, size );
+            thumbnail_cache_store( key, mtime, result );
+            g_free( key );
+        }
+    }
     return result;
 }
 
@@ -547,12 +1663,115 @@ GdkPixbuf* vfs_thumbnail_load_for_file( const char* file, int size, time_t mtime
 void vfs_thumbnail_init()
 {
     char* dir;
-    dir = g_build_filename( g_get_home_dir(), ".thumbnails/normal", NULL );
+    int i;
 
-    if( G_LIKELY( g_file_test( dir, G_FILE_TEST_IS_DIR ) ) )
-        chmod( dir, 0700 );
-    else
-        g_mkdir_with_parents( dir, 0700 );
+    for ( i = 0; i < N_THUMBNAIL_TIERS; i++ )
+    {
+        dir = g_build_filename( g_get_home_dir(), ".thumbnails",
+                                thumbnail_tier_dirs[i], NULL );
 
+        if( G_LIKELY( g_file_test( dir, G_FILE_TEST_IS_DIR ) ) )
+            chmod( dir, 0700 );
+        else
+            g_mkdir_with_parents( dir, 0700 );
+
+        g_free( dir );
+    }
+    /* files the thumbnailer helper failed on */
+    dir = g_build_filename( g_get_home_dir(), ".thumbnails", "fail",
+                            "spacefm", NULL );
+    g_mkdir_with_parents( dir, 0700 );
     g_free( dir );
+
+    if ( !thumbnail_index )
+        thumbnail_index_open();
+}
+
+/* Thumbnails per second made from the jpegs in dir_path, by decoding the
+ * photos and from their EXIF previews */
+void vfs_thumbnail_bench( const char* dir_path, int size )
+{
+    GDir* dir;
+    const char* name;
+    char* path;
+    char* format_name;
+    GPtrArray* paths;
+    GArray* dims;
+    GdkPixbufFormat* format;
+    GdkPixbuf* pixbuf;
+    GTimer* timer;
+    gdouble decode_secs, exif_secs;
+    int w, h, n_exif = 0;
+    guint i;
+
+    if ( !( dir = g_dir_open( dir_path, 0, NULL ) ) )
+    {
+        printf( "spacefm: cannot open %s\n", dir_path );
+        return;
+    }
+    paths = g_ptr_array_new_with_free_func( g_free );
+    dims = g_array_new( FALSE, FALSE, sizeof( int ) );
+    while ( ( name = g_dir_read_name( dir ) ) )
+    {
+        path = g_build_filename( dir_path, name, NULL );
+        if ( ( format = gdk_pixbuf_get_file_info( path, &w, &h ) ) )
+        {
+            format_name = gdk_pixbuf_format_get_name( format );
+            if ( !g_strcmp0( format_name, "jpeg" ) )
+            {
+                g_ptr_array_add( paths, path );
+                g_array_append_val( dims, w );
+                g_array_append_val( dims, h );
+                path = NULL;
+            }
+            g_free( format_name );
+        }
+        g_free( path );
+    }
+    g_dir_close( dir );
+    if ( !paths->len )
+    {
+        printf( "spacefm: no jpeg files in %s\n", dir_path );
+        goto _done;
+    }
+
+    timer = g_timer_new();
+    for ( i = 0; i < paths->len; i++ )
+    {
+        pixbuf = gdk_pixbuf_new_from_file_at_size(
+                            (char*)g_ptr_array_index( paths, i ), size, size,
+                            NULL );
+        if ( pixbuf )
+            g_object_unref( pixbuf );
+    }
+    decode_secs = g_timer_elapsed( timer, NULL );
+
+    g_timer_start( timer );
+    for ( i = 0; i < paths->len; i++ )
+    {
+        pixbuf = thumbnail_load_exif( (char*)g_ptr_array_index( paths, i ),
+                                      size,
+                                      g_array_index( dims, int, i * 2 ),
+                                      g_array_index( dims, int, i * 2 + 1 ) );
+        if ( !pixbuf )
+            pixbuf = gdk_pixbuf_new_from_file_at_size(
+                            (char*)g_ptr_array_index( paths, i ), size, size,
+                            NULL );
+        else
+            n_exif++;
+        if ( pixbuf )
+            g_object_unref( pixbuf );
+    }
+    exif_secs = g_timer_elapsed( timer, NULL );
+    g_timer_destroy( timer );
+
+    printf( "%u jpeg files, %d with a usable EXIF preview at size %d\n",
+                                                    paths->len, n_exif, size );
+    printf( "decode:   %.1f thumbnails/sec\n",
+                                    paths->len / MAX( decode_secs, 1e-9 ) );
+    printf( "exif:     %.1f thumbnails/sec\n",
+                                    paths->len / MAX( exif_secs, 1e-9 ) );
+_done:
+    g_ptr_array_free( paths, TRUE );
+    g_array_free( dims, TRUE );
 }
@@ -36,6 +36,8 @@ VFSThumbnailLoader* vfs_thumbnail_loader_new( VFSDir* dir );
 void vfs_thumbnail_loader_free( VFSThumbnailLoader* loader );
 
 void vfs_thumbnail_loader_request( VFSDir* dir, VFSFileInfo* file, gboolean is_big );
+/* move a queued request ahead of the others - called when its row is drawn */
+void vfs_thumbnail_loader_raise( VFSDir* dir, VFSFileInfo* file );
 void vfs_thumbnail_loader_cancel_all_requests( VFSDir* dir, gboolean is_big );
 
 /* Load thumbnail for the specified file
@@ -47,8 +49,20 @@ void vfs_thumbnail_loader_cancel_all_requests( VFSDir* dir, gboolean is_big );
 GdkPixbuf* vfs_thumbnail_load_for_uri(  const char* uri, int size, time_t mtime );
 GdkPixbuf* vfs_thumbnail_load_for_file( const char* file, int size, time_t mtime );
 
+/* Get a thumbnail already loaded for file with this mtime, or NULL.  If
+ * scale is TRUE it may be scaled from a larger one loaded before, else only
+ * a thumbnail of this size is returned - cheap enough for the main thread */
+GdkPixbuf* vfs_thumbnail_get_cached( const char* file, int size, time_t mtime,
+                                     gboolean scale );
+
 void vfs_thumbnail_init();
 
+/* Make new thumbnails in spacefm --thumbnailer processes (default TRUE) */
+void vfs_thumbnail_set_helper( gboolean use_helper );
+int vfs_thumbnail_helper_main();
+
+void vfs_thumbnail_bench( const char* dir_path, int size );
+
 /*
 void vfs_thumbnail_delete_for _file();
 void vfs_thumbnail_delete_for _uri();